@@ -5,11 +5,37 @@
  * about permitted and prohibited uses of this code.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <vector>
+#ifdef _WIN32
 #include <conio.h>
+#endif
+#include "Benchmark.h"
+#include "CodecValidator.h"
+#include "FrequencyMonitor.h"
 #include "Info.h"
+#include "PowerMonitor.h"
+#include "Profile.h"
+#include "PStateSampler.h"
+#include "PStateTrace.h"
+#include "RegisterAccess.h"
+#include "RegisterCache.h"
+#include "RegisterLog.h"
+#include "RegisterSnapshot.h"
+#include "ReplayCheck.h"
+#include "StringUtils.h"
+#include "TraceAnalyzer.h"
+#include "TelemetryDaemon.h"
+#include "TelemetryShm.h"
+#include "ThermalMonitor.h"
+#include "TransitionBenchmark.h"
 #include "Worker.h"
-#include "WinRing0.h"
 
 using std::cout;
 using std::cerr;
@@ -17,39 +43,401 @@ using std::endl;
 
 
 void PrintInfo(const Info& info);
+void PrintTelemetry();
+int PrintTrace(std::vector<const char*>& args);
 void WaitForKey();
+const char* ExtractOption(std::vector<const char*>& args, const char* name);
+double GetOption(std::vector<const char*>& args, const char* name, double defaultValue);
+
+
+static std::atomic<bool> stopRequested(false);
+
+static void OnStopSignal(int)
+{
+	stopRequested.store(true);
+}
 
 
 /// <summary>Entry point for the program.</summary>
 int main(int argc, const char* argv[])
 {
-	// initialize WinRing0
-	if (!InitializeOls() || GetDllStatus() != 0)
+	// the benchmark creates its own backends
+	if (argc > 1 && _stricmp(argv[1], "bench") == 0)
+	{
+		// bench [iterations=<n>] [replay=<register log>]
+		std::vector<const char*> args(argv, argv + argc);
+		const char* simulationLog = ExtractOption(args, "replay");
+		const int iterations = std::max(1, (int)GetOption(args, "iterations", 100000.0));
+
+		Benchmark::Print(cout, Benchmark::RunPciConfigReads(iterations));
+		cout << endl;
+		Benchmark::Print(cout, Benchmark::RunAccessLatencies(iterations, simulationLog));
+		return 0;
+	}
+
+	// reading the telemetry of a running daemon requires neither the driver nor privileges
+	if (argc == 2 && _stricmp(argv[1], "telemetry") == 0)
+	{
+		PrintTelemetry();
+		return 0;
+	}
+
+	// dumping and analyzing traces does not require the driver either
+	if (argc > 1 && _stricmp(argv[1], "dump") == 0)
+	{
+		std::vector<const char*> args(argv, argv + argc);
+		return PrintTrace(args);
+	}
+
+	if (argc > 1 && _stricmp(argv[1], "analyze") == 0)
+	{
+		// analyze dir=<path> [threads=<n>]
+		std::vector<const char*> args(argv, argv + argc);
+		const char* path = ExtractOption(args, "dir");
+		const int threads = (int)GetOption(args, "threads", 0.0);
+
+		if (path == NULL)
+		{
+			cerr << "ERROR: analyze requires dir=<path>" << endl;
+			return 3;
+		}
+
+		TraceAnalyzer::Print(cout, TraceAnalyzer::Run(TraceAnalyzer::ListTraces(path), threads));
+		return 0;
+	}
+
+	if (argc > 1 && _stricmp(argv[1], "validate") == 0)
+	{
+		// validate [rounds=<n>] [threads=<n>] [show=<n>]
+		std::vector<const char*> args(argv, argv + argc);
+		const int rounds = (int)GetOption(args, "rounds", 1000.0);
+		const int threads = (int)GetOption(args, "threads", 0.0);
+		const int show = (int)GetOption(args, "show", 10.0);
+
+		const CodecValidationReport report = CodecValidator::Run(rounds, threads);
+		CodecValidator::Print(cout, report, show);
+
+		int numLossy = 0;
+		for (size_t i = 0; i < report.Profiles.size(); i++)
+			numLossy += report.Profiles[i].NumLossy;
+		return (numLossy == 0 ? 0 : 4);
+	}
+
+	if (argc > 1 && _stricmp(argv[1], "replaycheck") == 0)
 	{
-		cerr << "ERROR: WinRing0 initialization failed" << endl;
-		DeinitializeOls();
+		// replaycheck [cpus=<n>] [log=<path>], records and replays an apply on a synthetic CPU
+		std::vector<const char*> args(argv, argv + argc);
+		const int cpus = (int)GetOption(args, "cpus", 0.0);
+		const char* logPath = ExtractOption(args, "log");
+		if (logPath == NULL)
+			logPath = "ReplayCheck.log";
+
+		const ReplayCheckResult result = ReplayCheck::Run(cpus, logPath);
+		for (size_t i = 0; i < result.Mismatches.size(); i++)
+			cerr << "MISMATCH: " << result.Mismatches[i] << endl;
+
+		cout << "Replayed an apply on " << result.NumCPUs << " logical CPUs (host: " << result.NumHostCPUs << "): "
+		     << (result.Mismatches.empty() ? "OK" : "FAILED") << endl;
+		return (result.Mismatches.empty() ? 0 : 4);
+	}
+
+	// record=<file> logs all register accesses, replay=<file> serves them from such a log instead of the hardware
+	std::vector<const char*> args(argv, argv + argc);
+	const char* recordPath = ExtractOption(args, "record");
+	const char* replayPath = ExtractOption(args, "replay");
+
+	argc = (int)args.size();
+	argv = &args[0];
+
+	// initialize the register backend (WinRing0 on Windows, msr driver and sysfs on Linux)
+	ReplayBackend* replay = (replayPath == NULL ? NULL : new ReplayBackend(replayPath));
+	RegisterBackend* backend = (replay != NULL ? replay : CreateDefaultBackend());
+	if (!backend->Initialize())
+	{
+		cerr << "ERROR: " << backend->GetName() << " initialization failed" << endl;
+		delete backend;
 
 		return 1;
 	}
 
+	if (recordPath != NULL)
+	{
+		backend = new RecordingBackend(backend, recordPath);
+		if (!backend->Initialize())
+		{
+			cerr << "ERROR: cannot create " << recordPath << endl;
+			delete backend;
+
+			return 1;
+		}
+	}
+
+	// Initialize() and PrintInfo() read several registers more than once
+	SetBackend(new RegisterCache(backend));
+
 	try
 	{
 		Info info;
 		if (!info.Initialize())
 		{
 			cout << "ERROR: unsupported CPU" << endl;
-			DeinitializeOls();
+			ShutdownBackend();
 			WaitForKey();
 			return 2;
 		}
 
-		if (argc > 1)
+		if (argc > 1 && _stricmp(argv[1], "sample") == 0)
+		{
+			// sample [rate=<Hz>] [duration=<seconds>], duration=0 runs until interrupted
+			const double rate = GetOption(args, "rate", 1000.0);
+			const double duration = GetOption(args, "duration", 10.0);
+
+			std::signal(SIGINT, OnStopSignal);
+			std::signal(SIGTERM, OnStopSignal);
+
+			PStateSampler sampler(info);
+			sampler.Print(cout, sampler.Run(rate, duration, &stopRequested));
+		}
+		else if (argc > 1 && _stricmp(argv[1], "freq") == 0)
+		{
+			// freq [interval=<ms>] [duration=<seconds>]
+			const double interval = GetOption(args, "interval", 100.0) / 1000.0;
+			const double duration = GetOption(args, "duration", 5.0);
+
+			if (!FrequencyMonitor::IsSupported())
+			{
+				cerr << "ERROR: APERF/MPERF not supported" << endl;
+				ShutdownBackend();
+				return 2;
+			}
+
+			FrequencyMonitor monitor(info);
+			monitor.Print(cout, monitor.Run(interval, duration));
+		}
+		else if (argc > 1 && _stricmp(argv[1], "daemon") == 0)
+		{
+			// daemon [interval=<ms>] [duration=<seconds>], runs until interrupted by default
+			const double interval = GetOption(args, "interval", 10.0) / 1000.0;
+			const double duration = GetOption(args, "duration", 0.0);
+
+			std::signal(SIGINT, OnStopSignal);
+			std::signal(SIGTERM, OnStopSignal);
+
+			TelemetryDaemon daemon(info);
+			if (!daemon.Run(interval, duration, stopRequested))
+			{
+				cerr << "ERROR: cannot create the telemetry segment (is another daemon running?)" << endl;
+				ShutdownBackend();
+				return 5;
+			}
+		}
+		else if (argc > 1 && _stricmp(argv[1], "thermal") == 0)
+		{
+			// thermal [interval=<ms>] [duration=<seconds>], runs until interrupted by default
+			const double interval = GetOption(args, "interval", 100.0) / 1000.0;
+			const double duration = GetOption(args, "duration", 0.0);
+
+			std::signal(SIGINT, OnStopSignal);
+			std::signal(SIGTERM, OnStopSignal);
+
+			// the clamp events are printed as they end
+			ThermalMonitor monitor(info);
+			const ThermalReport report = monitor.Run(interval, duration, stopRequested, &cout);
+			cout << endl;
+			monitor.Print(cout, report);
+		}
+		else if (argc > 1 && _stricmp(argv[1], "power") == 0)
+		{
+			// power [interval=<ms>] [duration=<seconds>] [csv=<file>]
+			const char* csvPath = ExtractOption(args, "csv");
+			const double interval = GetOption(args, "interval", 100.0) / 1000.0;
+			const double duration = GetOption(args, "duration", 10.0);
+
+			if (!PowerMonitor::IsSupported(info))
+			{
+				cerr << "ERROR: TDP running average not supported" << endl;
+				ShutdownBackend();
+				return 2;
+			}
+
+			std::signal(SIGINT, OnStopSignal);
+			std::signal(SIGTERM, OnStopSignal);
+
+			PowerMonitor monitor(info);
+			const std::vector<NodePower> nodes = monitor.Run(interval, duration, stopRequested);
+			monitor.Print(cout, nodes);
+
+			if (csvPath != NULL)
+			{
+				std::ofstream csv(csvPath);
+				PowerMonitor::PrintTimeline(csv, nodes);
+				if (!csv)
+					cerr << "ERROR: cannot write " << csvPath << endl;
+			}
+		}
+		else if (argc > 1 && _stricmp(argv[1], "transitions") == 0)
+		{
+			// transitions [iterations=<n>] [timeout=<ms>]
+			const int iterations = (int)GetOption(args, "iterations", 100.0);
+			const double timeout = GetOption(args, "timeout", 10.0) / 1000.0;
+
+			TransitionBenchmark benchmark(info);
+			benchmark.Print(cout, benchmark.Run(iterations, timeout));
+		}
+		else if (argc > 1 && _stricmp(argv[1], "trace") == 0)
+		{
+			// trace file=<path> [rate=<Hz>] [duration=<seconds>], runs until interrupted by default
+			const char* path = ExtractOption(args, "file");
+			const double rate = GetOption(args, "rate", 1000.0);
+			const double duration = GetOption(args, "duration", 0.0);
+
+			if (path == NULL)
+			{
+				cerr << "ERROR: trace requires file=<path>" << endl;
+				ShutdownBackend();
+				return 3;
+			}
+
+			std::signal(SIGINT, OnStopSignal);
+			std::signal(SIGTERM, OnStopSignal);
+
+			PStateTraceStats stats;
+			PStateTraceRecorder recorder(info);
+			if (!recorder.Run(path, rate, duration, stopRequested, stats))
+			{
+				cerr << "ERROR: cannot write " << path << endl;
+				ShutdownBackend();
+				return 5;
+			}
+
+			cout << stats.NumEvents << " transitions in " << stats.Seconds << " s (" << stats.Size << " bytes";
+			if (stats.NumDropped > 0)
+				cout << ", " << stats.NumDropped << " samples dropped";
+			cout << ")" << endl;
+		}
+		else if (argc > 1 && _stricmp(argv[1], "compile") == 0)
+		{
+			// compile file=<profiles> profile=<name> out=<path>, validates and encodes a profile for this CPU
+			const char* path = ExtractOption(args, "file");
+			const char* name = ExtractOption(args, "profile");
+			const char* outPath = ExtractOption(args, "out");
+
+			if (path == NULL || name == NULL || outPath == NULL)
+			{
+				cerr << "ERROR: compile requires file=<profiles> profile=<name> out=<path>" << endl;
+				ShutdownBackend();
+				return 3;
+			}
+
+			ProfileFile profiles;
+			if (!profiles.Load(path))
+			{
+				ShutdownBackend();
+				return 5;
+			}
+
+			const std::vector<std::string>* params = profiles.Find(name);
+			if (params == NULL)
+			{
+				cerr << "ERROR: profile " << name << " is not defined in " << path << endl;
+				ShutdownBackend();
+				return 3;
+			}
+
+			// the profile is parsed like the command line
+			std::vector<const char*> profileArgs(1, argv[0]);
+			for (size_t i = 0; i < params->size(); i++)
+				profileArgs.push_back((*params)[i].c_str());
+
+			Worker worker(info);
+			CompiledProfile profile;
+			profile.Name = name;
+
+			if (!worker.ParseParams((int)profileArgs.size(), &profileArgs[0]) || !worker.Compile(profile))
+			{
+				ShutdownBackend();
+				return 3;
+			}
+
+			if (!profile.Save(outPath))
+			{
+				cerr << "ERROR: cannot write " << outPath << endl;
+				ShutdownBackend();
+				return 5;
+			}
+
+			profile.Print(cout);
+		}
+		else if (argc > 1 && _stricmp(argv[1], "apply") == 0)
+		{
+			// apply file=<path> [ShowPlan=1] [Snapshot=<file>], applies a compiled profile
+			const char* path = ExtractOption(args, "file");
+
+			CompiledProfile profile;
+			if (path == NULL || !profile.Load(path))
+			{
+				cerr << "ERROR: apply requires a compiled profile (file=<path>)" << endl;
+				ShutdownBackend();
+				return 3;
+			}
+
+			// the remaining arguments may only be options of the apply itself, the settings are those of the profile
+			Worker worker(info);
+			if (!worker.ParseParams((int)args.size() - 1, &args[1]))
+			{
+				ShutdownBackend();
+				return 3;
+			}
+
+			if (worker.HasChanges())
+			{
+				cerr << "ERROR: apply only accepts ShowPlan= and Snapshot= besides the compiled profile" << endl;
+				ShutdownBackend();
+				return 3;
+			}
+
+			ApplyPlan plan = worker.PlanProfile(profile);
+			worker.Apply(plan);
+		}
+		else if (argc > 1 && _stricmp(argv[1], "restore") == 0)
+		{
+			// restore file=<path>, writes back the register values saved by an apply with Snapshot=<path>
+			const char* path = ExtractOption(args, "file");
+
+			if (path == NULL)
+			{
+				cerr << "ERROR: restore requires file=<path>" << endl;
+				ShutdownBackend();
+				return 3;
+			}
+
+			RegisterSnapshot snapshot;
+			if (!snapshot.Load(path))
+			{
+				cerr << "ERROR: cannot read " << path << endl;
+				ShutdownBackend();
+				return 5;
+			}
+
+			if (snapshot.Family != info.Family || snapshot.Model != info.Model || snapshot.NumCPUs != GetBackend().GetNumCPUs())
+			{
+				cerr << "ERROR: " << path << " has been taken on a different CPU" << endl;
+				ShutdownBackend();
+				return 3;
+			}
+
+			Worker worker(info);
+			ApplyPlan plan = worker.PlanRestore(snapshot);
+			plan.Print(cout);
+			worker.Execute(plan);
+		}
+		else if (argc > 1)
 		{
 			Worker worker(info);
 
 			if (!worker.ParseParams(argc, argv))
 			{
-				DeinitializeOls();
+				ShutdownBackend();
 				WaitForKey();
 				return 3;
 			}
@@ -65,14 +453,52 @@ int main(int argc, const char* argv[])
 	catch (const std::exception& e)
 	{
 		cerr << "ERROR: " << e.what() << endl;
-		DeinitializeOls();
+		ShutdownBackend();
 		WaitForKey();
 		return 10;
 	}
 
-	DeinitializeOls();
+	int result = 0;
 
-	return 0;
+	if (replay != NULL)
+	{
+		const std::vector<std::string> mismatches = replay->GetMismatches();
+		for (size_t i = 0; i < mismatches.size(); i++)
+			cerr << "MISMATCH: " << mismatches[i] << endl;
+
+		if (!mismatches.empty())
+			result = 4;
+	}
+
+	ShutdownBackend();
+
+	return result;
+}
+
+
+/// <summary>Removes a name=value argument and returns its value (NULL if not present).</summary>
+const char* ExtractOption(std::vector<const char*>& args, const char* name)
+{
+	const size_t length = strlen(name);
+
+	for (size_t i = 1; i < args.size(); i++)
+	{
+		if (_strnicmp(args[i], name, length) == 0 && args[i][length] == '=')
+		{
+			const char* value = args[i] + length + 1;
+			args.erase(args.begin() + i);
+			return value;
+		}
+	}
+
+	return NULL;
+}
+
+/// <summary>Removes a name=value argument and returns its numeric value (the default if not present).</summary>
+double GetOption(std::vector<const char*>& args, const char* name, double defaultValue)
+{
+	const char* value = ExtractOption(args, name);
+	return (value == NULL ? defaultValue : atof(value));
 }
 
 
@@ -84,6 +510,7 @@ void PrintInfo(const Info& info)
 
 	cout << ".:. General" << endl << "---" << endl;
 	cout << "  AMD family 0x" << std::hex << info.Family << ", model 0x" << info.Model << std::dec << " CPU, " << info.NumCores << " cores" << endl;
+	cout << "  Platform: " << info.GetCodec().GetName() << endl;
 	cout << "  Default reference clock: " << info.multiScaleFactor * 100 << " MHz" << endl;
 	cout << "  Available multipliers: " << (info.MinMulti / info.multiScaleFactor) << " .. " << (info.MaxSoftwareMulti / info.multiScaleFactor) << endl;
 	cout << "  Available voltage IDs: " << info.MinVID << " .. " << info.MaxVID << " (" << info.VIDStep << " steps)" << endl;
@@ -108,6 +535,23 @@ void PrintInfo(const Info& info)
 	}
 	cout << endl;
 
+	cout << ".:. Thermal" << endl << "---" << endl;
+	double temperature;
+	HtcStatus htc;
+	if (info.TryReadTemperature(temperature) == REG_OK)
+		cout << "  Temperature (Tctl): " << temperature << " C" << endl;
+	if (info.TryReadHtcStatus(htc) == REG_OK)
+	{
+		if (!htc.Enabled)
+			cout << "  HTC disabled" << endl;
+		else
+		{
+			cout << "  HTC limit: " << htc.Limit << " C (hysteresis " << htc.Hysteresis << " C), P-state limit P" << htc.PStateLimit << endl;
+			cout << "  HTC " << (htc.Active ? "active" : "inactive") << (htc.WasActive ? ", has been active" : "") << endl;
+		}
+	}
+	cout << endl;
+
 	cout << ".:. P-states" << endl << "---" << endl;
 	cout << "  " << info.NumPStates << " of " << (info.Family == 0x10 ? 5 : 8) << " enabled (P0 .. P" << (info.NumPStates - 1) << ")" << endl;
 
@@ -190,9 +634,10 @@ void PrintInfo(const Info& info)
 
 		cout << "  ---" << endl;
 
-		for (int i = 0; i < 8; i++)
+		const std::vector<iGPUPStateInfo> iGPUPStates = info.ReadiGPUPStates();
+		for (int i = 0; i < Info::NUM_IGPU_PSTATES; i++)
 		{
-			const iGPUPStateInfo pi = info.ReadiGPUPState(i);
+			const iGPUPStateInfo& pi = iGPUPStates[i];
 			cout << "  GPU_P" << i << ": StateValid = " << pi.StateValid << ", LclkDivider = " << pi.LclkDivider << ", VID = " << info.DecodeVID(pi.VID) << " V";
 			if (pi.StateValid == 1)
 				cout << " [VALID]";
@@ -229,9 +674,106 @@ void PrintInfo(const Info& info)
 }
 
 
+void PrintTelemetry()
+{
+	TelemetryReader reader;
+	if (!reader.Open())
+	{
+		cout << "no telemetry published (daemon not running?)" << endl;
+		return;
+	}
+
+	const TelemetryHeader& header = reader.GetHeader();
+	cout << ".:. Telemetry (daemon PID " << header.ProcessId << ", every " << header.IntervalMicroseconds << " us)" << endl << "---" << endl;
+
+	TelemetryNodeData node;
+	if (reader.ReadNode(node))
+	{
+		cout << "  Temperature: " << node.TemperatureC << " C";
+		if (node.NbPState >= 0)
+			cout << ", NB_P" << node.NbPState;
+		cout << endl;
+	}
+
+	for (int i = 0; i < (int)header.NumCPUs; i++)
+	{
+		TelemetryCoreData core;
+		if (!reader.ReadCore(i, core))
+			continue;
+
+		cout << "  CPU " << i << ": P" << core.PState << " at " << core.Voltage << "V, " << core.CofMHz << " MHz";
+		if (core.EffectiveMHz > 0)
+			cout << " (" << core.EffectiveMHz << " MHz effective)";
+		cout << endl;
+	}
+}
+
+
 void WaitForKey()
 {
+#ifdef _WIN32
 	cout << endl << "Press any key to exit... ";
 	_getch();
 	cout << endl;
+#endif
+}
+
+
+/// <summary>dump file=<path> [from=<seconds>] [to=<seconds>]: prints the transitions of a trace.</summary>
+int PrintTrace(std::vector<const char*>& args)
+{
+	const char* path = ExtractOption(args, "file");
+	const double from = GetOption(args, "from", 0.0);
+	const double to = GetOption(args, "to", -1.0);
+
+	PStateTraceReader reader;
+	if (path == NULL || !reader.Open(path))
+	{
+		cerr << "ERROR: cannot read trace " << (path == NULL ? "(file=<path> missing)" : path) << endl;
+		return 3;
+	}
+
+	const PStateTraceHeader& header = reader.GetHeader();
+	const std::unique_ptr<PStateCodec> codec(PStateCodec::Create(header.Family, header.Model, header.MaxMulti));
+	if (!codec)
+	{
+		cerr << "ERROR: unsupported CPU in trace" << endl;
+		return 2;
+	}
+
+	cout << ".:. Trace of " << header.Host << " (family 0x" << std::hex << header.Family << ", model 0x" << header.Model << std::dec
+	     << ", " << header.NumCPUs << " CPUs, " << reader.GetNumBlocks() << " blocks)" << endl << "---" << endl;
+
+	const QWORD first = (QWORD)(from * 1e9);
+	const QWORD last = (to < 0 ? ~0ULL : (QWORD)(to * 1e9));
+
+	std::vector<PStateTraceEvent> events;
+	for (size_t b = reader.FindBlock(first); b < reader.GetNumBlocks() && reader.GetBlock(b).FirstTimestamp <= last; b++)
+	{
+		if (!reader.ReadBlock(b, events))
+		{
+			cerr << "ERROR: block " << b << " is corrupt" << endl;
+			return 4;
+		}
+
+		for (size_t i = 0; i < events.size(); i++)
+		{
+			const PStateTraceEvent& e = events[i];
+			if (e.Timestamp < first || e.Timestamp > last)
+				continue;
+
+			cout << "  " << (e.Timestamp / 1e9) << " s: ";
+			if (e.Kind == TRACE_NBPSTATE)
+				cout << "NB_P" << e.Value << endl;
+			else
+			{
+				CofVidStatus status;
+				codec->DecodeCofVid(e.Value, status);
+
+				cout << "CPU " << e.Cpu << " P" << status.PState << " " << (status.Multi / codec->GetMultiScaleFactor()) << "x VID " << status.VID << endl;
+			}
+		}
+	}
+
+	return 0;
 }
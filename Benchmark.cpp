@@ -0,0 +1,405 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <thread>
+#include "Benchmark.h"
+#include "LinuxBackend.h"
+#include "ParallelApply.h"
+#include "Platform.h"
+#include "RegisterAccess.h"
+#include "RegisterLog.h"
+#include "Registers.h"
+#include "WinRing0.h"
+
+using std::endl;
+using std::vector;
+using std::chrono::steady_clock;
+
+typedef std::chrono::duration<double, std::nano> Nanoseconds;
+
+
+struct PciRegister
+{
+	DWORD Function;
+	DWORD Address;
+};
+
+// registers polled by the monitoring code
+static const PciRegister BENCHMARK_REGISTERS[] =
+{
+	{ 3, 0x64 },  // HTC
+	{ 3, 0xA4 },  // reported temperature control
+	{ 3, 0xDC },  // clock power/timing control 2
+	{ 4, 0x15C }, // core performance boost control
+	{ 5, 0x174 }, // northbridge P-state status
+};
+
+static const int NUM_BENCHMARK_REGISTERS = sizeof(BENCHMARK_REGISTERS) / sizeof(BENCHMARK_REGISTERS[0]);
+
+
+enum AccessType
+{
+	ACCESS_RDMSR,
+	ACCESS_PCI,
+	ACCESS_SMU,
+	ACCESS_CPUID
+};
+
+static const char* const ACCESS_NAMES[] = { "RDMSR", "PCI read", "SMU read", "CPUID" };
+
+
+// returns the initialized backends
+static vector<RegisterBackend*> CreateCandidates()
+{
+	vector<RegisterBackend*> candidates;
+
+#ifdef _WIN32
+	WinRing0Backend* winRing0 = new WinRing0Backend();
+	if (winRing0->Initialize())
+		candidates.push_back(winRing0);
+	else
+		delete winRing0;
+#else
+	LinuxBackend* pread = new LinuxBackend();
+	if (pread->Initialize())
+		candidates.push_back(pread);
+	else
+		delete pread;
+
+	// only worth timing if the ECAM window could actually be mapped
+	LinuxEcamBackend* ecam = new LinuxEcamBackend();
+	if (ecam->Initialize() && ecam->IsMapped())
+		candidates.push_back(ecam);
+	else
+		delete ecam;
+#endif
+
+	return candidates;
+}
+
+
+vector<BenchmarkResult> Benchmark::RunPciConfigReads(int iterations)
+{
+	vector<BenchmarkResult> results;
+
+	const vector<RegisterBackend*> candidates = CreateCandidates();
+
+	DWORD reference[NUM_BENCHMARK_REGISTERS];
+	bool haveReference = false;
+
+	for (size_t i = 0; i < candidates.size(); i++)
+	{
+		std::unique_ptr<RegisterBackend> backend(candidates[i]);
+
+		BenchmarkResult result;
+		result.Backend = backend->GetName();
+		result.NumReads = iterations * NUM_BENCHMARK_REGISTERS;
+		result.Consistent = true;
+
+		DWORD values[NUM_BENCHMARK_REGISTERS];
+		bool ok = true;
+
+		// warm up (opens the lazily opened files) and check the values against the first backend
+		for (int r = 0; ok && r < NUM_BENCHMARK_REGISTERS; r++)
+			ok = (backend->ReadPciConfig(AMD_CPU_DEVICE, BENCHMARK_REGISTERS[r].Function, BENCHMARK_REGISTERS[r].Address, values[r]) == REG_OK);
+
+		if (!ok)
+			continue;
+
+		if (!haveReference)
+		{
+			std::copy(values, values + NUM_BENCHMARK_REGISTERS, reference);
+			haveReference = true;
+		}
+		else
+		{
+			// D18F3x64 and D18F3xA4 may legitimately change in between, the others must not
+			for (int r = 2; r < NUM_BENCHMARK_REGISTERS; r++)
+				result.Consistent &= (values[r] == reference[r]);
+		}
+
+		const steady_clock::time_point start = steady_clock::now();
+
+		for (int n = 0; n < iterations; n++)
+		{
+			for (int r = 0; r < NUM_BENCHMARK_REGISTERS; r++)
+				backend->ReadPciConfig(AMD_CPU_DEVICE, BENCHMARK_REGISTERS[r].Function, BENCHMARK_REGISTERS[r].Address, values[r]);
+		}
+
+		const Nanoseconds elapsed = steady_clock::now() - start;
+		result.NanosecondsPerRead = elapsed.count() / result.NumReads;
+
+		results.push_back(result);
+	}
+
+	return results;
+}
+
+
+// performs a single access of the specified type, reading the registers polled by the monitors
+static RegisterStatus Access(RegisterBackend& backend, AccessType type, int cpu)
+{
+	switch (type)
+	{
+		case ACCESS_RDMSR:
+		{
+			QWORD value;
+			return backend.Rdmsr(cpu, 0xC0010071, value); // MSRC001_0071 COFVID Status
+		}
+
+		case ACCESS_PCI:
+		{
+			DWORD value;
+			return backend.ReadPciConfig(AMD_CPU_DEVICE, 3, 0xDC, value); // D18F3xDC Clock Power/Timing Control 2
+		}
+
+		case ACCESS_SMU:
+		{
+			const DWORD offset = D0F0xBC_x3FDC8::Offset;
+			DWORD value;
+			return backend.ReadSmuIndirect(&offset, &value, 1);
+		}
+
+		default:
+		{
+			CpuidRegs regs;
+			return backend.Cpuid(cpu, 0x80000001, regs);
+		}
+	}
+}
+
+// times single accesses, the target CPU of each one is selected by the callback (which is timed too)
+static void TimeAccesses(RegisterBackend& backend, AccessType type, int iterations, const std::function<int(int n)>& selectCpu,
+	vector<double>& latencies, int& numFailed)
+{
+	latencies.reserve(latencies.size() + iterations);
+
+	for (int n = 0; n < iterations; n++)
+	{
+		const steady_clock::time_point start = steady_clock::now();
+		const RegisterStatus status = Access(backend, type, selectCpu(n));
+		const steady_clock::time_point end = steady_clock::now();
+
+		if (status == REG_OK)
+			latencies.push_back(Nanoseconds(end - start).count());
+		else
+			numFailed++;
+	}
+}
+
+// runs the function on a separate thread pinned to the specified logical CPU and waits for it
+static void RunPinned(int cpu, const std::function<void()>& function)
+{
+	std::thread worker([&]()
+	{
+		PinCurrentThread(cpu);
+		RaiseThreadPriority();
+		function();
+		RestoreThreadPriority();
+	});
+
+	worker.join();
+}
+
+static AccessResult MakeResult(const RegisterBackend& backend, AccessType type, const char* mode, int numThreads,
+	vector<double>& latencies, int numFailed, double seconds)
+{
+	AccessResult result;
+	result.Backend = backend.GetName();
+	result.Access = ACCESS_NAMES[type];
+	result.Mode = mode;
+	result.NumThreads = numThreads;
+	result.Latency = Statistics::Compute(latencies);
+	result.CallsPerSecond = (seconds > 0.0 ? (latencies.size() + numFailed) / seconds : 0.0);
+	result.NumFailed = numFailed;
+	return result;
+}
+
+static void RunAccessModes(RegisterBackend& backend, AccessType type, int iterations, vector<AccessResult>& results)
+{
+	const bool isCpuAddressable = backend.IsCpuAddressable();
+	const bool isPerCpu = (type == ACCESS_RDMSR || type == ACCESS_CPUID);
+
+	// a simulated backend may describe more CPUs than there are
+	const int numCPUs = backend.GetNumCPUs();
+	const int numThreads = std::min(numCPUs, GetNumLogicalCPUs());
+
+	const int localCpu = (isCpuAddressable ? 0 : CURRENT_CPU);
+
+	// skip access types the backend does not support (also warms it up)
+	bool supported = false;
+	RunPinned(0, [&]() { supported = (Access(backend, type, localCpu) == REG_OK); });
+	if (!supported)
+		return;
+
+	vector<double> latencies;
+	int numFailed = 0;
+	double seconds = 0.0;
+
+	// local
+	RunPinned(0, [&]()
+	{
+		const steady_clock::time_point start = steady_clock::now();
+		TimeAccesses(backend, type, iterations, [localCpu](int) { return localCpu; }, latencies, numFailed);
+		seconds = std::chrono::duration<double>(steady_clock::now() - start).count();
+	});
+	results.push_back(MakeResult(backend, type, "local", 1, latencies, numFailed, seconds));
+
+	// remote
+	if (isPerCpu && isCpuAddressable && numCPUs > 1)
+	{
+		latencies.clear();
+		numFailed = 0;
+
+		RunPinned(0, [&]()
+		{
+			const int remoteCpu = numCPUs - 1;
+			const steady_clock::time_point start = steady_clock::now();
+			TimeAccesses(backend, type, iterations, [remoteCpu](int) { return remoteCpu; }, latencies, numFailed);
+			seconds = std::chrono::duration<double>(steady_clock::now() - start).count();
+		});
+		results.push_back(MakeResult(backend, type, "remote", 1, latencies, numFailed, seconds));
+	}
+
+	// sweep; without CPU addressing each access includes re-pinning the thread, like TargetCPU()
+	const int sweepCPUs = (isCpuAddressable ? numCPUs : numThreads);
+	if (isPerCpu && sweepCPUs > 1)
+	{
+		latencies.clear();
+		numFailed = 0;
+
+		RunPinned(0, [&]()
+		{
+			const steady_clock::time_point start = steady_clock::now();
+			TimeAccesses(backend, type, iterations, [&](int n)
+			{
+				const int cpu = n % sweepCPUs;
+				if (isCpuAddressable)
+					return cpu;
+
+				PinCurrentThread(cpu);
+				return CURRENT_CPU;
+			}, latencies, numFailed);
+			seconds = std::chrono::duration<double>(steady_clock::now() - start).count();
+		});
+		results.push_back(MakeResult(backend, type, "sweep", 1, latencies, numFailed, seconds));
+	}
+
+	// parallel
+	if (numThreads > 1)
+	{
+		vector<vector<double> > perThread(numThreads);
+		vector<int> failedPerThread(numThreads, 0);
+
+		RaiseThreadPriority();
+		const ParallelApplyReport report = ParallelApply::RunIndexed(backend, numThreads, [&](int index, int cpu)
+		{
+			TimeAccesses(backend, type, iterations, [cpu](int) { return cpu; }, perThread[index], failedPerThread[index]);
+		});
+		RestoreThreadPriority();
+
+		latencies.clear();
+		numFailed = 0;
+		for (int i = 0; i < numThreads; i++)
+		{
+			latencies.insert(latencies.end(), perThread[i].begin(), perThread[i].end());
+			numFailed += failedPerThread[i];
+		}
+
+		results.push_back(MakeResult(backend, type, "parallel", numThreads, latencies, numFailed, report.TotalMicroseconds / 1e6));
+	}
+}
+
+
+vector<AccessResult> Benchmark::RunAccessLatencies(int iterations, const char* simulationLog)
+{
+	vector<AccessResult> results;
+
+	vector<RegisterBackend*> candidates = CreateCandidates();
+
+	if (simulationLog != NULL)
+	{
+		SimulatedBackend* simulated = new SimulatedBackend(simulationLog);
+		if (simulated->Initialize())
+			candidates.push_back(simulated);
+		else
+			delete simulated;
+	}
+
+	for (size_t i = 0; i < candidates.size(); i++)
+	{
+		std::unique_ptr<RegisterBackend> backend(candidates[i]);
+
+		// the SMU registers behind D0F0xB8/D0F0xBC exist on family 15h only
+		CpuidRegs regs;
+		bool hasSmu = false;
+		RunPinned(0, [&]()
+		{
+			if (backend->Cpuid(backend->IsCpuAddressable() ? 0 : CURRENT_CPU, 0x80000001, regs) == REG_OK)
+				hasSmu = (CPUID_8000_0001_EAX::BaseFamily::Get(regs.eax) + CPUID_8000_0001_EAX::ExtFamily::Get(regs.eax) == 0x15);
+		});
+
+		RunAccessModes(*backend, ACCESS_RDMSR, iterations, results);
+		RunAccessModes(*backend, ACCESS_PCI, iterations, results);
+		if (hasSmu)
+			RunAccessModes(*backend, ACCESS_SMU, iterations, results);
+		RunAccessModes(*backend, ACCESS_CPUID, iterations, results);
+	}
+
+	return results;
+}
+
+
+void Benchmark::Print(std::ostream& out, const vector<BenchmarkResult>& results)
+{
+	out << ".:. PCI configuration space reads" << endl << "---" << endl;
+
+	if (results.empty())
+		out << "  no usable backend" << endl;
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchmarkResult& r = results[i];
+		out << "  " << r.Backend << ": " << r.NanosecondsPerRead << " ns per read (" << r.NumReads << " reads)";
+		if (!r.Consistent)
+			out << " [VALUES DIFFER]";
+		out << endl;
+	}
+}
+
+void Benchmark::Print(std::ostream& out, const vector<AccessResult>& results)
+{
+	out << ".:. Register access latency" << endl << "---" << endl;
+
+	if (results.empty())
+		out << "  no usable backend" << endl;
+
+	const std::ios::fmtflags flags = out.flags();
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const AccessResult& r = results[i];
+
+		if (i == 0 || r.Backend != results[i - 1].Backend)
+			out << "  " << r.Backend << ":" << endl;
+
+		out << "    " << std::left << std::setw(9) << r.Access << std::setw(9) << r.Mode << std::right
+		    << std::setw(2) << r.NumThreads << (r.NumThreads == 1 ? " thread:  " : " threads: ");
+		Statistics::Print(out, r.Latency, "ns");
+		out << ", " << (long long)r.CallsPerSecond << " calls/s";
+		if (r.NumFailed > 0)
+			out << ", " << r.NumFailed << " FAILED";
+		out << endl;
+	}
+
+	out.flags(flags);
+}
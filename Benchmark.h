@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Statistics.h"
+
+
+struct BenchmarkResult
+{
+	std::string Backend;
+	int NumReads;
+	double NanosecondsPerRead;
+	bool Consistent; // false if the values differ from the ones read by the first backend
+};
+
+struct AccessResult
+{
+	std::string Backend;
+	const char* Access;     // "RDMSR", "PCI read", "SMU read", "CPUID"
+	const char* Mode;       // "local", "remote", "sweep", "parallel"
+	int NumThreads;
+	Percentiles Latency;    // nanoseconds per call, including the clock overhead (~20-30 ns)
+	double CallsPerSecond;  // of all threads together
+	int NumFailed;          // calls not returning REG_OK (not timed)
+};
+
+
+/// <summary>
+/// Microbenchmarks for the register access paths. The backends are created and initialized
+/// separately, i.e., independently from the (cached) global backend.
+/// </summary>
+class Benchmark
+{
+public:
+
+	/// <summary>
+	/// Times reads of a few northbridge configuration registers (D18F3/D18F4/D18F5) for each
+	/// available access path (pread vs. mapped ECAM on Linux, WinRing0 on Windows).
+	/// </summary>
+	static std::vector<BenchmarkResult> RunPciConfigReads(int iterations);
+
+	/// <summary>
+	/// Times each access type (RDMSR, PCI configuration read, SMU indirect read, CPUID) per call:
+	/// local: a thread on CPU 0 accessing CPU 0,
+	/// remote: a thread on CPU 0 accessing the last CPU (CPU-addressable backends only),
+	/// sweep: a single thread accessing all CPUs in turn (re-pinning itself if the backend is not CPU-addressable),
+	/// parallel: a thread per CPU, each accessing its own one simultaneously.
+	/// If a register log is specified, a SimulatedBackend seeded from it is measured as well.
+	/// </summary>
+	static std::vector<AccessResult> RunAccessLatencies(int iterations, const char* simulationLog);
+
+	static void Print(std::ostream& out, const std::vector<BenchmarkResult>& results);
+
+	static void Print(std::ostream& out, const std::vector<AccessResult>& results);
+};
@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include "CodecValidator.h"
+#include "Platform.h"
+#include "PStateCodec.h"
+#include "Registers.h"
+
+using std::endl;
+using std::pair;
+using std::vector;
+using std::chrono::steady_clock;
+
+typedef std::chrono::duration<double> Seconds;
+
+// keeps the compiler from dropping the timed calls
+static volatile double checksum;
+
+
+struct CodecProfile
+{
+	int Family;
+	int Model;
+	double MaxMulti; // family 0x14 only
+};
+
+// one model per layout (see PStateCodec::Create()), family 0x14 follows below
+static const int FAMILY_MODELS[][2] =
+{
+	{ 0x10, 0x00 }, // K10
+	{ 0x12, 0x00 }, // Llano
+	{ 0x15, 0x00 }, // Bulldozer/Piledriver (models 0x00-0x0F)
+	{ 0x15, 0x10 }, // SVI2: Trinity/Richland (models 0x10-0x1F), Kaveri (models 0x30-0x3F)
+	{ 0x15, 0x60 }, // all other family 0x15 models, e.g., Carrizo/Stoney Ridge
+};
+
+static vector<CodecProfile> GetProfiles()
+{
+	vector<CodecProfile> profiles;
+
+	for (size_t i = 0; i < sizeof(FAMILY_MODELS) / sizeof(FAMILY_MODELS[0]); i++)
+	{
+		const CodecProfile profile = { FAMILY_MODELS[i][0], FAMILY_MODELS[i][1], 0.0 };
+		profiles.push_back(profile);
+	}
+
+	// family 0x14 expresses the multis as divisors of MaxCpuCof + 16 (see Info::Initialize())
+	for (int cof = 1; cof <= (int)MSRC001_0071::MaxCpuCof::Max(); cof++)
+	{
+		const CodecProfile profile = { 0x14, 0x00, cof + 16.0 };
+		profiles.push_back(profile);
+	}
+
+	return profiles;
+}
+
+
+static void AddMismatch(CodecValidation& result, const char* coding, int raw, int encoded, double value, double reencodedValue)
+{
+	CodecMismatch mismatch;
+	mismatch.Coding = coding;
+	mismatch.Raw = raw;
+	mismatch.Encoded = encoded;
+	mismatch.Value = value;
+	mismatch.IsAlias = (reencodedValue == value);
+
+	if (mismatch.IsAlias)
+		result.NumAliases++;
+	else
+		result.NumLossy++;
+
+	result.Mismatches.push_back(mismatch);
+}
+
+static CodecValidation Validate(const CodecProfile& profile, int rounds)
+{
+	std::unique_ptr<PStateCodec> codec(PStateCodec::Create(profile.Family, profile.Model, profile.MaxMulti));
+	const bool hasNbPStates = (profile.Family == 0x15);
+
+	CodecValidation result;
+	result.NumEncodings = 0;
+	result.NumReserved = 0;
+	result.NumAliases = 0;
+	result.NumLossy = 0;
+	result.DecodesPerSecond = 0.0;
+	result.EncodesPerSecond = 0.0;
+
+	std::ostringstream name;
+	name << codec->GetName() << ", family " << std::hex << std::uppercase << profile.Family << "h model " << profile.Model << "h";
+	if (profile.Family == 0x14)
+		name << std::dec << ", max multi " << profile.MaxMulti;
+	result.Profile = name.str();
+
+	// the valid raw encodings
+	vector<pair<int, int> > cofs, nbCofs; // FID, DID
+	for (int fid = 0; fid <= codec->GetMaxFid(); fid++)
+	{
+		for (int did = 0; did <= codec->GetMaxDid(); did++)
+		{
+			if (codec->IsValidMulti(fid, did))
+				cofs.push_back(std::make_pair(fid, did));
+			else
+				result.NumReserved++;
+		}
+	}
+
+	if (hasNbPStates)
+	{
+		for (int fid = 0; fid <= (int)D18F5x160::NbFid::Max(); fid++)
+		{
+			for (int did = 0; did <= (int)D18F5x160::NbDid::Max(); did++)
+			{
+				if (PStateCodec::IsValidNbMulti(fid, did))
+					nbCofs.push_back(std::make_pair(fid, did));
+				else
+					result.NumReserved++;
+			}
+		}
+	}
+
+	// the VIDs beyond 0 V are the "off" codes
+	const int numVIDs = std::min(codec->GetMaxVID(), codec->EncodeVID(0.0)) + 1;
+	result.NumReserved += codec->GetMaxVID() + 1 - numVIDs;
+	result.NumEncodings = (int)(cofs.size() + nbCofs.size()) + numVIDs;
+
+	// round trips
+	vector<double> multis(cofs.size()), nbMultis(nbCofs.size()), volts(numVIDs);
+
+	for (size_t i = 0; i < cofs.size(); i++)
+	{
+		const int fid = cofs[i].first, did = cofs[i].second;
+		multis[i] = codec->DecodeMulti(fid, did);
+
+		int encodedFid, encodedDid;
+		codec->EncodeMulti(multis[i], encodedFid, encodedDid);
+		if (encodedFid != fid || encodedDid != did)
+			AddMismatch(result, "CPU FID/DID", fid << 8 | did, encodedFid << 8 | encodedDid, multis[i], codec->DecodeMulti(encodedFid, encodedDid));
+	}
+
+	for (size_t i = 0; i < nbCofs.size(); i++)
+	{
+		const int fid = nbCofs[i].first, did = nbCofs[i].second;
+		nbMultis[i] = PStateCodec::DecodeNbMulti(fid, did);
+
+		int encodedFid, encodedDid;
+		PStateCodec::EncodeNbMulti(nbMultis[i], encodedFid, encodedDid);
+		if (encodedFid != fid || encodedDid != did)
+			AddMismatch(result, "NB FID/DID", fid << 8 | did, encodedFid << 8 | encodedDid, nbMultis[i], PStateCodec::DecodeNbMulti(encodedFid, encodedDid));
+	}
+
+	for (int vid = 0; vid < numVIDs; vid++)
+	{
+		volts[vid] = codec->DecodeVID(vid);
+
+		const int encoded = codec->EncodeVID(volts[vid]);
+		if (encoded != vid)
+			AddMismatch(result, "VID", vid, encoded, volts[vid], codec->DecodeVID(encoded));
+	}
+
+	if (rounds <= 0 || result.NumEncodings == 0)
+		return result;
+
+	// throughput
+	double decodeSum = 0.0;
+	int encodeSum = 0;
+
+	steady_clock::time_point start = steady_clock::now();
+	for (int r = 0; r < rounds; r++)
+	{
+		for (size_t i = 0; i < cofs.size(); i++)
+			decodeSum += codec->DecodeMulti(cofs[i].first, cofs[i].second);
+		for (size_t i = 0; i < nbCofs.size(); i++)
+			decodeSum += PStateCodec::DecodeNbMulti(nbCofs[i].first, nbCofs[i].second);
+		for (int vid = 0; vid < numVIDs; vid++)
+			decodeSum += codec->DecodeVID(vid);
+	}
+	const double decodeSeconds = Seconds(steady_clock::now() - start).count();
+
+	start = steady_clock::now();
+	for (int r = 0; r < rounds; r++)
+	{
+		int fid, did;
+		for (size_t i = 0; i < multis.size(); i++)
+		{
+			codec->EncodeMulti(multis[i], fid, did);
+			encodeSum += fid + did;
+		}
+		for (size_t i = 0; i < nbMultis.size(); i++)
+		{
+			PStateCodec::EncodeNbMulti(nbMultis[i], fid, did);
+			encodeSum += fid + did;
+		}
+		for (int vid = 0; vid < numVIDs; vid++)
+			encodeSum += codec->EncodeVID(volts[vid]);
+	}
+	const double encodeSeconds = Seconds(steady_clock::now() - start).count();
+
+	checksum = decodeSum + encodeSum;
+
+	const double numOperations = (double)rounds * result.NumEncodings;
+	result.DecodesPerSecond = (decodeSeconds > 0.0 ? numOperations / decodeSeconds : 0.0);
+	result.EncodesPerSecond = (encodeSeconds > 0.0 ? numOperations / encodeSeconds : 0.0);
+
+	return result;
+}
+
+
+CodecValidationReport CodecValidator::Run(int rounds, int numThreads)
+{
+	const vector<CodecProfile> profiles = GetProfiles();
+
+	if (numThreads <= 0)
+		numThreads = GetNumLogicalCPUs();
+	numThreads = std::max(1, std::min(numThreads, (int)profiles.size()));
+
+	CodecValidationReport report;
+	report.Profiles.resize(profiles.size());
+	report.NumThreads = numThreads;
+
+	std::atomic<size_t> next(0);
+	const steady_clock::time_point start = steady_clock::now();
+
+	vector<std::thread> workers;
+	for (int t = 0; t < numThreads; t++)
+	{
+		workers.push_back(std::thread([&]()
+		{
+			for (size_t i = next.fetch_add(1); i < profiles.size(); i = next.fetch_add(1))
+				report.Profiles[i] = Validate(profiles[i], rounds);
+		}));
+	}
+
+	for (size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+
+	report.Seconds = Seconds(steady_clock::now() - start).count();
+
+	double numOperations = 0.0;
+	for (size_t i = 0; i < report.Profiles.size(); i++)
+		numOperations += 2.0 * rounds * report.Profiles[i].NumEncodings;
+	report.OperationsPerSecond = (report.Seconds > 0.0 ? numOperations / report.Seconds : 0.0);
+
+	return report;
+}
+
+
+// FID/DID pairs as "FID/DID", VIDs as they are
+static void PrintRaw(std::ostream& os, const CodecMismatch& mismatch, int raw)
+{
+	if (mismatch.Coding[0] == 'V')
+		os << raw;
+	else
+		os << (raw >> 8) << "/" << (raw & 0xFF);
+}
+
+void CodecValidator::Print(std::ostream& os, const CodecValidationReport& report, int maxMismatches)
+{
+	const std::ios::fmtflags flags = os.flags();
+	const std::streamsize precision = os.precision();
+	os.setf(std::ios::fixed);
+
+	int numAliases = 0, numLossy = 0;
+
+	os << ".:. Codec validation" << endl << "---" << endl;
+
+	for (size_t i = 0; i < report.Profiles.size(); i++)
+	{
+		const CodecValidation& p = report.Profiles[i];
+		numAliases += p.NumAliases;
+		numLossy += p.NumLossy;
+
+		os.precision(1);
+		os << "  " << p.Profile << ": " << p.NumEncodings << " encodings (" << p.NumReserved << " reserved), "
+		   << p.NumAliases << " aliases, " << p.NumLossy << " lossy, "
+		   << (p.DecodesPerSecond / 1e6) << " M decodes/s, " << (p.EncodesPerSecond / 1e6) << " M encodes/s" << endl;
+
+		// aliases are inherent to the codings (e.g., 32/2 = 16/1), only the lossy round trips are listed
+		os.precision(5);
+		int numShown = 0;
+		for (size_t j = 0; j < p.Mismatches.size() && numShown < maxMismatches; j++)
+		{
+			const CodecMismatch& m = p.Mismatches[j];
+			if (m.IsAlias)
+				continue;
+
+			os << "    " << m.Coding << " ";
+			PrintRaw(os, m, m.Raw);
+			os << " (" << m.Value << ") -> ";
+			PrintRaw(os, m, m.Encoded);
+			os << endl;
+			numShown++;
+		}
+		if (p.NumLossy > numShown)
+			os << "    ... " << (p.NumLossy - numShown) << " more" << endl;
+	}
+
+	os.precision(1);
+	os << "  Total: " << report.Profiles.size() << " profiles, " << numAliases << " aliases, " << numLossy << " lossy; "
+	   << (report.OperationsPerSecond / 1e6) << " M operations/s on " << report.NumThreads << (report.NumThreads == 1 ? " thread (" : " threads (")
+	   << (report.Seconds * 1000.0) << " ms)" << endl;
+
+	os.precision(precision);
+	os.flags(flags);
+}
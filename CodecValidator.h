@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+struct CodecMismatch
+{
+	const char* Coding; // "CPU FID/DID", "NB FID/DID" or "VID"
+	int Raw;            // FID << 8 | DID, or the VID
+	int Encoded;        // Encode(Decode(Raw)), same format
+	double Value;       // Decode(Raw)
+	bool IsAlias;       // Encoded decodes to Value as well, i.e., Raw is merely another encoding of it
+};
+
+struct CodecValidation
+{
+	std::string Profile;     // codec name, family, model and (family 0x14) max multiplier
+	int NumEncodings;        // valid raw encodings checked
+	int NumReserved;         // raw FID/DID pairs skipped as reserved
+	int NumAliases;
+	int NumLossy;
+	double DecodesPerSecond; // single thread
+	double EncodesPerSecond;
+	std::vector<CodecMismatch> Mismatches;
+};
+
+struct CodecValidationReport
+{
+	std::vector<CodecValidation> Profiles;
+	int NumThreads;
+	double Seconds;             // wall-clock time of the whole validation
+	double OperationsPerSecond; // decodes and encodes of all threads together
+};
+
+
+/// <summary>
+/// Exhaustively checks the multiplier and VID codings (see PStateCodec) of all supported platforms,
+/// including every possible max multiplier of family 0x14: each valid raw FID/DID pair, NB FID/DID pair
+/// (family 0x15) and VID (up to 0 V) is decoded and encoded again. Raw values not reproduced by the round trip are
+/// reported, as aliases if the result decodes to the same value and as lossy otherwise.
+/// The profiles are distributed over all logical CPUs and each one is timed for a number of rounds.
+/// </summary>
+class CodecValidator
+{
+public:
+
+	/// <summary>Runs the validation using the given number of threads (all logical CPUs if not positive).</summary>
+	static CodecValidationReport Run(int rounds, int numThreads);
+
+	/// <summary>Prints the summary and up to maxMismatches lossy round trips per profile (aliases are only counted).</summary>
+	static void Print(std::ostream& os, const CodecValidationReport& report, int maxMismatches);
+};
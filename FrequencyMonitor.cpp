@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "FrequencyMonitor.h"
+#include "Info.h"
+#include "ParallelApply.h"
+#include "Registers.h"
+
+using std::endl;
+using std::vector;
+using std::chrono::steady_clock;
+
+
+struct PerfCounters
+{
+	QWORD Mperf;
+	QWORD Aperf;
+	bool Valid;
+};
+
+
+// reads MPERF and APERF of all cores, each one on its own core and as close together as possible
+static void Sweep(int numCPUs, vector<PerfCounters>& counters)
+{
+	ParallelApply::RunIndexed(numCPUs, [&](int index, int cpu)
+	{
+		PerfCounters& c = counters[index];
+		c.Valid = (TryRdmsr(MSR0000_00E7::Index, c.Mperf, cpu) == REG_OK &&
+		           TryRdmsr(MSR0000_00E8::Index, c.Aperf, cpu) == REG_OK);
+	});
+}
+
+
+bool FrequencyMonitor::IsSupported()
+{
+	CpuidRegs regs;
+	return (TryCpuid(0x00000006, regs) == REG_OK && CPUID_0000_0006_ECX::EffFreq::Get(regs.ecx) == 1);
+}
+
+double FrequencyMonitor::GetP0MHz() const
+{
+	const Info& info = *_info;
+
+	// software P0 follows the boost P-states
+	const PStateInfo p0 = info.ReadPState(info.IsBoostSupported ? info.NumBoostStates : 0);
+
+	// external multi times the reference clock (200 MHz on K10 and Bulldozer/Piledriver)
+	const double referenceClock = 100.0 * info.multiScaleFactor;
+	return (p0.Multi / info.multiScaleFactor) * referenceClock;
+}
+
+vector<CoreFrequency> FrequencyMonitor::Run(double intervalSeconds, double seconds) const
+{
+	const int numCPUs = GetBackend().GetNumCPUs();
+	const double p0MHz = GetP0MHz();
+
+	const steady_clock::duration interval = std::chrono::duration_cast<steady_clock::duration>(
+		std::chrono::duration<double>(std::max(0.001, intervalSeconds)));
+	const int numIntervals = std::max(1, (int)(seconds / std::max(0.001, intervalSeconds) + 0.5));
+
+	vector<PerfCounters> first(numCPUs), previous(numCPUs), current(numCPUs);
+
+	vector<CoreFrequency> result(numCPUs);
+	for (int i = 0; i < numCPUs; i++)
+	{
+		result[i].Cpu = i;
+		result[i].NumIntervals = 0;
+		result[i].MinMHz = result[i].AvgMHz = result[i].MaxMHz = 0.0;
+	}
+
+	Sweep(numCPUs, previous);
+	first = previous;
+
+	steady_clock::time_point next = steady_clock::now();
+
+	for (int n = 0; n < numIntervals; n++)
+	{
+		next += interval;
+		std::this_thread::sleep_until(next);
+
+		Sweep(numCPUs, current);
+
+		for (int i = 0; i < numCPUs; i++)
+		{
+			const PerfCounters& a = previous[i];
+			const PerfCounters& b = current[i];
+
+			// an idle core does not advance MPERF
+			if (!a.Valid || !b.Valid || b.Mperf == a.Mperf)
+				continue;
+
+			const double mhz = p0MHz * (double)(b.Aperf - a.Aperf) / (double)(b.Mperf - a.Mperf);
+
+			CoreFrequency& f = result[i];
+			f.MinMHz = (f.NumIntervals == 0 ? mhz : std::min(f.MinMHz, mhz));
+			f.MaxMHz = (f.NumIntervals == 0 ? mhz : std::max(f.MaxMHz, mhz));
+			f.NumIntervals++;
+		}
+
+		previous.swap(current);
+	}
+
+	for (int i = 0; i < numCPUs; i++)
+	{
+		const PerfCounters& a = first[i];
+		const PerfCounters& b = previous[i];
+
+		if (a.Valid && b.Valid && b.Mperf != a.Mperf)
+			result[i].AvgMHz = p0MHz * (double)(b.Aperf - a.Aperf) / (double)(b.Mperf - a.Mperf);
+	}
+
+	return result;
+}
+
+
+void FrequencyMonitor::Print(std::ostream& os, const vector<CoreFrequency>& frequencies) const
+{
+	const std::ios::fmtflags flags = os.flags();
+	const std::streamsize precision = os.precision();
+	os.setf(std::ios::fixed);
+	os.precision(0);
+
+	os << ".:. Effective frequency (P0 = " << GetP0MHz() << " MHz)" << endl << "---" << endl;
+
+	for (size_t i = 0; i < frequencies.size(); i++)
+	{
+		const CoreFrequency& f = frequencies[i];
+
+		os << "  CPU " << f.Cpu << ": ";
+		if (f.NumIntervals == 0)
+			os << "idle" << endl;
+		else
+			os << f.MinMHz << " / " << f.AvgMHz << " / " << f.MaxMHz << " MHz (min/avg/max, active in " << f.NumIntervals << " intervals)" << endl;
+	}
+
+	os.precision(precision);
+	os.flags(flags);
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#pragma once
+
+#include <ostream>
+#include <vector>
+
+class Info;
+
+
+struct CoreFrequency
+{
+	int Cpu;
+	int NumIntervals; // intervals in which the core was active (MPERF advanced)
+	double MinMHz;
+	double AvgMHz;    // over the whole period, weighted by the active time
+	double MaxMHz;
+};
+
+
+/// <summary>
+/// Measures the frequency delivered by each core while active, based on the APERF/MPERF counters
+/// (effective frequency interface): f = f(P0) * deltaAPERF / deltaMPERF.
+/// The counters of all cores are read in one parallel sweep per interval.
+/// </summary>
+class FrequencyMonitor
+{
+public:
+
+	explicit FrequencyMonitor(const Info& info)
+		: _info(&info)
+	{ }
+
+	/// <summary>Checks for the effective frequency interface (CPUID Fn0000_0006_ECX[EffFreq]).</summary>
+	static bool IsSupported();
+
+	/// <summary>Returns the frequency of software P0, which MPERF counts at.</summary>
+	double GetP0MHz() const;
+
+	/// <summary>Samples the counters every interval for the given period.</summary>
+	std::vector<CoreFrequency> Run(double intervalSeconds, double seconds) const;
+
+	void Print(std::ostream& os, const std::vector<CoreFrequency>& frequencies) const;
+
+
+private:
+
+	const Info* _info;
+};
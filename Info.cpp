@@ -6,23 +6,18 @@
  */
 
 #include <algorithm> // for min/max
-#include <exception>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include <string>
 #include "Info.h"
-#include "WinRing0.h"
+#include "PStateCodec.h"
+#include "Registers.h"
+#include "RegisterTransaction.h"
 
 using std::min;
 using std::max;
 
-// divisors for families 0x10 and 0x15
-static const double DIVISORS_10_15[] = { 1.0, 2.0, 4.0, 8.0, 16.0, 0.0 };
-// special divisors for family 0x12
-static const double DIVISORS_12[] = { 1.0, 1.5, 2.0, 3.0, 4.0, 6.0, 8.0, 12.0, 16.0, 0.0 };
-
-
-void FindFraction(double value, const double* divisors,
-	int& numerator, int& divisorIndex,
-	int minNumerator, int maxNumerator);
-
 
 bool Info::Initialize()
 {
@@ -37,83 +32,68 @@ bool Info::Initialize()
 
 	// check family
 	regs = Cpuid(0x80000001);
-	Family = GetBits(regs.eax, 8, 4) + GetBits(regs.eax, 20, 8);
+	Family = CPUID_8000_0001_EAX::BaseFamily::Get(regs.eax) + CPUID_8000_0001_EAX::ExtFamily::Get(regs.eax);
 	if (!(Family == 0x10 || Family == 0x12 || Family == 0x14 || Family == 0x15))
 		return false;
 
 	// read model
-	Model = GetBits(regs.eax, 4, 4) + (GetBits(regs.eax, 16, 4) << 4);
-
-	//set VID step for SVI2 platforms (otherwise 0.0125 is assumed, see header)
-	// Family 0x15 Models 10-1F is Trinity/Richland
-	// Family 0x15 Models 30-3F is Kaveri
-	if (Family == 0x15 && ((Model > 0xF && Model < 0x20) || (Model > 0x2F && Model < 0x40)))
-		VIDStep = 0.00625;
-
-	// scale factor from external multi to internal one (default 1, set for 200MHz REFCLK platforms)
-	// Family 0x10 includes all AM2+/AM3 K10 CPUs
-	// Family 0x15 Models 0-F is Bulldozer/Piledriver
-	if (Family == 0x10 || (Family == 0x15 && Model < 0x10))
-		multiScaleFactor = 2.0;
+	Model = CPUID_8000_0001_EAX::BaseModel::Get(regs.eax) + (CPUID_8000_0001_EAX::ExtModel::Get(regs.eax) << 4);
 
 	// number of physical cores
 	regs = Cpuid(0x80000008);
-	NumCores = GetBits(regs.ecx, 0, 8) + 1;
+	NumCores = CPUID_8000_0008_ECX::NC::Get(regs.ecx) + 1;
 
 	// number of hardware P-states
 	eax = ReadPciConfig(AMD_CPU_DEVICE, 3, 0xdc); // D18F3xDC Clock Power/Timing Control 2
-	NumPStates = GetBits(eax, 8, 3) + 1; // HwPstateMaxVal[2:0]
+	NumPStates = D18F3xDC::HwPstateMaxVal::Get(eax) + 1;
 
 	eax = ReadPciConfig(AMD_CPU_DEVICE, 3, 0xA0); // D18F3xA0 Power Control Miscellaneous
-	PsiVidEn = GetBits(eax, 7, 1); // PsiVidEn
-	PsiVid = GetBits(eax, 0, 7); // PsiVid[6:0]
-	const int PsiVid7 = GetBits(eax, 8, 1); // PsiVidEn[7]
-	PsiVid += (PsiVid7 << 7); // PsiVid[7:0]
+	PsiVidEn = D18F3xA0::PsiVidEn::Get(eax);
+	PsiVid = D18F3xA0::PsiVid::Get(eax); // PsiVid[7:0]
 
 	if (Family == 0x15)
 	{
 		eax = ReadPciConfig(AMD_CPU_DEVICE, 5, 0x170); // D18F5x170 Northbridge P-state Control
-		NumNBPStates = GetBits(eax, 0, 2) + 1; // NbPstateMaxVal[1:0]
-		NBPStateLo = GetBits(eax, 3, 2); // NbPstateLo[1:0]
-		NBPStateHi = GetBits(eax, 6, 2); // NbPstateHi[1:0]
-		NbPstateGnbSlowDis = GetBits(eax, 23, 1); // NbPstateGnbSlowDis
-		IsDynMemPStateChgEnabled = GetBits(eax, 31, 1) == 0 ? true : false; // MemPstateDis
+		NumNBPStates = D18F5x170::NbPstateMaxVal::Get(eax) + 1;
+		NBPStateLo = D18F5x170::NbPstateLo::Get(eax);
+		NBPStateHi = D18F5x170::NbPstateHi::Get(eax);
+		NbPstateGnbSlowDis = D18F5x170::NbPstateGnbSlowDis::Get(eax);
+		IsDynMemPStateChgEnabled = (D18F5x170::MemPstateDis::Get(eax) == 0);
 		eax = ReadPciConfig(AMD_CPU_DEVICE, 5, 0x174); // D18F5x174 Northbridge P-state Status
-		StartupNbPstate = GetBits(eax, 1, 2); // StartupNbPstate[2:1]
+		StartupNbPstate = D18F5x174::StartupNbPstate::Get(eax);
 		eax = ReadPciConfig(AMD_CPU_DEVICE, 3, 0xE8); // D18F3xE8 Northbridge Capabilities
-		NumMemPStates = GetBits(eax, 24, 1) + 1; // MemPstateCap
-
-		// The index/data pair registers, D0F0xB8 and D0F0xBC, are used to access the registers at
-		// D0F0xBC_x[FFFFFFFF:00000000].To access any of these registers, the address is first written into the index
-		// register, D0F0xB8, and then the data is read from or written to the data register, D0F0xBC.
-		eax = 0x0003F9E8; // D0F0xBC_x3F9E8 NB_DPM_CONFIG_1
-		WritePciConfig(0, 0, 0xB8, eax); // D0F0xBC_x3F9E8 NB_DPM_CONFIG_1
-		eax = ReadPciConfig(0, 0, 0xBC); // D0F0xBC_x3F9E8 NB_DPM_CONFIG_1
-		NBPStateHiGPU = GetBits(eax, 24, 8); // DpmXNbPsHi[7:0]
-		NBPStateLoGPU = GetBits(eax, 16, 8); // DpmXNbPsLo[7:0]
-		NBPStateHiCPU = GetBits(eax, 8, 8); // Dpm0PgNbPsHi[7:0]
-		NBPStateLoCPU = GetBits(eax, 0, 8); // Dpm0PgNbPsLo[7:0]
+		NumMemPStates = D18F3xE8::MemPstateCap::Get(eax) + 1;
+
+		// read both SMU registers behind the D0F0xB8/D0F0xBC index/data pair in one batch
+		const DWORD smuOffsets[2] =
+		{
+			D0F0xBC_x3F9E8::Offset, // NB_DPM_CONFIG_1
+			D0F0xBC_x3FDC8::Offset  // SMU_LCLK_DPM_CNTL
+		};
+		DWORD smuValues[2];
+		ReadSmuRegisters(smuOffsets, smuValues, 2);
+
+		eax = smuValues[0]; // D0F0xBC_x3F9E8 NB_DPM_CONFIG_1
+		NBPStateHiGPU = D0F0xBC_x3F9E8::DpmXNbPsHi::Get(eax);
+		NBPStateLoGPU = D0F0xBC_x3F9E8::DpmXNbPsLo::Get(eax);
+		NBPStateHiCPU = D0F0xBC_x3F9E8::Dpm0PgNbPsHi::Get(eax);
+		NBPStateLoCPU = D0F0xBC_x3F9E8::Dpm0PgNbPsLo::Get(eax);
 
 		eax = ReadPciConfig(AMD_CPU_DEVICE, 2, 0x94); // D18F2x94_dct[3:0] DRAM Configuration High
-		MemClkFreqVal = GetBits(eax, 7, 1); // MemClkFreqVal
+		MemClkFreqVal = D18F2x94::MemClkFreqVal::Get(eax);
 		eax = ReadPciConfig(AMD_CPU_DEVICE, 2, 0x2E0); // D18F2x2E0_dct[3:0] Memory P-state Control and Status
-		FastMstateDis = GetBits(eax, 30, 1); // FastMstateDis
+		FastMstateDis = D18F2x2E0::FastMstateDis::Get(eax);
 
 		eax = ReadPciConfig(AMD_CPU_DEVICE, 5, 0x178); // D18F5x178 Northbridge Fusion Configuration
-		SwGfxDis = GetBits(eax, 19, 1); // SwGfxDis
+		SwGfxDis = D18F5x178::SwGfxDis::Get(eax);
 		eax = ReadPciConfig(AMD_CPU_DEVICE, 5, 0x17C); // D18F5x17C Miscellaneous Voltages
-		NbPsi0Vid = GetBits(eax, 23, 8); // NbPsi0Vid[7:0]
-		NbPsi0VidEn = GetBits(eax, 31, 1); // NbPsi0VidEn
-
-		// The index/data pair registers, D0F0xB8 and D0F0xBC, are used to access the registers at
-		// D0F0xBC_x[FFFFFFFF:00000000].To access any of these registers, the address is first written into the index
-		// register, D0F0xB8, and then the data is read from or written to the data register, D0F0xBC.
-		eax = 0x0003FDC8; // D0F0xBC_x3FDC8 SMU_LCLK_DPM_CNTL
-		WritePciConfig(0, 0, 0xB8, eax); // D0F0xBC_x3FDC8 SMU_LCLK_DPM_CNTL
-		eax = ReadPciConfig(0, 0, 0xBC); // D0F0xBC_x3FDC8 SMU_LCLK_DPM_CNTL
-		LclkDpmBootState = GetBits(eax, 8, 8); // LclkDpmBootState[7:0]
-		VoltageChgEn = GetBits(eax, 16, 8); // VoltageChgEn[7:0]
-		LclkDpmEn = GetBits(eax, 24, 8); // LclkDpmEn[7:0]
+		NbPsi0Vid = D18F5x17C::NbPsi0Vid::Get(eax);
+		NbPsi0VidEn = D18F5x17C::NbPsi0VidEn::Get(eax);
+
+		eax = smuValues[1]; // D0F0xBC_x3FDC8 SMU_LCLK_DPM_CNTL
+		LclkDpmBootState = D0F0xBC_x3FDC8::LclkDpmBootState::Get(eax);
+		VoltageChgEn = D0F0xBC_x3FDC8::VoltageChgEn::Get(eax);
+		LclkDpmEn = D0F0xBC_x3FDC8::LclkDpmEn::Get(eax);
 	}
 	if( Family == 0x12 || Family == 0x15 )
 	{
@@ -122,16 +102,16 @@ bool Info::Initialize()
 		if( eax != 0xFFFFFFFF ) // GpuEnabled = (D1F0x00!=FFFF_FFFFh)
 			GpuEnabled = 1;
 		eax = ReadPciConfig( 0, 0, 0x7C ); // D0F0x7C IOC Configuration Control
-		ForceIntGfxDisable = GetBits( eax, 0, 0 ); // ForceIntGfxDisable
+		ForceIntGfxDisable = D0F0x7C::ForceIntGfxDisable::Get( eax );
 	}
 
 	// get limits
-	msr = Rdmsr(0xc0010071);
+	msr = Rdmsr(MSRC001_0071::Index); // COFVID Status
 
-	const int maxMulti = GetBits(msr, 49, 6);
-	const int minVID = GetBits(msr, 42, 7);
-	const int maxVID = GetBits(msr, 35, 7);
-	NbPstateDis = GetBits(msr, 23, 1);
+	const int maxMulti = MSRC001_0071::MaxCpuCof::Get(msr);
+	const int minVID = MSRC001_0071::MinVid::Get(msr);
+	const int maxVID = MSRC001_0071::MaxVid::Get(msr);
+	NbPstateDis = MSRC001_0071::NbPstateDis::Get(msr);
 
 	MinMulti = (Family == 0x14 ? (maxMulti == 0 ? 0 : (maxMulti + 16) / 26.5)
 	                           : 1.0);
@@ -140,6 +120,12 @@ bool Info::Initialize()
 	                          : (Family == 0x12 || Family == 0x14 ? maxMulti + 16 : maxMulti));
 	MaxSoftwareMulti = MaxMulti;
 
+	// select the P-state encoding of the platform once; it provides the VID step (0.00625 for SVI2 platforms)
+	// and the scale factor from the external multi to the internal one (2 for 200MHz REFCLK platforms)
+	_codec.reset(PStateCodec::Create(Family, Model, MaxMulti));
+	VIDStep = _codec->GetVIDStep();
+	multiScaleFactor = _codec->GetMultiScaleFactor();
+
 	MinVID = (minVID == 0 ? 0.0
 	                      : DecodeVID(minVID));
 	MaxVID = (maxVID == 0 ? 1.55
@@ -147,25 +133,25 @@ bool Info::Initialize()
 
 	// is CBP (core performance boost) supported?
 	regs = Cpuid(0x80000007);
-	IsBoostSupported = (GetBits(regs.edx, 9, 1) == 1);
+	IsBoostSupported = (CPUID_8000_0007_EDX::CPB::Get(regs.edx) == 1);
 
 	if (IsBoostSupported)
 	{
 		// is CPB disabled for the current core?
-		msr = Rdmsr(0xc0010015);
-		const bool cpbDis = (GetBits(msr, 25, 1) == 1);
+		msr = Rdmsr(MSRC001_0015::Index);
+		const bool cpbDis = (MSRC001_0015::CpbDis::Get(msr) == 1);
 
 		// boost lock, number of boost P-states and boost source
-		eax = ReadPciConfig(AMD_CPU_DEVICE, 4, 0x15c);
+		eax = ReadPciConfig(AMD_CPU_DEVICE, 4, D18F4x15C::Address);
 		IsBoostLocked = (Family == 0x12 ? true
-		                                : GetBits(eax, 31, 1) == 1);
-		NumBoostStates = (Family == 0x10 ? GetBits(eax, 2, 1)
-		                                 : GetBits(eax, 2, 3));
+		                                : D18F4x15C::BoostLock::Get(eax) == 1);
+		NumBoostStates = (Family == 0x10 ? D18F4x15C::NumBoostStatesF10::Get(eax)
+		                                 : D18F4x15C::NumBoostStates::Get(eax));
 
-		BoostEnAllCores = ( Family == 0x12 ? GetBits( eax, 29, 1 ) : -1 );
-		IgnoreBoostThresh = ( Family == 0x12 ? GetBits( eax, 28, 1 ) : -1 );
+		BoostEnAllCores = ( Family == 0x12 ? (int)D18F4x15C::BoostEnAllCores::Get( eax ) : -1 );
+		IgnoreBoostThresh = ( Family == 0x12 ? (int)D18F4x15C::IgnoreBoostThresh::Get( eax ) : -1 );
 
-		const int boostSrc = GetBits(eax, 0, 2);
+		const int boostSrc = D18F4x15C::BoostSrc::Get(eax);
 		const bool isBoostSrcEnabled = (Family == 0x10 ? (boostSrc == 3)
 		                                               : (boostSrc == 1));
 
@@ -175,14 +161,14 @@ bool Info::Initialize()
 		if (Family == 0x10)
 		{
 			eax = ReadPciConfig(AMD_CPU_DEVICE, 3, 0x1f0);
-			const int maxSoftwareMulti = GetBits(eax, 20, 6);
+			const int maxSoftwareMulti = D18F3x1F0::MaxSwPstateCpuCof::Get(eax);
 			MaxSoftwareMulti = (maxSoftwareMulti == 0 ? 63
 			                                          : maxSoftwareMulti);
 		}
 		else if (Family == 0x15)
 		{
 			eax = ReadPciConfig(AMD_CPU_DEVICE, 3, 0xd4);
-			const int maxSoftwareMulti = GetBits(eax, 0, 6);
+			const int maxSoftwareMulti = D18F3xD4::MaxSwPstateCpuCof::Get(eax);
 			MaxSoftwareMulti = (maxSoftwareMulti == 0 ? 63
 			                                          : maxSoftwareMulti);
 		}
@@ -193,110 +179,26 @@ bool Info::Initialize()
 
 
 
-PStateInfo Info::ReadPState(int index) const
+PStateInfo Info::ReadPState(int index, int cpu) const
 {
-	const QWORD msr = Rdmsr(0xc0010064 + index); // MSRC001_00[6B:64] P-state [7:0]
+	const QWORD msr = Rdmsr(MSRC001_0064::Index + index, cpu); // MSRC001_00[6B:64] P-state [7:0]
 
 	PStateInfo result;
 	result.Index = index;
-
-	int fid, did;
-	if (Family == 0x14)
-	{
-		fid = GetBits(msr, 4, 5); // DID MSD
-		did = GetBits(msr, 0, 4); // DID LSD
-	}
-	else if (Family == 0x12)
-	{
-		fid = GetBits(msr, 4, 5);
-		did = GetBits(msr, 0, 4);
-	}
-	else
-	{
-		fid = GetBits(msr, 0, 6);
-		did = GetBits(msr, 6, 3);
-	}
-
-	result.Multi = DecodeMulti(fid, did);
-
-	//on SVI2 platforms, VID is 8 bits
-	if (Family == 0x15 && ((Model > 0xF && Model < 0x20) || (Model > 0x2F && Model < 0x40)))
-		result.VID = GetBits(msr, 9, 8);
-	else
-		result.VID = GetBits(msr, 9, 7);
-
-	if (!(Family == 0x12 || Family == 0x14))
-	{
-		const int nbpstate = GetBits(msr, 22, 1); // NbPstate
-		result.NBPState = nbpstate;
-	}
-	else
-		result.NBPState = -1;
-
-	if (Family == 0x10)
-	{
-		result.NBVID = GetBits(msr, 25, 7);
-	}
-	else
-		result.NBVID = -1;
+	_codec->DecodePState(msr, result);
 
 	return result;
 }
 
-void Info::WritePState(const PStateInfo& info) const
+void Info::WritePState(const PStateInfo& info, RegisterTransaction& transaction, int cpu) const
 {
-	const DWORD regIndex = 0xc0010064 + info.Index;
-	QWORD msr = Rdmsr(regIndex);
+	const DWORD regIndex = MSRC001_0064::Index + info.Index;
 
-	if (info.Multi >= 0)
-	{
-		int fid, did;
-		EncodeMulti(info.Multi, fid, did);
+	QWORD mask, value;
+	_codec->EncodePState(info, mask, value);
 
-		if (Family == 0x14)
-		{
-			SetBits(msr, fid, 4, 5); // DID MSD
-			SetBits(msr, did, 0, 4); // DID LSD
-		}
-		else if (Family == 0x12)
-		{
-			SetBits(msr, fid, 4, 5);
-			SetBits(msr, did, 0, 4);
-		}
-		else
-		{
-			SetBits(msr, fid, 0, 6);
-			SetBits(msr, did, 6, 3);
-		}
-	}
-
-	if (info.VID >= 0)
-	{
-		//on SVI2 platforms, VID is 8 bits
-		if (Family == 0x15 && ((Model > 0xF && Model < 0x20) || (Model > 0x2F && Model < 0x40)))
-			SetBits(msr, info.VID, 9, 8);
-		else
-			SetBits(msr, info.VID, 9, 7);
-	}
-
-	if (info.NBPState >= 0)
-	{
-		if (!(Family == 0x12 || Family == 0x14))
-		{
-			const int nbDid = max(0, min(1, info.NBPState));
-			SetBits(msr, nbDid, 22, 1);
-		}
-	}
-
-	if (info.NBVID >= 0)
-	{
-		if (Family == 0x10)
-		{
-			SetBits(msr, info.NBVID, 25, 7);
-		}
-	}
-
-	Wrmsr(regIndex, msr);
+	if (mask != 0)
+		transaction.SetMsrMasked(regIndex, mask, value, cpu);
 }
 
 
@@ -304,64 +206,49 @@ void Info::WritePState(const PStateInfo& info) const
 NBPStateInfo Info::ReadNBPState(int index) const
 {
 	if (Family != 0x15)
-		throw std::exception("NB P-states not supported");
+		throw std::runtime_error("NB P-states not supported");
 
 	NBPStateInfo result;
 	result.Index = index;
 
-	const DWORD eax = ReadPciConfig(AMD_CPU_DEVICE, 5, 0x160 + index * 4); // D18F5x16[C:0] Northbridge P-state [3:0]
-
-	const int enabled = GetBits(eax, 0, 1); // NbPstateEn
-	const int fid = GetBits(eax, 1, 5); // NbFid[5:0]
-	const int did = GetBits(eax, 7, 1); // NbDid
-	int vid = GetBits(eax, 10, 7); // NbVid[6:0]
-	const int mempstate = GetBits(eax, 18, 1); // MemPstate
-	const int vid7 = GetBits(eax, 21, 1); // NbVid[7]
+	const DWORD eax = ReadPciConfig(AMD_CPU_DEVICE, 5, D18F5x160::Address + index * 4); // D18F5x16[C:0] Northbridge P-state [3:0]
 
-	//on SVI2 platforms, 8th bit for NB P-State is stored separately
-	if (Family == 0x15 && ((Model > 0xF && Model < 0x20) || (Model > 0x2F && Model < 0x40)))
-		vid += (vid7 << 7);
+	const int enabled = D18F5x160::NbPstateEn::Get(eax);
+	const int fid = D18F5x160::NbFid::Get(eax);
+	const int did = D18F5x160::NbDid::Get(eax);
+	const int mempstate = D18F5x160::MemPstate::Get(eax);
+	const int vid = _codec->DecodeNbVid(eax); // NbVid[7] is stored separately on SVI2 platforms
 
 	result.Enabled = enabled;
-	result.Multi = (fid + 4) / pow(2.0, did);
+	result.Multi = PStateCodec::DecodeNbMulti(fid, did);
 	result.VID = vid;
 	result.MemPState = mempstate;
 
 	return result;
 }
 
-void Info::WriteNBPState(const NBPStateInfo& info) const
+void Info::WriteNBPState(const NBPStateInfo& info, RegisterTransaction& transaction) const
 {
 	if (Family != 0x15)
-		throw std::exception("NB P-states not supported");
+		throw std::runtime_error("NB P-states not supported");
 
-	const DWORD regAddress = 0x160 + info.Index * 4;
-	DWORD eax = ReadPciConfig(AMD_CPU_DEVICE, 5, regAddress);
+	const DWORD regAddress = D18F5x160::Address + info.Index * 4;
 
 	if (info.Multi >= 0)
 	{
-		static const double divisors[] = { 1.0, 2.0, 0.0 }; // 2^did
-
-		int numerator, divisorIndex;
-		FindFraction(info.Multi, divisors, numerator, divisorIndex, 4, 31 + 4);
-
-		const int fid = numerator - 4;
-		const int did = divisorIndex;
+		int fid, did;
+		PStateCodec::EncodeNbMulti(info.Multi, fid, did);
 
-		SetBits(eax, fid, 1, 5);
-		SetBits(eax, did, 7, 1);
+		typedef D18F5x160::NbCof NbCof;
+		transaction.SetPciMasked(AMD_CPU_DEVICE, 5, regAddress, NbCof::Mask(), NbCof::Make(fid, did));
 	}
 
 	if (info.VID >= 0)
 	{
-		SetBits(eax, info.VID, 10, 7);
-
-		//on SVI2 platforms, 8th bit for NB P-State is stored separately
-		if (Family == 0x15 && ((Model > 0xF && Model < 0x20) || (Model > 0x2F && Model < 0x40)))
-			SetBits(eax, (info.VID >> 7), 21, 1);
+		DWORD mask, value;
+		_codec->EncodeNbVid(info.VID, mask, value);
+		transaction.SetPciMasked(AMD_CPU_DEVICE, 5, regAddress, mask, value);
 	}
-
-	WritePciConfig(AMD_CPU_DEVICE, 5, regAddress, eax);
 }
 
 
@@ -370,7 +257,7 @@ void Info::WriteNBPState(const NBPStateInfo& info) const
 MemPStateInfo Info::ReadMemPState(int index) const
 {
 	if (Family != 0x15)
-		throw std::exception("Mem P-states not supported");
+		throw std::runtime_error("Mem P-states not supported");
 
 	MemPStateInfo result;
 	result.Index = index;
@@ -382,12 +269,12 @@ MemPStateInfo Info::ReadMemPState(int index) const
 	if (index == 0)
 	{
 		eax = ReadPciConfig(AMD_CPU_DEVICE, 2, 0x94); // D18F2x94_dct[3:0] DRAM Configuration High
-		memclkfreq = GetBits(eax, 0, 5); // MemClkFreq[4:0]
+		memclkfreq = D18F2x94::MemClkFreq::Get(eax);
 	}
 	else if (index == 1)
 	{
 		eax = ReadPciConfig(AMD_CPU_DEVICE, 2, 0x2E0); // D18F2x2E0_dct[3:0] Memory P-state Control and Status
-		memclkfreq = GetBits(eax, 24, 5); // M1MemClkFreq[4:0]
+		memclkfreq = D18F2x2E0::M1MemClkFreq::Get(eax);
 	}
 
 	switch (memclkfreq)
@@ -440,31 +327,45 @@ MemPStateInfo Info::ReadMemPState(int index) const
 
 
 
+static iGPUPStateInfo DecodeiGPUPState(int index, DWORD eax)
+{
+	iGPUPStateInfo result;
+	result.Index = index;
+
+	// D0F0xBC_x3FD[8C:00:step14] LCLK DPM Control 0
+	result.StateValid = D0F0xBC_x3FD00::StateValid::Get(eax);
+	result.LclkDivider = D0F0xBC_x3FD00::LclkDivider::Get(eax);
+	result.VID = D0F0xBC_x3FD00::VID::Get(eax);
+	result.LowVoltageReqThreshold = D0F0xBC_x3FD00::LowVoltageReqThreshold::Get(eax);
+
+	return result;
+}
+
 iGPUPStateInfo Info::ReadiGPUPState(int index) const
 {
 	if (Family != 0x15)
-		throw std::exception("iGPU P-states not supported");
+		throw std::runtime_error("iGPU P-states not supported");
 
-	iGPUPStateInfo result;
-	result.Index = index;
+	const DWORD eax = ReadSmuRegister(D0F0xBC_x3FD00::Offset + index * D0F0xBC_x3FD00::Step); // LCLK DPM Control 0
+	return DecodeiGPUPState(index, eax);
+}
 
-	DWORD eax;
+std::vector<iGPUPStateInfo> Info::ReadiGPUPStates() const
+{
+	if (Family != 0x15)
+		throw std::runtime_error("iGPU P-states not supported");
 
-	// The index/data pair registers, D0F0xB8 and D0F0xBC, are used to access the registers at
-	// D0F0xBC_x[FFFFFFFF:00000000].To access any of these registers, the address is first written into the index
-	// register, D0F0xB8, and then the data is read from or written to the data register, D0F0xBC.
-	eax = 0x0003FD00 + index * 0x14; // D0F0xBC_x3FD[8C:00:step14] LCLK DPM Control 0
-	WritePciConfig(0, 0, 0xB8, eax); // D0F0xBC_x3FD[8C:00:step14] LCLK DPM Control 0
-	eax = ReadPciConfig(0, 0, 0xBC); // D0F0xBC_x3FD[8C:00:step14] LCLK DPM Control 0
-	int statevalid = GetBits(eax, 24, 8); // StateValid[7:0]
-	int lclkdivider = GetBits(eax, 16, 8); // LclkDivider[7:0]
-	int vid = GetBits(eax, 8, 8); // VID[7:0]
-	int lowvoltagereqthreshold = GetBits(eax, 0, 8); // LowVoltageReqThreshold[7:0]
-
-	result.StateValid = statevalid;
-	result.LclkDivider = lclkdivider;
-	result.VID = vid;
-	result.LowVoltageReqThreshold = lowvoltagereqthreshold;
+	DWORD offsets[NUM_IGPU_PSTATES];
+	DWORD values[NUM_IGPU_PSTATES];
+
+	for (int i = 0; i < NUM_IGPU_PSTATES; i++)
+		offsets[i] = D0F0xBC_x3FD00::Offset + i * D0F0xBC_x3FD00::Step; // LCLK DPM Control 0
+
+	ReadSmuRegisters(offsets, values, NUM_IGPU_PSTATES);
+
+	std::vector<iGPUPStateInfo> result;
+	for (int i = 0; i < NUM_IGPU_PSTATES; i++)
+		result.push_back(DecodeiGPUPState(i, values[i]));
 
 	return result;
 }
@@ -472,10 +373,10 @@ iGPUPStateInfo Info::ReadiGPUPState(int index) const
 DRAMInfo Info::ReadDRAMInfo( int index ) const
 {
 	if( Family != 0x12 )
-		throw std::exception( "DRAMInfo not supported" );
+		throw std::runtime_error( "DRAMInfo not supported" );
 
 	if( index != 0 && index != 1 )
-		throw std::exception( "Index out of range" );
+		throw std::runtime_error( "Index out of range" );
 
 	DRAMInfo result;
 	DWORD eax;
@@ -497,7 +398,7 @@ DRAMInfo Info::ReadDRAMInfo( int index ) const
 
 	// D18F2x[1,0]88 (DRAM Timing Low Register)
 	eax = ReadPciConfig( AMD_CPU_DEVICE, 2, TimingLowReg_idx );
-	result.tCL = GetBits( eax, 0, 4 ) + 4; // [3:0] Tcl (- 4)
+	result.tCL = D18F2x88::Tcl::Get( eax ) + 4; // [3:0] Tcl (- 4)
 
 	// D18F2x[1,0]F0 (DRAM Controller Extra Data Offset Register)
 	// This register is paired with D18F2x[1,0]F4 (DRAM Controller Extra Data Port)
@@ -507,10 +408,10 @@ DRAMInfo Info::ReadDRAMInfo( int index ) const
 	// Now F4 is populated with that register.
 	eax = ReadPciConfig( AMD_CPU_DEVICE, 2, XDPortReg_idx );
 
-	result.tRCD = GetBits( eax, 0, 4 ) + 5; // [3:0] Trcd (- 5)
-	result.tRP = GetBits( eax, 8, 4 ) + 5; // [11:8] Trp (- 5)
-	result.tRAS = GetBits( eax, 16, 5 ) + 15; // [20:16] Tras (- 15)
-	result.tRC = GetBits( eax, 24, 6 ) + 16; // [29:24] Trc (- 16)
+	result.tRCD = D18F2xF4_x40::Trcd::Get( eax ) + 5; // [3:0] Trcd (- 5)
+	result.tRP = D18F2xF4_x40::Trp::Get( eax ) + 5; // [11:8] Trp (- 5)
+	result.tRAS = D18F2xF4_x40::Tras::Get( eax ) + 15; // [20:16] Tras (- 15)
+	result.tRC = D18F2xF4_x40::Trc::Get( eax ) + 16; // [29:24] Trc (- 16)
 
 	// !! EXAMPLE WRITE CODE !! //
 #if YOU_ARE_INSANE
@@ -518,7 +419,7 @@ DRAMInfo Info::ReadDRAMInfo( int index ) const
 	WritePciConfig( AMD_CPU_DEVICE, 2, XDOffsetReg_idx, 0x40 );
 	eax = ReadPciConfig( AMD_CPU_DEVICE, 2, XDPortReg_idx );
 	// Modify only the bits to be changed
-	SetBits( eax, 4, 8, 4 );
+	eax = D18F2xF4_x40::Trp::Insert( eax, 4 );
 	// Write the new value to F4
 	WritePciConfig( AMD_CPU_DEVICE, 2, XDPortReg_idx, eax );
 	// Write the F4 offset to F0, with bit 30 (0-index, 31 for 1-index) set to 1 ("DctAccessWrite")
@@ -529,14 +430,14 @@ DRAMInfo Info::ReadDRAMInfo( int index ) const
 	WritePciConfig( AMD_CPU_DEVICE, 2, XDOffsetReg_idx, 0x41 );
 	eax = ReadPciConfig( AMD_CPU_DEVICE, 2, XDPortReg_idx );
 
-	result.tRTP = GetBits( eax, 0, 3 ) + 4; // [2:0] Trtp (- 4)
-	result.tRRD = GetBits( eax, 8, 3 ) + 4; // [10:8] Trrd (- 4)
-	result.tWTR = GetBits( eax, 16, 3 ) + 4; // [18:16] Twtr (- 4)
+	result.tRTP = D18F2xF4_x41::Trtp::Get( eax ) + 4; // [2:0] Trtp (- 4)
+	result.tRRD = D18F2xF4_x41::Trrd::Get( eax ) + 4; // [10:8] Trrd (- 4)
+	result.tWTR = D18F2xF4_x41::Twtr::Get( eax ) + 4; // [18:16] Twtr (- 4)
 
 	// D18F2x[1,0]94 (DRAM Configuration High Register)
 	eax = ReadPciConfig( AMD_CPU_DEVICE, 2, ConfigHighReg_idx );
-	result.CR = GetBits( eax, 20, 1 ) + 1; // [20] SlowAccessMode
-	switch( GetBits( eax, 0, 5 ) ) // [4:0] MemClkFreq
+	result.CR = D18F2x94::SlowAccessMode::Get( eax ) + 1; // [20] SlowAccessMode
+	switch( D18F2x94::MemClkFreq::Get( eax ) ) // [4:0] MemClkFreq
 	{
 		// There may be some way to calculate freq from those bits directly,
 		// however the BKDG documents only these values as being valid,
@@ -563,7 +464,7 @@ DRAMInfo Info::ReadDRAMInfo( int index ) const
 
 	// D18F2x[1,0]84 (DRAM MRS Register)
 	eax = ReadPciConfig( AMD_CPU_DEVICE, 2, MRSReg_idx );
-	int twr = GetBits( eax, 4, 3 ); // [6:4] Twr
+	int twr = D18F2x84::Twr::Get( eax ); // [6:4] Twr
 	// TODO: Surely there's some one-liner thing to calculate at least >= 0b001 ???
 	if( twr >= 0b100 )
 		result.tWR = twr << 1;
@@ -572,249 +473,207 @@ DRAMInfo Info::ReadDRAMInfo( int index ) const
 	else if( twr >= 0b000 )
 		result.tWR = 16;
 
-	result.tCWL = GetBits( eax, 20, 3 ) + 5; // [22:20] Tcwl
+	result.tCWL = D18F2x84::Tcwl::Get( eax ) + 5; // [22:20] Tcwl
 
 	return result;
 }
 
 
 
-void Info::SetCPBDis(bool enabled) const
+void Info::SetCPBDis(bool enabled, RegisterTransaction& transaction, int cpu) const
 {
 	if (!IsBoostSupported)
-		throw std::exception("CPB not supported");
+		throw std::runtime_error("CPB not supported");
 
-	const DWORD index = 0xc0010015;
-	QWORD msr = Rdmsr(index);
-	SetBits(msr, (enabled ? 0 : 1), 25, 1);
-	Wrmsr(index, msr);
+	transaction.SetMsrField<MSRC001_0015::CpbDis>(MSRC001_0015::Index, (enabled ? 0 : 1), cpu);
 }
 
-void Info::SetBoostSource(bool enabled) const
+void Info::SetBoostSource(bool enabled, RegisterTransaction& transaction) const
 {
 	if (!IsBoostSupported)
-		throw std::exception("CPB not supported");
+		throw std::runtime_error("CPB not supported");
 
-	DWORD eax = ReadPciConfig(AMD_CPU_DEVICE, 4, 0x15c);
 	const int bits = (enabled ? (Family == 0x10 ? 3 : 1)
 	                          : 0);
-	SetBits(eax, bits, 0, 2);
-	WritePciConfig(AMD_CPU_DEVICE, 4, 0x15c, eax);
+	transaction.SetPciField<D18F4x15C::BoostSrc>(AMD_CPU_DEVICE, 4, D18F4x15C::Address, bits);
 }
 
-void Info::SetBoostEnAllCores( int val ) const
+void Info::SetBoostEnAllCores( int val, RegisterTransaction& transaction ) const
 {
 	if( !IsBoostSupported )
-		throw std::exception( "Boost not supported" );
+		throw std::runtime_error( "Boost not supported" );
 
 	if( BoostEnAllCores == -1 || Family != 0x12 )
-		throw std::exception( "BoostEnAllCores not supported" );
+		throw std::runtime_error( "BoostEnAllCores not supported" );
 
 	if( val != 1 && val != 0 )
-		throw std::exception( "Value out of range" );
+		throw std::runtime_error( "Value out of range" );
 
 	// D18F4x15C (Core Performance Boost Control)
-	DWORD eax = ReadPciConfig( AMD_CPU_DEVICE, 4, 0x15c );
-	SetBits( eax, val, 29, 1 ); // [29] BoostEnAllCores
-	WritePciConfig( AMD_CPU_DEVICE, 4, 0x15c, eax );
+	transaction.SetPciField<D18F4x15C::BoostEnAllCores>( AMD_CPU_DEVICE, 4, D18F4x15C::Address, val );
 }
 
-void Info::SetIgnoreBoostThresh( int val ) const
+void Info::SetIgnoreBoostThresh( int val, RegisterTransaction& transaction ) const
 {
 	if( !IsBoostSupported )
-		throw std::exception( "Boost not supported" );
+		throw std::runtime_error( "Boost not supported" );
 
 	if( IgnoreBoostThresh == -1 || Family != 0x12 )
-		throw std::exception( "IgnoreBoostThresh not supported" );
+		throw std::runtime_error( "IgnoreBoostThresh not supported" );
 
 	if( val != 1 && val != 0 )
-		throw std::exception( "Value out of range" );
+		throw std::runtime_error( "Value out of range" );
 
 	// D18F4x15C (Core Performance Boost Control)
-	DWORD eax = ReadPciConfig( AMD_CPU_DEVICE, 4, 0x15c );
-	SetBits( eax, val, 28, 1 ); // [28] IgnoreBoostThresh
-	WritePciConfig( AMD_CPU_DEVICE, 4, 0x15c, eax );
+	transaction.SetPciField<D18F4x15C::IgnoreBoostThresh>( AMD_CPU_DEVICE, 4, D18F4x15C::Address, val );
 }
 
-void Info::SetAPM(bool enabled) const
+void Info::SetAPM(bool enabled, RegisterTransaction& transaction) const
 {
 	if (Family != 0x15)
-		throw std::exception("APM not supported");
+		throw std::runtime_error("APM not supported");
 
-	DWORD eax = ReadPciConfig(AMD_CPU_DEVICE, 4, 0x15c);
-	SetBits(eax, (enabled ? 1 : 0), 7, 1);
-	WritePciConfig(AMD_CPU_DEVICE, 4, 0x15c, eax);
+	transaction.SetPciField<D18F4x15C::ApmMasterEn>(AMD_CPU_DEVICE, 4, D18F4x15C::Address, (enabled ? 1 : 0));
 }
 
 
 
-void Info::WriteNbPsi0Vid(const int VID) const
+void Info::WriteNbPsi0Vid(const int VID, RegisterTransaction& transaction) const
 {
 	if (Family != 0x15)
-		throw std::exception("NB P-states not supported");
-
-	DWORD eax = ReadPciConfig(AMD_CPU_DEVICE, 5, 0x17C); // D18F5x17C Miscellaneous Voltages
-	//GetBits(eax, 23, 8); // NbPsi0Vid[7:0]
-	//GetBits(eax, 31, 1); // NbPsi0VidEn
+		throw std::runtime_error("NB P-states not supported");
 
 	if (VID >= 0)
 	{
-		SetBits(eax, VID, 23, 8);
+		transaction.SetPciField<D18F5x17C::NbPsi0Vid>(AMD_CPU_DEVICE, 5, D18F5x17C::Address, VID);
 	}
-
-	WritePciConfig(AMD_CPU_DEVICE, 5, 0x17C, eax);
 }
 
 
-int Info::GetCurrentPState() const
+int Info::GetCurrentPState(int cpu) const
 {
-	const QWORD msr = Rdmsr(0xc0010071);
-	const int i = GetBits(msr, 16, 3);
+	const QWORD msr = Rdmsr(MSRC001_0071::Index, cpu);
+	const int i = MSRC001_0071::CurPstate::Get(msr);
 	return i;
 }
 
-void Info::SetCurrentPState(int index) const
+RegisterStatus Info::TryGetCurrentPState(int& index, int cpu) const
 {
-	if (index < 0 || index >= NumPStates)
-		throw std::exception("P-state index out of range");
-
-	index -= NumBoostStates;
-	if (index < 0)
-		index = 0;
+	QWORD msr;
+	const RegisterStatus status = TryRdmsr(MSRC001_0071::Index, msr, cpu);
+	if (status == REG_OK)
+		index = MSRC001_0071::CurPstate::Get(msr);
 
-	const DWORD regIndex = 0xc0010062;
-	QWORD msr = Rdmsr(regIndex);
-	SetBits(msr, index, 0, 3);
-	Wrmsr(regIndex, msr);
+	return status;
 }
 
+RegisterStatus Info::TryGetRequestedPState(int& index, int cpu) const
+{
+	QWORD msr;
+	const RegisterStatus status = TryRdmsr(MSRC001_0062::Index, msr, cpu); // P-state Control
+	if (status == REG_OK)
+		index = (int)MSRC001_0062::PstateCmd::Get(msr) + NumBoostStates; // software => hardware P-state numbering
 
+	return status;
+}
 
-double Info::DecodeMulti(int fid, int did) const
+RegisterStatus Info::TryReadCofVidStatus(CofVidStatus& result, int cpu) const
 {
-	if (Family == 0x14)
-	{
-		// fid => DID MSD (integral part of divisor - 1)
-		// did => DID LSD (fractional part of divisor, in quarters)
+	QWORD msr;
+	const RegisterStatus status = TryRdmsr(MSRC001_0071::Index, msr, cpu); // COFVID Status
+	if (status != REG_OK)
+		return status;
 
-		double divisor = fid + 1;
+	_codec->DecodeCofVid(msr, result);
 
-		if (divisor >= 16)
-			did &= ~1; // ignore least significant bit of LSD
-		divisor += did * 0.25;
+	return REG_OK;
+}
 
-		return MaxMulti / divisor;
-	}
+RegisterStatus Info::TryReadTemperature(double& celsius) const
+{
+	DWORD eax;
+	const RegisterStatus status = TryReadPciConfig(AMD_CPU_DEVICE, 3, D18F3xA4::Address, eax); // D18F3xA4 Reported Temperature Control
+	if (status != REG_OK)
+		return status;
 
-	const double* divisors = (Family == 0x12 ? DIVISORS_12
-	                                         : DIVISORS_10_15);
+	celsius = D18F3xA4::CurTmp::Get(eax) * 0.125;
+	if (Family == 0x15 && D18F3xA4::CurTmpTjSel::Get(eax) == 3)
+		celsius -= 49.0;
 
-	return (fid + 16) / divisors[did];
+	return REG_OK;
 }
 
-void Info::EncodeMulti(double multi, int& fid, int& did) const
+RegisterStatus Info::TryReadHtcStatus(HtcStatus& result) const
 {
-	if (Family == 0x14)
-	{
-		if (MaxMulti == 0)
-			throw std::exception("cannot encode multiplier (family 0x14) - unknown max multiplier");
-
-		const double exactDivisor = max(1.0, min(26.5, MaxMulti / multi));
-
-		double integer;
-		const double fractional = modf(exactDivisor, &integer);
+	DWORD eax;
+	const RegisterStatus status = TryReadPciConfig(AMD_CPU_DEVICE, 3, D18F3x64::Address, eax); // D18F3x64 Hardware Thermal Control
+	if (status != REG_OK)
+		return status;
+
+	result.Enabled = (D18F3x64::HtcEn::Get(eax) == 1);
+	result.Active = (D18F3x64::HtcAct::Get(eax) == 1);
+	result.WasActive = (D18F3x64::HtcActSts::Get(eax) == 1);
+	result.PStateLimit = (int)D18F3x64::HtcPstateLimit::Get(eax) + NumBoostStates;
+	result.Limit = 52.0 + D18F3x64::HtcTmpLmt::Get(eax) * 0.5;
+	result.Hysteresis = D18F3x64::HtcHystLmt::Get(eax) * 0.5;
+
+	return REG_OK;
+}
 
-		fid = (int)integer - 1;
+double Info::ReadTemperature() const
+{
+	double celsius;
+	const RegisterStatus status = TryReadTemperature(celsius);
+	if (status != REG_OK)
+		throw std::runtime_error(std::string("cannot read the temperature: ") + ToString(status));
 
-		did = (int)ceil(fractional / 0.25);
+	return celsius;
+}
 
-		if (integer >= 16)
-		{
-			if (did == 1)
-				did = 2;
-			else if (did == 3)
-				did = 4;
-		}
+void Info::SetCurrentPState(int index, int cpu) const
+{
+	if (index < 0 || index >= NumPStates)
+		throw std::runtime_error("P-state index out of range");
 
-		if (did == 4)
-		{
-			fid++;
-			did = 0;
-		}
+	index -= NumBoostStates;
+	if (index < 0)
+		index = 0;
 
-		return;
-	}
+	const QWORD msr = Rdmsr(MSRC001_0062::Index, cpu);
+	Wrmsr(MSRC001_0062::Index, MSRC001_0062::PstateCmd::Insert(msr, index), cpu);
+}
 
-	const int minNumerator = 16; // numerator: 0x10 = 16 as fixed offset
-	int maxNumerator;
-	const double* divisors;
+bool Info::WaitForPState(const PStateInfo& target, double timeoutSeconds, int cpu) const
+{
+	const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+		std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(timeoutSeconds));
 
-	if (Family == 0x12)
+	for (;;)
 	{
-		maxNumerator = 31 + minNumerator; // 5 bits => max 2^5-1 = 31
-		divisors = DIVISORS_12;
+		// CurPstate and CurCpuFid/CurCpuDid are per core (both multis are decoded by the same codec, so they
+		// compare exactly), CurCpuVid is the voltage of the shared plane: a sibling core requesting a higher
+		// voltage keeps it above the target, i.e., at a numerically lower VID
+		CofVidStatus status;
+		if (TryReadCofVidStatus(status, cpu) != REG_OK)
+			return false;
+
+		if (status.PState == target.Index && status.Multi == target.Multi && status.VID <= target.VID)
+			return true;
+
+		if (std::chrono::steady_clock::now() >= deadline)
+			return false;
 	}
-	else
-	{
-		maxNumerator = 47 + minNumerator; // 6 bits, but max 0x2f = 47
-		divisors = DIVISORS_10_15;
-	}
-
-	int numerator, divisorIndex;
-	FindFraction(multi, divisors, numerator, divisorIndex, minNumerator, maxNumerator);
-
-	fid = numerator - minNumerator;
-	did = divisorIndex;
 }
 
 
+
 double Info::DecodeVID(int vid) const
 {
-	return 1.55 - vid * VIDStep;
+	return _codec->DecodeVID(vid);
 }
 
 int Info::EncodeVID(double vid) const
 {
-	vid = max(0.0, min(1.55, vid));
-
-	// round to nearest step
-	int r = (int)(vid / VIDStep + 0.5);
-
-	//1.55 / VIDStep = highest VID (0 V)
-	return (int)(1.55 / VIDStep) - r;
+	return _codec->EncodeVID(vid);
 }
 
-
-
-void FindFraction(double value, const double* divisors,
-	int& numerator, int& divisorIndex,
-	int minNumerator, int maxNumerator)
-{
-	// limitations: non-negative value and divisors
-
-	// count the null-terminated and ascendingly ordered divisors
-	int numDivisors = 0;
-	for (; divisors[numDivisors] > 0; numDivisors++) { }
-
-	// make sure the value is in a valid range
-	value = max(minNumerator / divisors[numDivisors-1], min(maxNumerator / divisors[0], value));
-
-	// search the best-matching combo
-	double bestValue = -1.0; // numerator / divisors[divisorIndex]
-	for (int i = 0; i < numDivisors; i++)
-	{
-		const double d = divisors[i];
-		const int n = max(minNumerator, min(maxNumerator, (int)(value * d)));
-		const double myValue = n / d;
-
-		if (myValue <= value && myValue > bestValue)
-		{
-			numerator = n;
-			divisorIndex = i;
-			bestValue = myValue;
-
-			if (bestValue == value)
-				break;
-		}
-	}
-}
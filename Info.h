@@ -7,6 +7,13 @@
 
 #pragma once
 
+#include <memory>
+#include <vector>
+#include "PStateCodec.h"
+#include "RegisterAccess.h"
+
+class RegisterTransaction;
+
 
 struct PStateInfo
 {
@@ -42,6 +49,25 @@ struct iGPUPStateInfo
 	int LowVoltageReqThreshold; // derived from LowVoltageReqThreshold in D0F0xBC_x3FD[8C:00:step14] LCLK DPM Control 0
 };
 
+struct CofVidStatus // MSRC001_0071 COFVID Status
+{
+	int PState;   // CurPstate[2:0]
+	int Fid;      // CurCpuFid (DID MSD for family 0x14)
+	int Did;      // CurCpuDid (DID LSD for family 0x14)
+	int VID;      // CurCpuVid
+	double Multi; // internal one for 100 MHz reference
+};
+
+struct HtcStatus // D18F3x64 Hardware Thermal Control
+{
+	bool Enabled;        // HtcEn
+	bool Active;         // HtcAct
+	bool WasActive;      // HtcActSts, has been HTC-active since the flag was last cleared
+	int PStateLimit;     // HtcPstateLimit, hardware P-state numbering
+	double Limit;        // Tctl limit in degrees
+	double Hysteresis;   // in degrees
+};
+
 struct DRAMInfo
 {
 	int Freq = -1;
@@ -63,6 +89,8 @@ class Info
 {
 public:
 
+	static const int NUM_IGPU_PSTATES = 8; // D0F0xBC_x3FD[8C:00:step14] LCLK DPM Control 0
+
 	int Family;
 	int Model;
 	int NumCores;
@@ -166,35 +194,55 @@ public:
 
 	bool Initialize();
 
-	PStateInfo ReadPState(int index) const;
-	void WritePState(const PStateInfo& info) const;
+	// writers taking a RegisterTransaction only queue their changes, see RegisterTransaction::Commit()
+
+	PStateInfo ReadPState(int index, int cpu = CURRENT_CPU) const;
+	void WritePState(const PStateInfo& info, RegisterTransaction& transaction, int cpu = CURRENT_CPU) const;
 
 	NBPStateInfo ReadNBPState(int index) const;
-	void WriteNBPState(const NBPStateInfo& info) const;
+	void WriteNBPState(const NBPStateInfo& info, RegisterTransaction& transaction) const;
 
 	MemPStateInfo ReadMemPState(int index) const;
 
 	iGPUPStateInfo ReadiGPUPState(int index) const;
+	std::vector<iGPUPStateInfo> ReadiGPUPStates() const; // all LCLK DPM states in a single batch
 
 	DRAMInfo ReadDRAMInfo( int index ) const;
 
-	void SetCPBDis(bool enabled) const;
-	void SetBoostSource(bool enabled) const;
-	void SetBoostEnAllCores( int val ) const;
-	void SetIgnoreBoostThresh( int val ) const;
-	void SetAPM(bool enabled) const;
+	void SetCPBDis(bool enabled, RegisterTransaction& transaction, int cpu = CURRENT_CPU) const;
+	void SetBoostSource(bool enabled, RegisterTransaction& transaction) const;
+	void SetBoostEnAllCores( int val, RegisterTransaction& transaction ) const;
+	void SetIgnoreBoostThresh( int val, RegisterTransaction& transaction ) const;
+	void SetAPM(bool enabled, RegisterTransaction& transaction) const;
+
+	void WriteNbPsi0Vid(const int VID, RegisterTransaction& transaction) const;
 
-	void WriteNbPsi0Vid(const int VID) const;
+	int GetCurrentPState(int cpu = CURRENT_CPU) const;
+	void SetCurrentPState(int index, int cpu = CURRENT_CPU) const;
 
-	int GetCurrentPState() const;
-	void SetCurrentPState(int index) const;
+	/// <summary>
+	/// Spins on the COFVID status until the core runs in the P-state (as returned by ReadPState()) at its
+	/// multiplier and the shared voltage plane provides at least its voltage. Returns false on a timeout or a failing read.
+	/// </summary>
+	bool WaitForPState(const PStateInfo& target, double timeoutSeconds, int cpu = CURRENT_CPU) const;
+
+	// non-throwing and non-allocating readers for monitoring loops
+	RegisterStatus TryGetCurrentPState(int& index, int cpu = CURRENT_CPU) const;
+	RegisterStatus TryGetRequestedPState(int& index, int cpu = CURRENT_CPU) const; // PstateCmd, hardware numbering
+	RegisterStatus TryReadCofVidStatus(CofVidStatus& status, int cpu = CURRENT_CPU) const;
+	RegisterStatus TryReadTemperature(double& celsius) const; // Tctl of the first node
+	RegisterStatus TryReadHtcStatus(HtcStatus& status) const;
+
+	double ReadTemperature() const;
 
 	double DecodeVID(int vid) const;
 	int EncodeVID(double vid) const;
 
+	/// <summary>Returns the P-state encoding selected by Initialize().</summary>
+	const PStateCodec& GetCodec() const { return *_codec; }
+
 private:
 
-	double DecodeMulti(int fid, int did) const;
-	void EncodeMulti(double multi, int& fid, int& did) const;
+	std::shared_ptr<const PStateCodec> _codec;
 
 };
@@ -0,0 +1,333 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#ifndef _WIN32
+
+#include <cpuid.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "LinuxBackend.h"
+
+using std::lock_guard;
+using std::mutex;
+using std::vector;
+
+
+static int OpenReadWrite(const char* path)
+{
+	int fd = open(path, O_RDWR | O_CLOEXEC);
+	if (fd < 0)
+		fd = open(path, O_RDONLY | O_CLOEXEC); // sufficient for reading infos
+
+	return fd;
+}
+
+static RegisterStatus ErrnoToStatus()
+{
+	// the msr/cpuid drivers fail with ENXIO if the CPU has gone offline
+	if (errno == ENXIO || errno == ENODEV)
+		return REG_CPU_UNAVAILABLE;
+
+	return (errno == EPERM || errno == EACCES ? REG_ACCESS_DENIED : REG_ACCESS_FAILED);
+}
+
+// the msr driver fails with EIO if the MSR is not implemented (#GP)
+static RegisterStatus ReadAt(int fd, void* buffer, size_t size, QWORD offset)
+{
+	if (pread(fd, buffer, size, (off_t)offset) != (ssize_t)size)
+		return ErrnoToStatus();
+
+	return REG_OK;
+}
+
+static RegisterStatus WriteAt(int fd, const void* buffer, size_t size, QWORD offset)
+{
+	if (pwrite(fd, buffer, size, (off_t)offset) != (ssize_t)size)
+		return ErrnoToStatus();
+
+	return REG_OK;
+}
+
+
+LinuxBackend::LinuxBackend()
+{
+	for (int i = 0; i < NUM_PCI_FILES; i++)
+		_pciConfigFiles[i] = -2;
+}
+
+LinuxBackend::~LinuxBackend()
+{
+	for (size_t i = 0; i < _msrFiles.size(); i++)
+	{
+		if (_msrFiles[i] >= 0)
+			close(_msrFiles[i]);
+		if (_cpuidFiles[i] >= 0)
+			close(_cpuidFiles[i]);
+	}
+
+	for (int i = 0; i < NUM_PCI_FILES; i++)
+	{
+		if (_pciConfigFiles[i] >= 0)
+			close(_pciConfigFiles[i]);
+	}
+}
+
+bool LinuxBackend::Initialize()
+{
+	// the files are indexed by logical CPU index, i.e., among the online CPUs only
+	const int numCPUs = GetNumLogicalCPUs();
+
+	bool anyMsrFile = false;
+	for (int i = 0; i < numCPUs; i++)
+	{
+		const int id = GetLogicalCPUId(i);
+		char path[64];
+
+		snprintf(path, sizeof(path), "/dev/cpu/%d/msr", id);
+		const int msrFile = OpenReadWrite(path);
+		_msrFiles.push_back(msrFile);
+		anyMsrFile |= (msrFile >= 0);
+
+		snprintf(path, sizeof(path), "/dev/cpu/%d/cpuid", id);
+		_cpuidFiles.push_back(open(path, O_RDONLY | O_CLOEXEC));
+	}
+
+	// the msr module may not be loaded or we may lack the required privileges
+	return anyMsrFile;
+}
+
+int LinuxBackend::GetCpuFile(const vector<int>& files, int cpu) const
+{
+	if (cpu == CURRENT_CPU)
+		cpu = GetCurrentCPU();
+
+	return (cpu >= 0 && cpu < (int)files.size() ? files[cpu] : -1);
+}
+
+int LinuxBackend::GetPciConfigFile(DWORD device, DWORD function)
+{
+	if (device >= 32 || function >= 8)
+		return -1;
+
+	std::atomic<int>& file = _pciConfigFiles[device * 8 + function];
+
+	int fd = file.load(std::memory_order_acquire);
+	if (fd != -2)
+		return fd;
+
+	lock_guard<mutex> lock(_pciOpenMutex);
+
+	fd = file.load(std::memory_order_relaxed);
+	if (fd == -2)
+	{
+		char path[64];
+		snprintf(path, sizeof(path), "/sys/bus/pci/devices/0000:00:%02x.%x/config", (unsigned int)device, (unsigned int)function);
+
+		fd = OpenReadWrite(path);
+		file.store(fd, std::memory_order_release);
+	}
+
+	return fd;
+}
+
+
+RegisterStatus LinuxBackend::Rdmsr(int cpu, DWORD index, QWORD& value)
+{
+	const int fd = GetCpuFile(_msrFiles, cpu);
+	if (fd < 0)
+		return REG_CPU_UNAVAILABLE;
+
+	return ReadAt(fd, &value, sizeof(value), index);
+}
+
+RegisterStatus LinuxBackend::Wrmsr(int cpu, DWORD index, QWORD value)
+{
+	const int fd = GetCpuFile(_msrFiles, cpu);
+	if (fd < 0)
+		return REG_CPU_UNAVAILABLE;
+
+	return WriteAt(fd, &value, sizeof(value), index);
+}
+
+
+RegisterStatus LinuxBackend::ReadPciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD& value)
+{
+	const int fd = GetPciConfigFile(device, function);
+	if (fd < 0)
+		return REG_NOT_PRESENT;
+
+	return ReadAt(fd, &value, sizeof(value), regAddress);
+}
+
+RegisterStatus LinuxBackend::WritePciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD value)
+{
+	const int fd = GetPciConfigFile(device, function);
+	if (fd < 0)
+		return REG_NOT_PRESENT;
+
+	return WriteAt(fd, &value, sizeof(value), regAddress);
+}
+
+
+RegisterStatus LinuxBackend::Cpuid(int cpu, DWORD index, CpuidRegs& regs)
+{
+	// the instruction itself is cheaper than the driver if we are already on the right CPU
+	if (cpu == CURRENT_CPU)
+	{
+		unsigned int eax, ebx, ecx, edx;
+		__cpuid(index, eax, ebx, ecx, edx);
+
+		regs.eax = eax;
+		regs.ebx = ebx;
+		regs.ecx = ecx;
+		regs.edx = edx;
+		return REG_OK;
+	}
+
+	const int fd = GetCpuFile(_cpuidFiles, cpu);
+	if (fd < 0)
+		return REG_CPU_UNAVAILABLE;
+
+	// the cpuid driver returns eax, ebx, ecx and edx for the leaf specified by the file offset
+	DWORD buffer[4];
+	const RegisterStatus status = ReadAt(fd, buffer, sizeof(buffer), index);
+	if (status != REG_OK)
+		return status;
+
+	regs.eax = buffer[0];
+	regs.ebx = buffer[1];
+	regs.ecx = buffer[2];
+	regs.edx = buffer[3];
+	return REG_OK;
+}
+
+
+// the whole batch goes through the already opened config file of D0F0
+RegisterStatus LinuxBackend::ReadSmuIndirect(const DWORD* offsets, DWORD* values, int count)
+{
+	const int fd = GetPciConfigFile(0, 0);
+	if (fd < 0)
+		return REG_NOT_PRESENT;
+
+	lock_guard<mutex> lock(SmuIndexDataMutex);
+
+	for (int i = 0; i < count; i++)
+	{
+		RegisterStatus status = WriteAt(fd, &offsets[i], sizeof(DWORD), 0xB8);
+		if (status == REG_OK)
+			status = ReadAt(fd, &values[i], sizeof(DWORD), 0xBC);
+
+		if (status != REG_OK)
+			return status;
+	}
+
+	return REG_OK;
+}
+
+
+
+// ECAM: bus << 20 | device << 15 | function << 12 | register
+static const DWORD ECAM_FIRST_DEVICE = AMD_CPU_DEVICE;
+static const DWORD ECAM_NUM_DEVICES = 8;
+static const size_t ECAM_WINDOW_SIZE = ECAM_NUM_DEVICES << 15;
+
+// Locates the ECAM window of PCI segment 0, e.g., "e0000000-efffffff : PCI MMCONFIG 0000 [bus 00-ff]".
+// Without root privileges, /proc/iomem reports all addresses as 0.
+static QWORD FindEcamBase()
+{
+	FILE* file = fopen("/proc/iomem", "r");
+	if (file == NULL)
+		return 0;
+
+	QWORD base = 0;
+
+	// e.g., "  e0000000-efffffff : PCI MMCONFIG 0000 [bus 00-ff]"; the window starts at its first bus,
+	// so it has to begin with bus 0 for the northbridge devices to be at the assumed offsets
+	char line[256];
+	while (base == 0 && fgets(line, sizeof(line), file) != NULL)
+	{
+		const char* window = strstr(line, "PCI MMCONFIG 0000");
+		const char* buses = (window == NULL ? NULL : strstr(window, "[bus "));
+		if (buses == NULL)
+			continue;
+
+		unsigned long long start;
+		unsigned int firstBus, lastBus;
+		if (sscanf(line, " %llx-", &start) == 1 && sscanf(buses, "[bus %x-%x]", &firstBus, &lastBus) == 2 &&
+		    firstBus == 0 && lastBus >= firstBus)
+			base = start;
+	}
+
+	fclose(file);
+	return base;
+}
+
+
+LinuxEcamBackend::~LinuxEcamBackend()
+{
+	if (_window != NULL)
+		munmap((void*)_window, ECAM_WINDOW_SIZE);
+}
+
+bool LinuxEcamBackend::Initialize()
+{
+	if (!LinuxBackend::Initialize())
+		return false;
+
+	const QWORD base = FindEcamBase();
+	if (base == 0)
+		return true;
+
+	const int fd = open("/dev/mem", O_RDONLY | O_SYNC | O_CLOEXEC);
+	if (fd < 0)
+		return true;
+
+	void* window = mmap(NULL, ECAM_WINDOW_SIZE, PROT_READ, MAP_SHARED, fd, (off_t)(base + (ECAM_FIRST_DEVICE << 15)));
+	close(fd); // the mapping stays valid
+
+	if (window == MAP_FAILED)
+		return true;
+
+	_window = (const volatile DWORD*)window;
+
+	// make sure the window really maps D18F0 by comparing the vendor/device ID with sysfs
+	DWORD expected, mapped;
+	if (LinuxBackend::ReadPciConfig(AMD_CPU_DEVICE, 0, 0x00, expected) != REG_OK ||
+	    ReadPciConfig(AMD_CPU_DEVICE, 0, 0x00, mapped) != REG_OK || mapped != expected)
+	{
+		munmap(window, ECAM_WINDOW_SIZE);
+		_window = NULL;
+	}
+
+	return true;
+}
+
+const volatile DWORD* LinuxEcamBackend::GetRegister(DWORD device, DWORD function, DWORD regAddress) const
+{
+	if (_window == NULL || device < ECAM_FIRST_DEVICE || device >= ECAM_FIRST_DEVICE + ECAM_NUM_DEVICES ||
+	    function >= 8 || regAddress >= 0x1000 || (regAddress & 3) != 0)
+		return NULL;
+
+	const DWORD offset = ((device - ECAM_FIRST_DEVICE) << 15) | (function << 12) | regAddress;
+	return _window + offset / sizeof(DWORD);
+}
+
+RegisterStatus LinuxEcamBackend::ReadPciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD& value)
+{
+	const volatile DWORD* reg = GetRegister(device, function, regAddress);
+	if (reg == NULL)
+		return LinuxBackend::ReadPciConfig(device, function, regAddress, value);
+
+	value = *reg;
+	return REG_OK;
+}
+
+#endif
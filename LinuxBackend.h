@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "RegisterAccess.h"
+
+
+/// <summary>
+/// Linux backend based on the msr and cpuid drivers (/dev/cpu/N/msr, /dev/cpu/N/cpuid) and on the
+/// PCI configuration space exported by sysfs (/sys/bus/pci/devices/0000:00:DD.F/config).
+/// All files are opened once and kept open for the lifetime of the backend; the registers are accessed
+/// via pread/pwrite at the register offset, so no thread ever needs to be moved to a specific CPU.
+/// </summary>
+class LinuxBackend : public RegisterBackend
+{
+public:
+
+	LinuxBackend();
+	~LinuxBackend();
+
+	const char* GetName() const { return "Linux msr/sysfs"; }
+
+	bool Initialize();
+
+	bool IsCpuAddressable() const { return true; }
+
+	RegisterStatus Rdmsr(int cpu, DWORD index, QWORD& value);
+	RegisterStatus Wrmsr(int cpu, DWORD index, QWORD value);
+
+	RegisterStatus ReadPciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD& value);
+	RegisterStatus WritePciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD value);
+
+	RegisterStatus Cpuid(int cpu, DWORD index, CpuidRegs& regs);
+
+	RegisterStatus ReadSmuIndirect(const DWORD* offsets, DWORD* values, int count);
+
+
+protected:
+
+	/// <summary>Returns the file descriptor of a bus 0 PCI function's config file, or -1.</summary>
+	int GetPciConfigFile(DWORD device, DWORD function);
+
+
+private:
+
+	static const int NUM_PCI_FILES = 32 * 8; // bus 0: 32 devices with 8 functions each
+
+	int GetCpuFile(const std::vector<int>& files, int cpu) const;
+
+	std::vector<int> _msrFiles;   // indexed by logical CPU, -1 if not available
+	std::vector<int> _cpuidFiles; // indexed by logical CPU, -1 if not available
+
+	// opened on first use; -2 = not opened yet, -1 = not available
+	std::atomic<int> _pciConfigFiles[NUM_PCI_FILES];
+	std::mutex _pciOpenMutex;
+};
+
+
+/// <summary>
+/// Linux backend mapping the extended configuration space of the northbridge devices (D18h-D1Fh, i.e.,
+/// up to 8 nodes) read-only via the PCI MMCONFIG/ECAM window, so that reading a D18Fx register is a plain
+/// memory access instead of a syscall. Writes always go through sysfs (pwrite), which serializes them with
+/// the other config space accessors of the kernel (e.g., k10temp, fam15h_power). If the window cannot be
+/// located or mapped (e.g., /dev/mem restricted by CONFIG_STRICT_DEVMEM), reads fall back to pread as well.
+/// </summary>
+class LinuxEcamBackend : public LinuxBackend
+{
+public:
+
+	LinuxEcamBackend()
+		: _window(NULL)
+	{ }
+
+	~LinuxEcamBackend();
+
+	const char* GetName() const { return (_window != NULL ? "Linux msr/ECAM" : LinuxBackend::GetName()); }
+
+	bool Initialize();
+
+	/// <summary>True if the ECAM window is mapped (false if falling back to sysfs).</summary>
+	bool IsMapped() const { return _window != NULL; }
+
+	RegisterStatus ReadPciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD& value);
+
+
+private:
+
+	const volatile DWORD* GetRegister(DWORD device, DWORD function, DWORD regAddress) const;
+
+	const volatile DWORD* _window; // bus 0, devices 18h-1Fh
+};
@@ -0,0 +1,361 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include "PStateCodec.h"
+#include "Info.h"
+#include "Registers.h"
+
+using std::min;
+using std::max;
+
+// divisors for families 0x10 and 0x15
+static const double DIVISORS_10_15[] = { 1.0, 2.0, 4.0, 8.0, 16.0, 0.0 };
+// special divisors for family 0x12
+static const double DIVISORS_12[] = { 1.0, 1.5, 2.0, 3.0, 4.0, 6.0, 8.0, 12.0, 16.0, 0.0 };
+
+
+// multi = (fid + 16) / divisors[did]
+static double DecodeFidDid(int fid, int did, const double* divisors)
+{
+	return (fid + 16) / divisors[did];
+}
+
+static bool IsValidFidDid(int fid, int did, const double* divisors, int maxFid)
+{
+	int numDivisors = 0;
+	for (; divisors[numDivisors] > 0; numDivisors++) { }
+
+	return (fid <= maxFid && did < numDivisors);
+}
+
+
+// Layout traits: register fields, VID step and multiplier coding of a platform.
+
+// family 0x10 (K10, AM2+/AM3 with 200 MHz REFCLK)
+struct K10Layout
+{
+	static const char* Name() { return "K10"; }
+	static double VIDStep() { return 0.0125; }
+	static double MultiScaleFactor() { return 2.0; }
+
+	typedef MSRC001_0064::CpuFid Fid;
+	typedef MSRC001_0064::CpuDid Did;
+	typedef MSRC001_0064::CpuVid Vid;
+	typedef MSRC001_0071::CurCpuVid CurVid;
+	typedef MSRC001_0064::NbPstate NbPstate; // NbDid
+	typedef MSRC001_0064::NbVid NbVid;
+	typedef D18F5x160::NbVidLow NbPstateVid;
+
+	static const bool HasNbPstate = true;
+	static const bool HasNbVid = true;
+
+	static double DecodeMulti(int fid, int did, double) { return DecodeFidDid(fid, did, DIVISORS_10_15); }
+	static bool IsValidMulti(int fid, int did, double) { return IsValidFidDid(fid, did, DIVISORS_10_15, 47); } // 6 bits, but max 0x2f = 47
+};
+
+// family 0x15 models 0x00-0x0F (Bulldozer/Piledriver, 200 MHz REFCLK)
+struct BulldozerLayout : K10Layout
+{
+	static const char* Name() { return "Bulldozer/Piledriver"; }
+
+	static const bool HasNbVid = false;
+};
+
+// family 0x15 models without a dedicated layout (100 MHz REFCLK, SVI1 VIDs), including Carrizo/Stoney Ridge
+struct Family15hLayout : BulldozerLayout
+{
+	static const char* Name() { return "Family 15h"; }
+	static double MultiScaleFactor() { return 1.0; }
+};
+
+// family 0x15 models 0x10-0x1F and 0x30-0x3F (Trinity/Richland, Kaveri): 8-bit SVI2 VIDs
+struct Svi2Layout : Family15hLayout
+{
+	static const char* Name() { return "Trinity/Kaveri (SVI2)"; }
+	static double VIDStep() { return 0.00625; }
+
+	typedef MSRC001_0064::CpuVidSvi2 Vid;
+	typedef MSRC001_0071::CurCpuVidSvi2 CurVid;
+	typedef D18F5x160::NbVid NbPstateVid; // NbVid[7] stored separately
+};
+
+// family 0x12 (Llano)
+struct LlanoLayout : Family15hLayout
+{
+	static const char* Name() { return "Llano"; }
+
+	typedef MSRC001_0064_F12::CpuFid Fid;
+	typedef MSRC001_0064_F12::CpuDid Did;
+
+	static const bool HasNbPstate = false;
+
+	static double DecodeMulti(int fid, int did, double) { return DecodeFidDid(fid, did, DIVISORS_12); }
+	static bool IsValidMulti(int fid, int did, double) { return IsValidFidDid(fid, did, DIVISORS_12, 31); } // 5 bits => max 2^5-1 = 31
+};
+
+// family 0x14 (Bobcat): the multi is expressed as divisor of the max multi
+struct BobcatLayout : LlanoLayout
+{
+	static const char* Name() { return "Bobcat"; }
+
+	typedef MSRC001_0064_F14::CpuDidMSD Fid; // integral part of divisor - 1
+	typedef MSRC001_0064_F14::CpuDidLSD Did; // fractional part of divisor, in quarters
+
+	static double DecodeMulti(int fid, int did, double maxMulti)
+	{
+		double divisor = fid + 1;
+
+		if (divisor >= 16)
+			did &= ~1; // ignore least significant bit of LSD
+		divisor += did * 0.25;
+
+		return maxMulti / divisor;
+	}
+
+	// divisors 1.0 .. 26.5 in quarters (in halves from 16.0 on); nothing can be encoded without the max multiplier
+	static bool IsValidMulti(int fid, int did, double maxMulti)
+	{
+		return (maxMulti != 0 && did < 4 && (fid + 1) * 4 + did <= 106);
+	}
+};
+
+
+template <typename Layout> class PStateCodecImpl : public PStateCodec
+{
+public:
+
+	explicit PStateCodecImpl(double maxMulti)
+		: _maxMulti(maxMulti)
+	{
+		for (int fid = 0; fid <= (int)Layout::Fid::Max(); fid++)
+		{
+			for (int did = 0; did <= (int)Layout::Did::Max(); did++)
+			{
+				if (Layout::IsValidMulti(fid, did, maxMulti))
+					_multis.Add(Layout::DecodeMulti(fid, did, maxMulti), fid, did);
+			}
+		}
+
+		_multis.Seal();
+	}
+
+	const char* GetName() const { return Layout::Name(); }
+
+	double GetVIDStep() const { return Layout::VIDStep(); }
+	double GetMultiScaleFactor() const { return Layout::MultiScaleFactor(); }
+
+	void DecodePState(QWORD msr, PStateInfo& result) const { Decode(msr, result); }
+
+	void DecodePStates(const QWORD* msrs, PStateInfo* results, int count) const
+	{
+		for (int i = 0; i < count; i++)
+			Decode(msrs[i], results[i]);
+	}
+
+	void EncodePState(const PStateInfo& info, QWORD& mask, QWORD& value) const
+	{
+		typedef FieldSet<typename Layout::Fid, typename Layout::Did> Cof;
+
+		mask = value = 0;
+
+		if (info.Multi >= 0)
+		{
+			int fid, did;
+			EncodeMulti(info.Multi, fid, did);
+
+			mask |= Cof::Mask();
+			value |= Cof::Make(fid, did);
+		}
+
+		if (info.VID >= 0)
+		{
+			mask |= Layout::Vid::Mask();
+			value |= Layout::Vid::Make(info.VID);
+		}
+
+		if (Layout::HasNbPstate && info.NBPState >= 0)
+		{
+			mask |= Layout::NbPstate::Mask();
+			value |= Layout::NbPstate::Make(max(0, min(1, info.NBPState)));
+		}
+
+		if (Layout::HasNbVid && info.NBVID >= 0)
+		{
+			mask |= Layout::NbVid::Mask();
+			value |= Layout::NbVid::Make(info.NBVID);
+		}
+	}
+
+	void DecodeCofVid(QWORD msr, CofVidStatus& result) const
+	{
+		// CurCpuFid/CurCpuDid share the layout of the P-state definitions
+		result.PState = MSRC001_0071::CurPstate::Get(msr);
+		result.Fid = Layout::Fid::Get(msr);
+		result.Did = Layout::Did::Get(msr);
+		result.VID = Layout::CurVid::Get(msr);
+		result.Multi = Layout::DecodeMulti(result.Fid, result.Did, _maxMulti);
+	}
+
+	int DecodeNbVid(DWORD reg) const { return Layout::NbPstateVid::Get(reg); }
+
+	void EncodeNbVid(int vid, DWORD& mask, DWORD& value) const
+	{
+		mask = Layout::NbPstateVid::Mask();
+		value = Layout::NbPstateVid::Make(vid);
+	}
+
+	double DecodeMulti(int fid, int did) const { return Layout::DecodeMulti(fid, did, _maxMulti); }
+
+	void EncodeMulti(double multi, int& fid, int& did) const
+	{
+		if (_multis.IsEmpty())
+			throw std::runtime_error("cannot encode multiplier - unknown max multiplier");
+
+		const MultiTable::Entry& entry = _multis.Find(multi);
+		fid = entry.Fid;
+		did = entry.Did;
+	}
+
+	const MultiTable& GetMultiTable() const { return _multis; }
+
+	bool IsValidMulti(int fid, int did) const { return Layout::IsValidMulti(fid, did, _maxMulti); }
+
+	int GetMaxFid() const { return Layout::Fid::Max(); }
+	int GetMaxDid() const { return Layout::Did::Max(); }
+	int GetMaxVID() const { return Layout::Vid::Max(); }
+
+
+private:
+
+	void Decode(QWORD msr, PStateInfo& result) const
+	{
+		result.Multi = Layout::DecodeMulti(Layout::Fid::Get(msr), Layout::Did::Get(msr), _maxMulti);
+		result.VID = Layout::Vid::Get(msr);
+		result.NBPState = (Layout::HasNbPstate ? (int)Layout::NbPstate::Get(msr) : -1);
+		result.NBVID = (Layout::HasNbVid ? (int)Layout::NbVid::Get(msr) : -1);
+	}
+
+	double _maxMulti;
+	MultiTable _multis;
+};
+
+
+PStateCodec* PStateCodec::Create(int family, int model, double maxMulti)
+{
+	switch (family)
+	{
+		case 0x10: return new PStateCodecImpl<K10Layout>(maxMulti);
+		case 0x12: return new PStateCodecImpl<LlanoLayout>(maxMulti);
+		case 0x14: return new PStateCodecImpl<BobcatLayout>(maxMulti);
+
+		case 0x15:
+			if (model < 0x10)
+				return new PStateCodecImpl<BulldozerLayout>(maxMulti);
+			if ((model >= 0x10 && model < 0x20) || (model >= 0x30 && model < 0x40))
+				return new PStateCodecImpl<Svi2Layout>(maxMulti);
+			return new PStateCodecImpl<Family15hLayout>(maxMulti);
+	}
+
+	return NULL;
+}
+
+
+
+double PStateCodec::DecodeVID(int vid) const
+{
+	return 1.55 - vid * GetVIDStep();
+}
+
+int PStateCodec::EncodeVID(double volts) const
+{
+	const double step = GetVIDStep();
+
+	volts = max(0.0, min(1.55, volts));
+
+	// round to nearest step
+	int r = (int)(volts / step + 0.5);
+
+	//1.55 / step = highest VID (0 V)
+	return (int)(1.55 / step) - r;
+}
+
+
+// NB multi = (NbFid + 4) / 2^NbDid
+double PStateCodec::DecodeNbMulti(int fid, int did)
+{
+	return (fid + 4) / (double)(1 << did);
+}
+
+void PStateCodec::EncodeNbMulti(double multi, int& fid, int& did)
+{
+	const MultiTable::Entry& entry = GetNbMultiTable().Find(multi);
+	fid = entry.Fid;
+	did = entry.Did;
+}
+
+bool PStateCodec::IsValidNbMulti(int fid, int did)
+{
+	return (fid <= 31 && did <= 1); // 6 bits, but max 31
+}
+
+static MultiTable CreateNbMultiTable()
+{
+	MultiTable table;
+
+	for (int fid = 0; fid <= (int)D18F5x160::NbFid::Max(); fid++)
+	{
+		for (int did = 0; did <= (int)D18F5x160::NbDid::Max(); did++)
+		{
+			if (PStateCodec::IsValidNbMulti(fid, did))
+				table.Add(PStateCodec::DecodeNbMulti(fid, did), fid, did);
+		}
+	}
+
+	table.Seal();
+	return table;
+}
+
+const MultiTable& PStateCodec::GetNbMultiTable()
+{
+	static const MultiTable table = CreateNbMultiTable();
+	return table;
+}
+
+
+
+void MultiTable::Add(double multi, int fid, int did)
+{
+	const Entry entry = { multi, fid, did };
+	_entries.push_back(entry);
+}
+
+void MultiTable::Seal()
+{
+	// by multiplier, aliases by ascending divisor
+	std::stable_sort(_entries.begin(), _entries.end(), [](const Entry& a, const Entry& b)
+	{
+		return (a.Multi < b.Multi || (a.Multi == b.Multi && a.Did < b.Did));
+	});
+
+	_entries.erase(std::unique(_entries.begin(), _entries.end(), [](const Entry& a, const Entry& b)
+	{
+		return a.Multi == b.Multi;
+	}), _entries.end());
+}
+
+const MultiTable::Entry& MultiTable::Find(double multi) const
+{
+	// tolerate rounding errors of the requested multi, e.g., 2.3 GHz / 100 MHz
+	const double limit = multi * (1.0 + 1e-9);
+
+	std::vector<Entry>::const_iterator it = std::upper_bound(_entries.begin(), _entries.end(), limit,
+		[](double value, const Entry& entry) { return value < entry.Multi; });
+
+	return (it == _entries.begin() ? *it : *(it - 1));
+}
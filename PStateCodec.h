@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#pragma once
+
+#include <vector>
+#include "Platform.h"
+
+struct PStateInfo;
+struct CofVidStatus;
+
+
+/// <summary>
+/// All valid encodings of a multiplier coding, ascendingly sorted by multiplier. Multipliers with
+/// several encodings (e.g., 16/1 and 32/2) are only listed once, with the lowest divisor.
+/// </summary>
+class MultiTable
+{
+public:
+
+	struct Entry
+	{
+		double Multi; // exactly as returned by the decoder
+		int Fid;
+		int Did;
+	};
+
+	/// <summary>Adds an encoding; the table needs to be sorted by Seal() before it can be searched.</summary>
+	void Add(double multi, int fid, int did);
+
+	void Seal();
+
+	bool IsEmpty() const { return _entries.empty(); }
+
+	/// <summary>
+	/// Returns the entry with the largest multiplier not exceeding the specified one
+	/// (the smallest entry for lower multipliers); the table must not be empty.
+	/// </summary>
+	const Entry& Find(double multi) const;
+
+	const std::vector<Entry>& GetEntries() const { return _entries; }
+
+
+private:
+
+	std::vector<Entry> _entries;
+};
+
+
+/// <summary>
+/// Platform-specific encoding of the core P-state registers (MSRC001_00[6B:64] P-state [7:0],
+/// MSRC001_0071 COFVID Status) and of the NB VID in D18F5x16[C:0].
+/// The codec is selected once for the detected family/model; all decoders are plain
+/// shifts and masks without any further family checks, so they can be used on raw
+/// register values without touching the hardware.
+/// </summary>
+class PStateCodec
+{
+public:
+
+	virtual ~PStateCodec() { }
+
+	/// <summary>Returns the platform name, e.g., "Trinity/Kaveri (SVI2)".</summary>
+	virtual const char* GetName() const = 0;
+
+	virtual double GetVIDStep() const = 0;          // volts per VID step
+	virtual double GetMultiScaleFactor() const = 0; // internal multi per external one (2 for 200 MHz REFCLK platforms)
+
+	/// <summary>Decodes Multi, VID, NBPState and NBVID (-1 if not available) of a P-state definition.</summary>
+	virtual void DecodePState(QWORD msr, PStateInfo& result) const = 0;
+
+	/// <summary>Decodes a batch of P-state definitions; the results' indices are left untouched.</summary>
+	virtual void DecodePStates(const QWORD* msrs, PStateInfo* results, int count) const = 0;
+
+	/// <summary>
+	/// Encodes the fields of a P-state definition which are set (>= 0), as a mask of the affected bits
+	/// and their new values.
+	/// </summary>
+	virtual void EncodePState(const PStateInfo& info, QWORD& mask, QWORD& value) const = 0;
+
+	/// <summary>Decodes the COFVID status (CurPstate, CurCpuFid/Did/Vid).</summary>
+	virtual void DecodeCofVid(QWORD msr, CofVidStatus& result) const = 0;
+
+	/// <summary>NbVid of D18F5x16[C:0] Northbridge P-state [3:0] (family 0x15).</summary>
+	virtual int DecodeNbVid(DWORD reg) const = 0;
+	virtual void EncodeNbVid(int vid, DWORD& mask, DWORD& value) const = 0;
+
+	/// <summary>
+	/// Converts between the FID/DID pair (DID MSD/LSD for family 0x14) and the internal multiplier.
+	/// Multipliers which cannot be represented exactly are rounded down to the next valid one.
+	/// </summary>
+	virtual double DecodeMulti(int fid, int did) const = 0;
+	virtual void EncodeMulti(double multi, int& fid, int& did) const = 0;
+
+	/// <summary>Returns all valid core FID/DID encodings (empty on family 0x14 if the max multiplier is unknown).</summary>
+	virtual const MultiTable& GetMultiTable() const = 0;
+
+	/// <summary>Returns false for reserved FID/DID pairs, e.g., DIDs without divisor.</summary>
+	virtual bool IsValidMulti(int fid, int did) const = 0;
+
+	/// <summary>Largest raw values of the FID, DID and VID fields.</summary>
+	virtual int GetMaxFid() const = 0;
+	virtual int GetMaxDid() const = 0;
+	virtual int GetMaxVID() const = 0;
+
+	/// <summary>Converts between a VID and volts (1.55 V - VID * step), rounding to the nearest VID.</summary>
+	double DecodeVID(int vid) const;
+	int EncodeVID(double volts) const;
+
+	/// <summary>Converts between NbFid/NbDid of D18F5x16[C:0] and the NB multiplier (family 0x15).</summary>
+	static double DecodeNbMulti(int fid, int did);
+	static void EncodeNbMulti(double multi, int& fid, int& did);
+	static bool IsValidNbMulti(int fid, int did);
+
+	static const MultiTable& GetNbMultiTable();
+
+	/// <summary>
+	/// Returns the codec for a CPU (NULL if unsupported). The max multiplier (MaxCpuCof) is only required
+	/// by family 0x14, whose multipliers are expressed as divisors of it.
+	/// </summary>
+	static PStateCodec* Create(int family, int model, double maxMulti);
+};
+
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include "PStateSampler.h"
+#include "Info.h"
+#include "Registers.h"
+#include "SpscRing.h"
+
+using std::endl;
+using std::vector;
+using std::chrono::steady_clock;
+
+typedef SpscRing<PStateSample, 4096> SampleRing;
+
+
+static void Aggregate(CoreResidency& residency, const PStateSample& sample)
+{
+	residency.NumSamples++;
+
+	if (sample.PState < 0)
+	{
+		residency.NumFailed++;
+		return;
+	}
+
+	residency.PStates[sample.PState & 7]++;
+	residency.VIDs[sample.VID & 0xFF]++;
+	if (sample.NbPState >= 0)
+		residency.NbPStates[sample.NbPState & 3]++;
+}
+
+static void Drain(SampleRing& ring, int cpu, const PStateSampler::Consumer& consumer)
+{
+	PStateSample sample;
+	while (ring.TryPop(sample))
+		consumer(cpu, sample);
+}
+
+
+vector<CoreResidency> PStateSampler::Run(double rateHz, double seconds, const std::atomic<bool>* stopRequested) const
+{
+	const int numCPUs = GetBackend().GetNumCPUs();
+
+	vector<CoreResidency> result(numCPUs, CoreResidency());
+	for (int i = 0; i < numCPUs; i++)
+		result[i].Cpu = i;
+
+	const steady_clock::time_point start = steady_clock::now();
+
+	const vector<QWORD> numDropped = Run(rateHz, seconds, [&result](int cpu, const PStateSample& sample)
+	{
+		Aggregate(result[cpu], sample);
+	}, stopRequested);
+
+	const double elapsed = std::chrono::duration<double>(steady_clock::now() - start).count();
+
+	for (int i = 0; i < numCPUs; i++)
+	{
+		result[i].NumDropped = numDropped[i];
+		result[i].Seconds = elapsed;
+	}
+
+	return result;
+}
+
+vector<QWORD> PStateSampler::Run(double rateHz, double seconds, const Consumer& consumer, const std::atomic<bool>* stopRequested) const
+{
+	const Info& info = *_info;
+	const PStateCodec& codec = info.GetCodec();
+
+	const int numCPUs = GetBackend().GetNumCPUs();
+	const bool isCpuAddressable = GetBackend().IsCpuAddressable();
+	const bool hasNbPStates = (info.Family == 0x15);
+
+	const steady_clock::duration period = std::chrono::duration_cast<steady_clock::duration>(
+		std::chrono::duration<double>(1.0 / std::max(1.0, rateHz)));
+
+	vector<std::unique_ptr<SampleRing> > rings;
+	vector<QWORD> numDropped(numCPUs, 0); // each one written by its sampler only
+	vector<std::thread> samplers;
+	std::atomic<bool> stop(false);
+
+	for (int i = 0; i < numCPUs; i++)
+		rings.push_back(std::unique_ptr<SampleRing>(new SampleRing()));
+
+	const steady_clock::time_point start = steady_clock::now();
+
+	for (int i = 0; i < numCPUs; i++)
+	{
+		samplers.push_back(std::thread([&, i]()
+		{
+			// unpinned, CURRENT_CPU would sample whichever CPU the thread runs on
+			const bool canSample = (PinCurrentThread(i) || isCpuAddressable);
+			const int cpu = (isCpuAddressable ? i : CURRENT_CPU);
+
+			SampleRing& ring = *rings[i];
+			steady_clock::time_point next = steady_clock::now();
+
+			while (!stop.load(std::memory_order_relaxed))
+			{
+				const steady_clock::time_point now = steady_clock::now();
+
+				PStateSample sample;
+				sample.Timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count();
+				sample.NbPState = -1;
+
+				QWORD msr;
+				if (canSample && TryRdmsr(MSRC001_0071::Index, msr, cpu) == REG_OK)
+				{
+					CofVidStatus status;
+					codec.DecodeCofVid(msr, status);
+
+					sample.PState = status.PState;
+					sample.VID = status.VID;
+					sample.CofVid = (DWORD)msr;
+				}
+				else
+				{
+					sample.PState = sample.VID = -1;
+					sample.CofVid = 0;
+				}
+
+				DWORD nbStatus;
+				if (hasNbPStates && TryReadPciConfig(AMD_CPU_DEVICE, 5, D18F5x174::Address, nbStatus) == REG_OK)
+					sample.NbPState = D18F5x174::CurNbPstate::Get(nbStatus);
+
+				if (!ring.TryPush(sample))
+					numDropped[i]++;
+
+				// keep the rate, but skip the samples missed while being descheduled
+				next += period;
+				if (next < now)
+					next = now + period;
+
+				std::this_thread::sleep_until(next);
+			}
+		}));
+	}
+
+	// drain the rings while sampling
+	const steady_clock::time_point end = start + std::chrono::duration_cast<steady_clock::duration>(std::chrono::duration<double>(seconds));
+	while ((seconds <= 0 || steady_clock::now() < end) && (stopRequested == NULL || !stopRequested->load()))
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+		for (int i = 0; i < numCPUs; i++)
+			Drain(*rings[i], i, consumer);
+	}
+
+	stop.store(true);
+	for (int i = 0; i < numCPUs; i++)
+		samplers[i].join();
+
+	for (int i = 0; i < numCPUs; i++)
+		Drain(*rings[i], i, consumer);
+
+	return numDropped;
+}
+
+
+void PStateSampler::Print(std::ostream& os, const vector<CoreResidency>& residencies) const
+{
+	const Info& info = *_info;
+
+	const std::ios::fmtflags flags = os.flags();
+	const std::streamsize precision = os.precision();
+	os.setf(std::ios::fixed);
+	os.precision(1);
+
+	os << ".:. P-state residency" << endl << "---" << endl;
+
+	for (size_t i = 0; i < residencies.size(); i++)
+	{
+		const CoreResidency& r = residencies[i];
+		const QWORD numValid = r.NumSamples - r.NumFailed;
+
+		os << "  CPU " << r.Cpu << ": " << r.NumSamples << " samples (" << (r.Seconds > 0 ? r.NumSamples / r.Seconds : 0.0) << " Hz)";
+		if (r.NumFailed > 0)
+			os << ", " << r.NumFailed << " failed";
+		if (r.NumDropped > 0)
+			os << ", " << r.NumDropped << " dropped";
+		os << endl;
+
+		if (numValid == 0)
+			continue;
+
+		os << "   ";
+		for (int p = 0; p < info.NumPStates; p++)
+			os << " P" << p << " " << (100.0 * r.PStates[p] / numValid) << "%";
+		os << endl;
+
+		if (info.Family == 0x15)
+		{
+			os << "   ";
+			for (int p = 0; p < info.NumNBPStates; p++)
+				os << " NB_P" << p << " " << (100.0 * r.NbPStates[p] / numValid) << "%";
+			os << endl;
+		}
+
+		// average voltage and the range of VIDs seen
+		double sum = 0.0;
+		int minVID = 255, maxVID = 0;
+		for (int v = 0; v < 256; v++)
+		{
+			if (r.VIDs[v] == 0)
+				continue;
+
+			sum += r.VIDs[v] * info.DecodeVID(v);
+			minVID = std::min(minVID, v);
+			maxVID = std::max(maxVID, v);
+		}
+
+		os.precision(4);
+		os << "    " << (sum / numValid) << "V on average (" << info.DecodeVID(maxVID) << " .. " << info.DecodeVID(minVID) << "V)" << endl;
+		os.precision(1);
+	}
+
+	os.precision(precision);
+	os.flags(flags);
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <ostream>
+#include <vector>
+#include "Platform.h"
+
+class Info;
+
+
+struct PStateSample
+{
+	QWORD Timestamp; // nanoseconds since the start of the sampling
+	int PState;      // CurPstate (hardware index), -1 if MSRC001_0071 could not be read (on this CPU)
+	int NbPState;    // CurNbPstate, -1 if not available (family 0x15 only)
+	int VID;         // CurCpuVid
+	DWORD CofVid;    // raw MSRC001_0071[31:0]
+};
+
+struct CoreResidency
+{
+	int Cpu;
+	QWORD NumSamples;    // including the failed ones
+	QWORD NumFailed;     // samples whose COFVID status could not be read
+	QWORD NumDropped;    // samples lost to a full ring buffer
+	QWORD PStates[8];    // samples per CurPstate
+	QWORD NbPStates[4];  // samples per CurNbPstate
+	QWORD VIDs[256];     // samples per CurCpuVid
+	double Seconds;      // sampling period
+};
+
+
+/// <summary>
+/// Polls CurPstate, CurCpuVid (MSRC001_0071 COFVID Status) and CurNbPstate (D18F5x174) on all logical CPUs
+/// at a fixed rate. Each CPU is sampled by a thread pinned to it, which hands its samples to the aggregating
+/// thread through a lock-free single-producer/single-consumer ring. The samplers sleep between two samples,
+/// so that they disturb the power management as little as possible; the achievable rate is bounded by the
+/// timer resolution of the OS (some kHz on Linux, ~1 kHz on Windows).
+/// </summary>
+class PStateSampler
+{
+public:
+
+	/// <summary>Receives the samples of a CPU in chronological order (called on the aggregating thread).</summary>
+	typedef std::function<void(int cpu, const PStateSample& sample)> Consumer;
+
+	explicit PStateSampler(const Info& info)
+		: _info(&info)
+	{ }
+
+	/// <summary>
+	/// Samples all logical CPUs at the given rate for the given period (if positive) or until the stop flag
+	/// is set and returns their histograms.
+	/// </summary>
+	std::vector<CoreResidency> Run(double rateHz, double seconds, const std::atomic<bool>* stop = NULL) const;
+
+	/// <summary>
+	/// Samples all logical CPUs and streams the samples to the consumer until the period has elapsed
+	/// (if positive) or the stop flag is set. Returns the number of dropped samples per CPU.
+	/// </summary>
+	std::vector<QWORD> Run(double rateHz, double seconds, const Consumer& consumer, const std::atomic<bool>* stop = NULL) const;
+
+	/// <summary>Prints the residencies in percent of the successful samples of each CPU.</summary>
+	void Print(std::ostream& os, const std::vector<CoreResidency>& residencies) const;
+
+
+private:
+
+	const Info* _info;
+};
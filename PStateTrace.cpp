@@ -0,0 +1,420 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include "PStateTrace.h"
+#include "Info.h"
+#include "PStateSampler.h"
+#include "Registers.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using std::vector;
+
+
+static void PutVarint(vector<unsigned char>& buffer, QWORD value)
+{
+	while (value >= 0x80)
+	{
+		buffer.push_back((unsigned char)(value | 0x80));
+		value >>= 7;
+	}
+	buffer.push_back((unsigned char)value);
+}
+
+// returns false on a truncated or overlong varint
+static bool GetVarint(const unsigned char*& p, const unsigned char* end, QWORD& value)
+{
+	value = 0;
+	for (int shift = 0; shift < 64; shift += 7)
+	{
+		if (p == end)
+			return false;
+
+		const unsigned char byte = *p++;
+		value |= (QWORD)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+// maps signed deltas to small unsigned ones: 0, -1, 1, -2, ... => 0, 1, 2, 3, ...
+static QWORD ZigZag(long long value) { return ((QWORD)value << 1) ^ (QWORD)(value >> 63); }
+static long long UnZigZag(QWORD value) { return (long long)(value >> 1) ^ -(long long)(value & 1); }
+
+
+
+bool PStateTraceWriter::Open(const char* path, const PStateTraceHeader& header)
+{
+	_file.open(path, std::ios::binary | std::ios::trunc);
+	if (!_file)
+		return false;
+
+	_file.write((const char*)&header, sizeof(header));
+
+	_offset = sizeof(header);
+	_payload.clear();
+	_payload.reserve(PSTATE_TRACE_BLOCK_SIZE + 32);
+	_numEvents = 0;
+	_maxTimestamp = 0;
+	_index.clear();
+	_totalEvents = 0;
+
+	return _file.good();
+}
+
+void PStateTraceWriter::Append(QWORD timestamp, int cpu, PStateTraceEventKind kind, DWORD value)
+{
+	if (_numEvents > 0 && timestamp > _firstTimestamp && timestamp - _firstTimestamp > PSTATE_TRACE_BLOCK_PERIOD)
+		FlushBlock();
+
+	if (_numEvents == 0)
+		_firstTimestamp = _lastTimestamp = timestamp;
+
+	PutVarint(_payload, ZigZag((long long)(timestamp - _lastTimestamp)));
+	PutVarint(_payload, (QWORD)cpu << 2 | kind);
+	PutVarint(_payload, value);
+
+	_lastTimestamp = timestamp;
+	_maxTimestamp = std::max(_maxTimestamp, timestamp);
+	_numEvents++;
+	_totalEvents++;
+
+	if (_payload.size() >= PSTATE_TRACE_BLOCK_SIZE)
+		FlushBlock();
+}
+
+void PStateTraceWriter::FlushBlock()
+{
+	if (_numEvents == 0)
+		return;
+
+	PStateTraceBlockHeader block;
+	block.Magic = PSTATE_TRACE_BLOCK_MAGIC;
+	block.NumEvents = _numEvents;
+	block.PayloadSize = (DWORD)_payload.size();
+	block.Reserved = 0;
+	block.FirstTimestamp = _firstTimestamp;
+	block.MaxTimestamp = _maxTimestamp;
+
+	PStateTraceIndexEntry entry;
+	entry.Offset = _offset;
+	entry.FirstTimestamp = _firstTimestamp;
+	entry.MaxTimestamp = _maxTimestamp;
+	_index.push_back(entry);
+
+	_file.write((const char*)&block, sizeof(block));
+	_file.write((const char*)&_payload[0], _payload.size());
+	_file.flush(); // complete blocks survive a crash of a long-running recorder
+
+	_offset += sizeof(block) + _payload.size();
+	_payload.clear();
+	_numEvents = 0;
+}
+
+bool PStateTraceWriter::Close()
+{
+	if (!_file.is_open())
+		return false;
+
+	FlushBlock();
+
+	PStateTraceFooter footer;
+	footer.IndexOffset = _offset;
+	footer.NumBlocks = (DWORD)_index.size();
+	footer.Magic = PSTATE_TRACE_INDEX_MAGIC;
+
+	if (!_index.empty())
+		_file.write((const char*)&_index[0], _index.size() * sizeof(PStateTraceIndexEntry));
+	_file.write((const char*)&footer, sizeof(footer));
+
+	_offset += _index.size() * sizeof(PStateTraceIndexEntry) + sizeof(footer);
+
+	const bool result = _file.good();
+	_file.close();
+	return result;
+}
+
+
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const char* path)
+{
+	Close();
+
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	HANDLE mapping = NULL;
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file); // the mapping keeps the file open
+
+	if (mapping == NULL)
+		return false;
+
+	_address = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (_address == NULL)
+	{
+		CloseHandle(mapping);
+		return false;
+	}
+
+	_handle = mapping;
+	_size = (size_t)size.QuadPart;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (_address != NULL)
+		UnmapViewOfFile(_address);
+	if (_handle != NULL)
+		CloseHandle((HANDLE)_handle);
+
+	_address = NULL;
+	_handle = NULL;
+	_size = 0;
+}
+
+#else
+
+bool MappedFile::Open(const char* path)
+{
+	Close();
+
+	const int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	void* address = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+		address = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (address == MAP_FAILED)
+		return false;
+
+	_address = address;
+	_size = (size_t)st.st_size;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (_address != NULL)
+		munmap(_address, _size);
+
+	_address = NULL;
+	_size = 0;
+}
+
+#endif
+
+
+
+bool PStateTraceReader::Open(const char* path)
+{
+	_header = NULL;
+	_index.clear();
+
+	if (!_file.Open(path) || _file.GetSize() < sizeof(PStateTraceHeader))
+		return false;
+
+	const unsigned char* base = _file.GetAddress();
+	const size_t size = _file.GetSize();
+
+	const PStateTraceHeader* header = (const PStateTraceHeader*)base;
+	if (memcmp(header->Magic, PSTATE_TRACE_MAGIC, sizeof(PSTATE_TRACE_MAGIC)) != 0 || header->Version != PSTATE_TRACE_VERSION)
+		return false;
+
+	_header = header;
+
+	// use the index of a finished trace
+	if (size >= sizeof(PStateTraceHeader) + sizeof(PStateTraceFooter))
+	{
+		const PStateTraceFooter* footer = (const PStateTraceFooter*)(base + size - sizeof(PStateTraceFooter));
+		const QWORD indexSize = (QWORD)footer->NumBlocks * sizeof(PStateTraceIndexEntry);
+
+		if (footer->Magic == PSTATE_TRACE_INDEX_MAGIC && footer->IndexOffset >= sizeof(PStateTraceHeader) &&
+		    footer->IndexOffset + indexSize + sizeof(PStateTraceFooter) == size)
+		{
+			const PStateTraceIndexEntry* entries = (const PStateTraceIndexEntry*)(base + footer->IndexOffset);
+			_index.assign(entries, entries + footer->NumBlocks);
+			return true;
+		}
+	}
+
+	// otherwise walk the block headers up to the first incomplete one
+	QWORD offset = sizeof(PStateTraceHeader);
+	while (offset + sizeof(PStateTraceBlockHeader) <= size)
+	{
+		const PStateTraceBlockHeader* block = (const PStateTraceBlockHeader*)(base + offset);
+		if (block->Magic != PSTATE_TRACE_BLOCK_MAGIC || offset + sizeof(PStateTraceBlockHeader) + block->PayloadSize > size)
+			break;
+
+		PStateTraceIndexEntry entry;
+		entry.Offset = offset;
+		entry.FirstTimestamp = block->FirstTimestamp;
+		entry.MaxTimestamp = block->MaxTimestamp;
+		_index.push_back(entry);
+
+		offset += sizeof(PStateTraceBlockHeader) + block->PayloadSize;
+	}
+
+	return true;
+}
+
+size_t PStateTraceReader::FindBlock(QWORD timestamp) const
+{
+	// the max. timestamps are cumulative and hence ascending
+	size_t lo = 0, hi = _index.size();
+	while (lo < hi)
+	{
+		const size_t mid = lo + (hi - lo) / 2;
+		if (_index[mid].MaxTimestamp < timestamp)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+bool PStateTraceReader::ReadBlock(size_t blockIndex, vector<PStateTraceEvent>& events) const
+{
+	events.clear();
+
+	const QWORD offset = _index[blockIndex].Offset;
+	if (offset + sizeof(PStateTraceBlockHeader) > _file.GetSize())
+		return false;
+
+	const PStateTraceBlockHeader* block = (const PStateTraceBlockHeader*)(_file.GetAddress() + offset);
+	if (block->Magic != PSTATE_TRACE_BLOCK_MAGIC || offset + sizeof(PStateTraceBlockHeader) + block->PayloadSize > _file.GetSize())
+		return false;
+
+	const unsigned char* p = (const unsigned char*)(block + 1);
+	const unsigned char* end = p + block->PayloadSize;
+
+	// each event takes at least one byte per varint, so a corrupt count cannot exhaust the memory
+	if (block->NumEvents > block->PayloadSize / 3)
+		return false;
+
+	events.reserve(block->NumEvents);
+
+	QWORD timestamp = block->FirstTimestamp;
+	for (DWORD i = 0; i < block->NumEvents; i++)
+	{
+		QWORD delta, id, value;
+		if (!GetVarint(p, end, delta) || !GetVarint(p, end, id) || !GetVarint(p, end, value))
+			return false;
+
+		timestamp += UnZigZag(delta);
+
+		PStateTraceEvent e;
+		e.Timestamp = timestamp;
+		e.Cpu = (int)(id >> 2);
+		e.Kind = (PStateTraceEventKind)(id & 3);
+		e.Value = (DWORD)value;
+		events.push_back(e);
+	}
+
+	return (p == end);
+}
+
+
+
+static void GetHostName(char* buffer, size_t size)
+{
+#ifdef _WIN32
+	DWORD length = (DWORD)size;
+	if (!GetComputerNameA(buffer, &length))
+		buffer[0] = 0;
+#else
+	if (gethostname(buffer, size) != 0)
+		buffer[0] = 0;
+#endif
+	buffer[size - 1] = 0;
+}
+
+bool PStateTraceRecorder::Run(const char* path, double rateHz, double seconds, const std::atomic<bool>& stop, PStateTraceStats& stats) const
+{
+	const Info& info = *_info;
+
+	const int numCPUs = GetBackend().GetNumCPUs();
+
+	PStateTraceHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.Magic, PSTATE_TRACE_MAGIC, sizeof(header.Magic));
+	header.Version = PSTATE_TRACE_VERSION;
+	header.Family = info.Family;
+	header.Model = info.Model;
+	header.NumCPUs = numCPUs;
+	header.NumPStates = info.NumPStates;
+	header.NumBoostStates = (info.IsBoostSupported ? info.NumBoostStates : 0);
+	header.NumNBPStates = info.NumNBPStates;
+	header.MaxMulti = info.MaxMulti;
+	for (int i = 0; i < info.NumPStates; i++)
+		header.PStates[i] = Rdmsr(MSRC001_0064::Index + i); // MSRC001_00[6B:64] P-state [7:0]
+	GetHostName(header.Host, sizeof(header.Host));
+
+	header.StartTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	PStateTraceWriter writer;
+	if (!writer.Open(path, header))
+		return false;
+
+	// last values written per core; the first sample of each core is always written
+	vector<long long> lastCofVid(numCPUs, -1);
+	long long lastNbPState = -1;
+
+	PStateSampler sampler(info);
+	const vector<QWORD> numDropped = sampler.Run(rateHz, seconds, [&](int cpu, const PStateSample& sample)
+	{
+		if (sample.PState < 0)
+			return;
+
+		if (sample.CofVid != lastCofVid[cpu])
+		{
+			writer.Append(sample.Timestamp, cpu, TRACE_COFVID, sample.CofVid);
+			lastCofVid[cpu] = sample.CofVid;
+		}
+
+		// the NB P-state is shared by all cores of the node
+		if (cpu == 0 && sample.NbPState >= 0 && sample.NbPState != lastNbPState)
+		{
+			writer.Append(sample.Timestamp, cpu, TRACE_NBPSTATE, sample.NbPState);
+			lastNbPState = sample.NbPState;
+		}
+	}, &stop);
+
+	const bool result = writer.Close();
+
+	stats.NumEvents = writer.GetNumEvents();
+	stats.NumDropped = 0;
+	for (size_t i = 0; i < numDropped.size(); i++)
+		stats.NumDropped += numDropped[i];
+	stats.Size = writer.GetSize();
+	stats.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	return result;
+}
@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <fstream>
+#include <vector>
+#include "Platform.h"
+
+class Info;
+
+
+// P-state transition trace:
+// a PStateTraceHeader, any number of blocks (a PStateTraceBlockHeader followed by its payload),
+// the block index (one PStateTraceIndexEntry per block) and a PStateTraceFooter (little endian).
+//
+// Only transitions are stored. Each event of a block payload consists of 3 varints (LEB128):
+// the zigzag-encoded timestamp delta to the previous event of the block (to the block's
+// FirstTimestamp for the first one), Cpu << 2 | Kind and the new value.
+// A trace whose writer did not finish has no index; the reader then walks the block headers.
+
+static const char PSTATE_TRACE_MAGIC[4] = { 'A', 'M', 'T', 'P' };
+static const DWORD PSTATE_TRACE_VERSION = 1;
+static const DWORD PSTATE_TRACE_BLOCK_MAGIC = 0x4B4C4250; // "PBLK"
+static const DWORD PSTATE_TRACE_INDEX_MAGIC = 0x58444950; // "PIDX"
+
+static const size_t PSTATE_TRACE_BLOCK_SIZE = 64 * 1024;    // max. payload bytes per block
+static const QWORD PSTATE_TRACE_BLOCK_PERIOD = 60000000000; // max. nanoseconds per block (limits the loss on a crash)
+
+struct PStateTraceHeader
+{
+	char Magic[4];
+	DWORD Version;
+	DWORD Family;
+	DWORD Model;
+	DWORD NumCPUs;
+	DWORD NumPStates;
+	DWORD NumBoostStates; // P0 .. P[NumBoostStates-1] are boosted
+	DWORD NumNBPStates;
+	double MaxMulti;      // MaxCpuCof, required to decode family 0x14 multipliers
+	QWORD StartTime;      // wall clock at timestamp 0, in nanoseconds since the UNIX epoch
+	QWORD PStates[8];     // raw MSRC001_00[6B:64] P-state [7:0] of the recorded system
+	char Host[64];        // null-terminated host name
+};
+
+struct PStateTraceBlockHeader
+{
+	DWORD Magic;          // PSTATE_TRACE_BLOCK_MAGIC
+	DWORD NumEvents;
+	DWORD PayloadSize;    // bytes following the block header
+	DWORD Reserved;
+	QWORD FirstTimestamp; // base of the first delta
+	QWORD MaxTimestamp;   // max. timestamp of this and all previous blocks (for binary searches)
+};
+
+struct PStateTraceIndexEntry
+{
+	QWORD Offset;         // of the block header
+	QWORD FirstTimestamp;
+	QWORD MaxTimestamp;
+};
+
+struct PStateTraceFooter
+{
+	QWORD IndexOffset;
+	DWORD NumBlocks;
+	DWORD Magic;          // PSTATE_TRACE_INDEX_MAGIC
+};
+
+static_assert(sizeof(PStateTraceHeader) == 176, "unexpected P-state trace header layout");
+static_assert(sizeof(PStateTraceBlockHeader) == 32, "unexpected P-state trace block layout");
+static_assert(sizeof(PStateTraceIndexEntry) == 24, "unexpected P-state trace index layout");
+static_assert(sizeof(PStateTraceFooter) == 16, "unexpected P-state trace footer layout");
+
+
+enum PStateTraceEventKind
+{
+	TRACE_COFVID = 0, // raw MSRC001_0071[31:0] COFVID Status of a core (CurPstate, CurCpuFid/Did/Vid)
+	TRACE_NBPSTATE,   // CurNbPstate of the node (reported by CPU 0)
+};
+
+struct PStateTraceEvent
+{
+	QWORD Timestamp; // nanoseconds since the header's StartTime
+	int Cpu;
+	PStateTraceEventKind Kind;
+	DWORD Value;
+};
+
+
+/// <summary>
+/// Appends transitions to a trace file. Events may be appended slightly out of order
+/// (e.g., drained per core); the block index stays searchable by time nevertheless.
+/// </summary>
+class PStateTraceWriter
+{
+public:
+
+	PStateTraceWriter()
+		: _offset(0)
+		, _numEvents(0)
+		, _totalEvents(0)
+	{ }
+
+	~PStateTraceWriter() { Close(); }
+
+	/// <summary>Creates the trace file and writes the header.</summary>
+	bool Open(const char* path, const PStateTraceHeader& header);
+
+	void Append(QWORD timestamp, int cpu, PStateTraceEventKind kind, DWORD value);
+
+	/// <summary>Writes the pending block, the block index and the footer.</summary>
+	bool Close();
+
+	QWORD GetNumEvents() const { return _totalEvents; }
+	QWORD GetSize() const { return _offset; }
+
+
+private:
+
+	void FlushBlock();
+
+	std::ofstream _file;
+	QWORD _offset;
+
+	std::vector<unsigned char> _payload;
+	DWORD _numEvents;
+	QWORD _firstTimestamp;
+	QWORD _lastTimestamp;
+	QWORD _maxTimestamp;
+
+	std::vector<PStateTraceIndexEntry> _index;
+	QWORD _totalEvents;
+};
+
+
+/// <summary>Maps a file read-only into memory.</summary>
+class MappedFile
+{
+public:
+
+	MappedFile()
+		: _address(NULL)
+		, _size(0)
+		, _handle(NULL)
+	{ }
+
+	~MappedFile() { Close(); }
+
+	bool Open(const char* path);
+	void Close();
+
+	const unsigned char* GetAddress() const { return (const unsigned char*)_address; }
+	size_t GetSize() const { return _size; }
+
+
+private:
+
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	void* _address;
+	size_t _size;
+	void* _handle; // Windows mapping handle
+};
+
+
+/// <summary>
+/// Reads a trace file through a memory mapping. Blocks are decoded on demand only,
+/// so seeking to a point in time does not touch the preceding blocks.
+/// </summary>
+class PStateTraceReader
+{
+public:
+
+	PStateTraceReader()
+		: _header(NULL)
+	{ }
+
+	/// <summary>Maps the trace and loads (or rebuilds) its block index.</summary>
+	bool Open(const char* path);
+
+	const PStateTraceHeader& GetHeader() const { return *_header; }
+
+	size_t GetNumBlocks() const { return _index.size(); }
+	const PStateTraceIndexEntry& GetBlock(size_t block) const { return _index[block]; }
+
+	/// <summary>
+	/// Returns the first block which may contain events at or after the timestamp
+	/// (GetNumBlocks() if there are none); all events of the preceding blocks are older.
+	/// </summary>
+	size_t FindBlock(QWORD timestamp) const;
+
+	/// <summary>Decodes the events of a block; returns false if the block is corrupt.</summary>
+	bool ReadBlock(size_t block, std::vector<PStateTraceEvent>& events) const;
+
+
+private:
+
+	MappedFile _file;
+	const PStateTraceHeader* _header;
+	std::vector<PStateTraceIndexEntry> _index;
+};
+
+
+struct PStateTraceStats
+{
+	QWORD NumEvents;
+	QWORD NumDropped; // samples lost by all cores
+	QWORD Size;       // bytes
+	double Seconds;
+};
+
+/// <summary>
+/// Samples all cores (see PStateSampler) and records their transitions to a trace file.
+/// </summary>
+class PStateTraceRecorder
+{
+public:
+
+	explicit PStateTraceRecorder(const Info& info)
+		: _info(&info)
+	{ }
+
+	/// <summary>
+	/// Records until the period has elapsed (if positive) or the stop flag is set.
+	/// Returns false if the trace file cannot be written.
+	/// </summary>
+	bool Run(const char* path, double rateHz, double seconds, const std::atomic<bool>& stop, PStateTraceStats& stats) const;
+
+
+private:
+
+	const Info* _info;
+};
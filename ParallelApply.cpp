@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ParallelApply.h"
+#include "RegisterAccess.h"
+
+using std::atomic;
+using std::exception_ptr;
+using std::thread;
+using std::vector;
+using std::chrono::steady_clock;
+
+typedef std::chrono::duration<double, std::micro> Microseconds;
+
+
+ParallelApplyReport ParallelApply::Run(int numCPUs, const Task& task)
+{
+	return RunIndexed(numCPUs, [&task](int, int cpu) { task(cpu); });
+}
+
+ParallelApplyReport ParallelApply::RunIndexed(int numCPUs, const IndexedTask& task)
+{
+	return RunIndexed(GetBackend(), numCPUs, task);
+}
+
+ParallelApplyReport ParallelApply::RunIndexed(const RegisterBackend& backend, int numCPUs, const IndexedTask& task)
+{
+	const bool isCpuAddressable = backend.IsCpuAddressable();
+
+	atomic<int> numReady(0);
+	atomic<bool> go(false);
+	atomic<bool> cancelled(false);
+
+	vector<steady_clock::time_point> finishTimes(numCPUs);
+	vector<exception_ptr> errors(numCPUs);
+	vector<thread> workers;
+
+	try
+	{
+		workers.reserve(numCPUs);
+
+		for (int i = 0; i < numCPUs; i++)
+		{
+			workers.push_back(thread([&, i]()
+			{
+				// the workers inherit the priority of the calling thread
+				const bool isPinned = PinCurrentThread(i);
+
+				// barrier: wait until all workers are pinned and ready to go
+				numReady.fetch_add(1);
+				while (!go.load(std::memory_order_acquire))
+					std::this_thread::yield();
+
+				try
+				{
+					// without the affinity, CURRENT_CPU would target an arbitrary CPU
+					// (addressable backends merely lose the simultaneity)
+					if (!isPinned && !isCpuAddressable)
+						throw std::runtime_error("cannot pin a thread to logical CPU " + std::to_string(i));
+
+					if (!cancelled.load(std::memory_order_relaxed))
+						task(i, isCpuAddressable ? i : CURRENT_CPU);
+				}
+				catch (...)
+				{
+					errors[i] = std::current_exception();
+				}
+
+				finishTimes[i] = steady_clock::now();
+			}));
+		}
+	}
+	catch (...)
+	{
+		// release the workers started so far without running the task
+		cancelled.store(true, std::memory_order_relaxed);
+		go.store(true, std::memory_order_release);
+
+		for (size_t i = 0; i < workers.size(); i++)
+			workers[i].join();
+
+		throw;
+	}
+
+	while (numReady.load() < numCPUs)
+		std::this_thread::yield();
+
+	const steady_clock::time_point start = steady_clock::now();
+	go.store(true, std::memory_order_release);
+
+	for (int i = 0; i < numCPUs; i++)
+		workers[i].join();
+
+	for (int i = 0; i < numCPUs; i++)
+	{
+		if (errors[i])
+			std::rethrow_exception(errors[i]);
+	}
+
+	ParallelApplyReport report;
+	report.NumCPUs = numCPUs;
+	report.TotalMicroseconds = 0.0;
+	report.SkewMicroseconds = 0.0;
+
+	if (numCPUs > 0)
+	{
+		const steady_clock::time_point first = *std::min_element(finishTimes.begin(), finishTimes.end());
+		const steady_clock::time_point last = *std::max_element(finishTimes.begin(), finishTimes.end());
+
+		report.TotalMicroseconds = Microseconds(last - start).count();
+		report.SkewMicroseconds = Microseconds(last - first).count();
+	}
+
+	return report;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#pragma once
+
+#include <functional>
+
+class RegisterBackend;
+
+
+struct ParallelApplyReport
+{
+	int NumCPUs;
+	double TotalMicroseconds; // from releasing the workers until the last one finished
+	double SkewMicroseconds;  // between the first and the last worker finishing
+};
+
+
+/// <summary>
+/// Runs a task on all logical CPUs simultaneously. Each CPU gets its own worker thread pinned to it;
+/// the workers wait behind a barrier until all of them are ready and are then released together.
+/// </summary>
+class ParallelApply
+{
+public:
+
+	/// <summary>
+	/// The task receives the CPU index to be passed to the register accessors
+	/// (CURRENT_CPU if the backend cannot address CPUs directly, see TargetCPU()).
+	/// </summary>
+	typedef std::function<void(int cpu)> Task;
+
+	/// <summary>Like Task, additionally receiving the index of the logical CPU it runs on.</summary>
+	typedef std::function<void(int index, int cpu)> IndexedTask;
+
+	/// <summary>
+	/// Runs the task on logical CPUs 0 .. numCPUs-1 and waits for all of them.
+	/// If any task throws or a worker cannot be pinned to its CPU (if the backend is not CPU-addressable),
+	/// the first exception (in CPU order) is rethrown after all workers finished. If a worker thread cannot be started, none runs the task.
+	/// </summary>
+	static ParallelApplyReport Run(int numCPUs, const Task& task);
+
+	static ParallelApplyReport RunIndexed(int numCPUs, const IndexedTask& task);
+
+	/// <summary>Like RunIndexed(), targeting the specified backend instead of the global one.</summary>
+	static ParallelApplyReport RunIndexed(const RegisterBackend& backend, int numCPUs, const IndexedTask& task);
+};
@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#include "Platform.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <sched.h>
+#include <cerrno>
+#include <cstdio>
+#include <signal.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+#endif
+
+
+#ifdef _WIN32
+
+int GetNumLogicalCPUs()
+{
+	SYSTEM_INFO sysInfo;
+	GetSystemInfo(&sysInfo);
+	return sysInfo.dwNumberOfProcessors;
+}
+
+int GetLogicalCPUId(int cpu)
+{
+	return cpu;
+}
+
+int GetCurrentCPU()
+{
+	return GetCurrentProcessorNumber();
+}
+
+bool PinCurrentThread(int cpu)
+{
+	const HANDLE hThread = GetCurrentThread();
+	return SetThreadAffinityMask(hThread, (DWORD_PTR)1 << cpu) != 0;
+}
+
+static thread_local DWORD savedPriorityClass = NORMAL_PRIORITY_CLASS;
+static thread_local int savedThreadPriority = THREAD_PRIORITY_NORMAL;
+
+void RaiseThreadPriority()
+{
+	savedPriorityClass = GetPriorityClass(GetCurrentProcess());
+	savedThreadPriority = GetThreadPriority(GetCurrentThread());
+
+	SetPriorityClass(GetCurrentProcess(), REALTIME_PRIORITY_CLASS);
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+}
+
+void RestoreThreadPriority()
+{
+	SetThreadPriority(GetCurrentThread(), savedThreadPriority);
+	SetPriorityClass(GetCurrentProcess(), savedPriorityClass);
+}
+
+bool IsProcessRunning(DWORD processId)
+{
+	const HANDLE hProcess = OpenProcess(SYNCHRONIZE, FALSE, processId);
+	if (hProcess == NULL)
+		return (GetLastError() == ERROR_ACCESS_DENIED);
+
+	const bool running = (WaitForSingleObject(hProcess, 0) == WAIT_TIMEOUT);
+	CloseHandle(hProcess);
+	return running;
+}
+
+#else
+
+/// <summary>The OS IDs of the online CPUs and the logical CPU index of each ID (-1 if offline).</summary>
+struct OnlineCPUs
+{
+	std::vector<int> Ids;
+	std::vector<int> Indices;
+
+	OnlineCPUs()
+	{
+		// e.g., "0-3,6,8-11"
+		FILE* file = fopen("/sys/devices/system/cpu/online", "r");
+		if (file != NULL)
+		{
+			int first, last;
+			while (fscanf(file, "%d", &first) == 1)
+			{
+				last = first;
+				if (fscanf(file, "-%d", &last) != 1)
+					last = first;
+
+				for (int id = first; id <= last; id++)
+					Ids.push_back(id);
+
+				if (fgetc(file) != ',')
+					break;
+			}
+
+			fclose(file);
+		}
+
+		if (Ids.empty())
+		{
+			const int numCPUs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+			for (int id = 0; id < numCPUs; id++)
+				Ids.push_back(id);
+		}
+
+		Indices.assign(Ids.back() + 1, -1);
+		for (size_t i = 0; i < Ids.size(); i++)
+			Indices[Ids[i]] = (int)i;
+	}
+};
+
+static const OnlineCPUs& GetOnlineCPUs()
+{
+	static const OnlineCPUs onlineCPUs;
+	return onlineCPUs;
+}
+
+int GetNumLogicalCPUs()
+{
+	return (int)GetOnlineCPUs().Ids.size();
+}
+
+int GetLogicalCPUId(int cpu)
+{
+	const OnlineCPUs& onlineCPUs = GetOnlineCPUs();
+	return (cpu >= 0 && cpu < (int)onlineCPUs.Ids.size() ? onlineCPUs.Ids[cpu] : -1);
+}
+
+int GetCurrentCPU()
+{
+	const OnlineCPUs& onlineCPUs = GetOnlineCPUs();
+	const int id = sched_getcpu();
+	return (id >= 0 && id < (int)onlineCPUs.Indices.size() ? onlineCPUs.Indices[id] : -1);
+}
+
+bool PinCurrentThread(int cpu)
+{
+	const int id = GetLogicalCPUId(cpu);
+	if (id < 0 || id >= CPU_SETSIZE)
+		return false;
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(id, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+static thread_local int savedNiceValue = 0;
+
+// on Linux, PRIO_PROCESS with a zero ID affects the calling thread only
+void RaiseThreadPriority()
+{
+	errno = 0;
+	const int niceValue = getpriority(PRIO_PROCESS, 0);
+	if (errno == 0)
+		savedNiceValue = niceValue;
+
+	setpriority(PRIO_PROCESS, 0, -20);
+}
+
+void RestoreThreadPriority()
+{
+	setpriority(PRIO_PROCESS, 0, savedNiceValue);
+}
+
+bool IsProcessRunning(DWORD processId)
+{
+	// signal 0 only checks for the existence of the process (EPERM: it belongs to another user)
+	return (processId != 0 && (kill((pid_t)processId, 0) == 0 || errno == EPERM));
+}
+
+#endif
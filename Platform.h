@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#pragma once
+
+#ifdef _WIN32
+#define WIN32_MEAN_AND_LEAN
+#include <windows.h>
+#undef min
+#undef max
+#else
+#include <stdint.h>
+typedef uint32_t DWORD;
+#endif
+
+
+typedef unsigned long long QWORD;
+
+
+// Logical CPUs are identified by their index (0 to GetNumLogicalCPUs() - 1) among the online CPUs,
+// which differs from the OS CPU ID if some CPUs have been taken offline (Linux).
+
+/// <summary>Returns the number of online logical CPUs.</summary>
+int GetNumLogicalCPUs();
+
+/// <summary>Returns the OS ID of a logical CPU (e.g., N in /dev/cpu/N/msr).</summary>
+int GetLogicalCPUId(int cpu);
+
+/// <summary>Returns the index of the logical CPU the calling thread is currently running on.</summary>
+int GetCurrentCPU();
+
+/// <summary>Restricts the calling thread to a single logical CPU.</summary>
+bool PinCurrentThread(int cpu);
+
+/// <summary>Switches to the highest thread priority (we do not want to get interrupted often).</summary>
+void RaiseThreadPriority();
+
+/// <summary>Restores the thread priority saved by RaiseThreadPriority().</summary>
+void RestoreThreadPriority();
+
+/// <summary>Returns whether a process with the given ID exists (and has not exited).</summary>
+bool IsProcessRunning(DWORD processId);
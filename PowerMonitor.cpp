@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "PowerMonitor.h"
+#include "Info.h"
+#include "Registers.h"
+
+using std::endl;
+using std::vector;
+using std::chrono::steady_clock;
+
+
+bool PowerMonitor::IsSupported(const Info& info)
+{
+	return (info.Family == 0x15 && info.Model < 0x80);
+}
+
+
+namespace
+{
+	struct NodeConstants
+	{
+		DWORD BaseTdp;
+		double WattsPerUnit; // Tdp2Watt
+	};
+}
+
+// the running average accumulator and the TDP limit were widened with Carrizo
+static bool IsCarrizoOrLater(const Info& info) { return (info.Model >= 0x60); }
+
+static long long SignExtend(DWORD value, unsigned width)
+{
+	const long long sign = 1LL << (width - 1);
+	return ((long long)value ^ sign) - sign;
+}
+
+static RegisterStatus TryReadPower(const Info& info, DWORD device, const NodeConstants& constants, double& watts)
+{
+	DWORD average, limit;
+	RegisterStatus status = TryReadPciConfig(device, 5, D18F5xE0::Address, average); // D18F5xE0 Processor TDP Running Average
+	if (status == REG_OK)
+		status = TryReadPciConfig(device, 5, D18F5xE8::Address, limit); // D18F5xE8 TDP Limit 3
+	if (status != REG_OK)
+		return status;
+
+	long long capture;
+	DWORD tdpLimit;
+	if (IsCarrizoOrLater(info))
+	{
+		capture = SignExtend(D18F5xE0::TdpRunAvgAccCapCZ::Get(average), D18F5xE0::TdpRunAvgAccCapCZ::Width);
+		tdpLimit = D18F5xE8::ApmTdpLimitCZ::Get(limit);
+	}
+	else
+	{
+		capture = SignExtend(D18F5xE0::TdpRunAvgAccCap::Get(average), D18F5xE0::TdpRunAvgAccCap::Width);
+		tdpLimit = D18F5xE8::ApmTdpLimit::Get(limit);
+	}
+
+	// the accumulator holds the difference to the limit, summed up over 2^range samples
+	const int range = (int)D18F5xE0::RunAvgRange::Get(average) + 1;
+	const long long sum = ((long long)(tdpLimit + constants.BaseTdp) << range) - capture;
+
+	watts = (double)sum / (double)(1LL << range) * constants.WattsPerUnit;
+	return REG_OK;
+}
+
+
+vector<NodePower> PowerMonitor::Run(double intervalSeconds, double seconds, const std::atomic<bool>& stop) const
+{
+	const Info& info = *_info;
+
+	vector<NodePower> nodes;
+	vector<NodeConstants> constants;
+
+	// nodes are consecutive PCI devices starting at D18h
+	for (int node = 0; node < 8; node++)
+	{
+		const DWORD device = AMD_CPU_DEVICE + node;
+
+		DWORD tdp, tdpLimit, caps;
+		if (TryReadPciConfig(device, 4, D18F4x1B8::Address, tdp) != REG_OK || tdp == 0xFFFFFFFF ||
+		    TryReadPciConfig(device, 5, D18F5xE8::Address, tdpLimit) != REG_OK ||
+		    TryReadPciConfig(device, 3, D18F3xE8::Address, caps) != REG_OK)
+			break;
+
+		// the second internal node of a multi-node package does not report the power
+		if (D18F3xE8::MultiNodeCpu::Get(caps) == 1 && D18F3xE8::IntNodeNum::Get(caps) != 0)
+			continue;
+
+		NodeConstants c;
+		c.BaseTdp = D18F4x1B8::BaseTdp::Get(tdp);
+		c.WattsPerUnit = D18F5xE8::Tdp2Watt::Get(tdpLimit) / 65536.0;
+		constants.push_back(c);
+
+		NodePower n;
+		n.Node = node;
+		n.Device = device;
+		n.TdpWatts = D18F4x1B8::ProcessorTdp::Get(tdp) * c.WattsPerUnit;
+		n.MinWatts = n.AvgWatts = n.MaxWatts = n.Joules = 0.0;
+		n.NumFailed = 0;
+		nodes.push_back(n);
+	}
+
+	const steady_clock::duration interval = std::chrono::duration_cast<steady_clock::duration>(
+		std::chrono::duration<double>(std::max(0.001, intervalSeconds)));
+
+	const steady_clock::time_point start = steady_clock::now();
+	const steady_clock::time_point end = start + std::chrono::duration_cast<steady_clock::duration>(std::chrono::duration<double>(seconds));
+
+	steady_clock::time_point next = start;
+
+	while (!nodes.empty() && (seconds <= 0 || next < end) && !stop.load())
+	{
+		const double now = std::chrono::duration<double>(steady_clock::now() - start).count();
+
+		for (size_t i = 0; i < nodes.size(); i++)
+		{
+			NodePower& n = nodes[i];
+
+			PowerSample sample;
+			sample.Seconds = now;
+			if (TryReadPower(info, n.Device, constants[i], sample.Watts) != REG_OK)
+			{
+				n.NumFailed++;
+				continue;
+			}
+
+			if (n.Samples.empty())
+				n.MinWatts = n.MaxWatts = sample.Watts;
+			else
+			{
+				// the power held since the previous sample
+				const PowerSample& previous = n.Samples.back();
+				n.Joules += previous.Watts * (sample.Seconds - previous.Seconds);
+
+				n.MinWatts = std::min(n.MinWatts, sample.Watts);
+				n.MaxWatts = std::max(n.MaxWatts, sample.Watts);
+			}
+
+			n.Samples.push_back(sample);
+		}
+
+		next += interval;
+		const steady_clock::time_point current = steady_clock::now();
+		if (next < current)
+			next = current + interval;
+
+		std::this_thread::sleep_until(next);
+	}
+
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		NodePower& n = nodes[i];
+
+		double sum = 0.0;
+		for (size_t j = 0; j < n.Samples.size(); j++)
+			sum += n.Samples[j].Watts;
+
+		n.AvgWatts = (n.Samples.empty() ? 0.0 : sum / n.Samples.size());
+	}
+
+	return nodes;
+}
+
+
+void PowerMonitor::Print(std::ostream& os, const vector<NodePower>& nodes) const
+{
+	const std::ios::fmtflags flags = os.flags();
+	const std::streamsize precision = os.precision();
+	os.setf(std::ios::fixed);
+	os.precision(1);
+
+	os << ".:. Power (TDP running average)" << endl << "---" << endl;
+
+	if (nodes.empty())
+		os << "  no node reports its power" << endl;
+
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		const NodePower& n = nodes[i];
+
+		os << "  Node " << n.Node << ": ";
+		if (n.Samples.empty())
+			os << "no samples";
+		else
+		{
+			os << n.MinWatts << " / " << n.AvgWatts << " / " << n.MaxWatts << " W (min/avg/max) of " << n.TdpWatts << " W TDP, "
+			   << n.Joules << " J in " << n.Samples.back().Seconds << " s";
+		}
+		if (n.NumFailed > 0)
+			os << ", " << n.NumFailed << " failed";
+		os << endl;
+	}
+
+	os.precision(precision);
+	os.flags(flags);
+}
+
+void PowerMonitor::PrintTimeline(std::ostream& os, const vector<NodePower>& nodes)
+{
+	const std::ios::fmtflags flags = os.flags();
+	const std::streamsize precision = os.precision();
+	os.setf(std::ios::fixed);
+	os.precision(3);
+
+	os << "seconds";
+	for (size_t i = 0; i < nodes.size(); i++)
+		os << ",node" << nodes[i].Node << "_watts";
+	os << endl;
+
+	// failed samples leave gaps, so the rows are merged by time
+	vector<size_t> positions(nodes.size(), 0);
+	for (;;)
+	{
+		double t = -1.0;
+		for (size_t i = 0; i < nodes.size(); i++)
+		{
+			if (positions[i] < nodes[i].Samples.size())
+			{
+				const double s = nodes[i].Samples[positions[i]].Seconds;
+				t = (t < 0 ? s : std::min(t, s));
+			}
+		}
+
+		if (t < 0)
+			break;
+
+		os << t;
+		for (size_t i = 0; i < nodes.size(); i++)
+		{
+			os << ",";
+			if (positions[i] < nodes[i].Samples.size() && nodes[i].Samples[positions[i]].Seconds == t)
+				os << nodes[i].Samples[positions[i]++].Watts;
+		}
+		os << endl;
+	}
+
+	os.precision(precision);
+	os.flags(flags);
+}
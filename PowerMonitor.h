@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <ostream>
+#include <vector>
+#include "Platform.h"
+
+class Info;
+
+
+struct PowerSample
+{
+	double Seconds; // since the start of the monitoring
+	double Watts;
+};
+
+struct NodePower
+{
+	int Node;
+	DWORD Device;     // PCI device of the node (D18h + node)
+	double TdpWatts;  // ProcessorTdp
+	double MinWatts;
+	double AvgWatts;  // over all samples
+	double MaxWatts;
+	double Joules;    // integral over the monitored period
+	int NumFailed;
+	std::vector<PowerSample> Samples;
+};
+
+
+/// <summary>
+/// Samples the processor power of each family 15h node, as computed by the APM TDP running
+/// average (D18F5xE0) relative to the TDP limit (D18F5xE8, D18F4x1B8):
+/// P = ((ApmTdpLimit + BaseTdp) * 2^(RunAvgRange + 1) - TdpRunAvgAccCap) / 2^(RunAvgRange + 1) * Tdp2Watt.
+/// On multi-node processors, only the first internal node of each package reports the power.
+/// </summary>
+class PowerMonitor
+{
+public:
+
+	explicit PowerMonitor(const Info& info)
+		: _info(&info)
+	{ }
+
+	/// <summary>Family 15h models 00h-7Fh implement the TDP running average.</summary>
+	static bool IsSupported(const Info& info);
+
+	/// <summary>Samples every interval until the period has elapsed (if positive) or the stop flag is set.</summary>
+	std::vector<NodePower> Run(double intervalSeconds, double seconds, const std::atomic<bool>& stop) const;
+
+	void Print(std::ostream& os, const std::vector<NodePower>& nodes) const;
+
+	/// <summary>Writes the samples as CSV, one row per sample and one column per node.</summary>
+	static void PrintTimeline(std::ostream& os, const std::vector<NodePower>& nodes);
+
+
+private:
+
+	const Info* _info;
+};
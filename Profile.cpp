@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "Profile.h"
+#include "StringUtils.h"
+
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+
+
+bool ProfileFile::Load(const char* path)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		cerr << "ERROR: cannot read " << path << endl;
+		return false;
+	}
+
+	_profiles.clear();
+
+	string line;
+	for (int lineNumber = 1; std::getline(file, line); lineNumber++)
+	{
+		vector<string> tokens;
+		StringUtils::Tokenize(tokens, line, " \t\r", true);
+
+		if (tokens.empty() || tokens[0][0] == ';' || tokens[0][0] == '#')
+			continue;
+
+		if (tokens[0][0] == '[')
+		{
+			const size_t end = line.find(']');
+			const size_t begin = line.find('[');
+			const string name = (end == string::npos ? string() : line.substr(begin + 1, end - begin - 1));
+
+			if (name.empty() || Find(name.c_str()) != NULL)
+			{
+				cerr << "ERROR: " << path << "(" << lineNumber << "): missing or duplicate profile name" << endl;
+				return false;
+			}
+
+			_profiles.push_back(std::make_pair(name, vector<string>()));
+			continue;
+		}
+
+		if (_profiles.empty())
+		{
+			cerr << "ERROR: " << path << "(" << lineNumber << "): parameters outside of a [profile]" << endl;
+			return false;
+		}
+
+		vector<string>& params = _profiles.back().second;
+		params.insert(params.end(), tokens.begin(), tokens.end());
+	}
+
+	return true;
+}
+
+const vector<string>* ProfileFile::Find(const char* name) const
+{
+	for (size_t i = 0; i < _profiles.size(); i++)
+	{
+		if (_stricmp(_profiles[i].first.c_str(), name) == 0)
+			return &_profiles[i].second;
+	}
+
+	return NULL;
+}
+
+vector<string> ProfileFile::GetNames() const
+{
+	vector<string> result;
+	for (size_t i = 0; i < _profiles.size(); i++)
+		result.push_back(_profiles[i].first);
+
+	return result;
+}
+
+
+static void WriteRecords(std::ofstream& file, const RegisterTransaction& transaction, CompiledProfileScope scope)
+{
+	const vector<RegisterChange>& changes = transaction.GetChanges();
+	for (size_t i = 0; i < changes.size(); i++)
+	{
+		const RegisterId& reg = changes[i].Register;
+
+		CompiledProfileRecord record;
+		record.Type = (unsigned char)reg.Type;
+		record.Scope = (unsigned char)scope;
+		record.Reserved = 0;
+		record.Address = (reg.Type == MSR_REGISTER ? reg.Address : (reg.Device << 16) | (reg.Function << 12) | reg.Address);
+		record.Mask = changes[i].Mask;
+		record.Value = changes[i].Value;
+
+		file.write((const char*)&record, sizeof(record));
+	}
+}
+
+bool CompiledProfile::Save(const char* path) const
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+
+	CompiledProfileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.Magic, COMPILED_PROFILE_MAGIC, sizeof(header.Magic));
+	header.Version = COMPILED_PROFILE_VERSION;
+	header.CpuSignature = CpuSignature;
+	header.NumPStates = (DWORD)NumPStates;
+	header.MaxMulti = MaxMulti;
+	header.PState = PState;
+	header.NumRecords = (DWORD)(NodeRegisters.GetChanges().size() + CoreRegisters.GetChanges().size());
+	strncpy(header.Name, Name.c_str(), sizeof(header.Name) - 1);
+
+	file.write((const char*)&header, sizeof(header));
+	WriteRecords(file, NodeRegisters, PROFILE_NODE);
+	WriteRecords(file, CoreRegisters, PROFILE_CORE);
+
+	file.flush();
+	return file.good();
+}
+
+bool CompiledProfile::Load(const char* path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	CompiledProfileHeader header;
+	if (!file.read((char*)&header, sizeof(header)) ||
+	    memcmp(header.Magic, COMPILED_PROFILE_MAGIC, sizeof(header.Magic)) != 0 ||
+	    header.Version != COMPILED_PROFILE_VERSION)
+		return false;
+
+	RegisterTransaction nodeRegisters, coreRegisters;
+
+	for (DWORD i = 0; i < header.NumRecords; i++)
+	{
+		CompiledProfileRecord record;
+		if (!file.read((char*)&record, sizeof(record)))
+			return false;
+
+		if (record.Type == MSR_REGISTER && record.Scope == PROFILE_CORE)
+			coreRegisters.SetMsrMasked(record.Address, record.Mask, record.Value);
+		else if (record.Type == MSR_REGISTER && record.Scope == PROFILE_NODE)
+			nodeRegisters.SetMsrMasked(record.Address, record.Mask, record.Value);
+		else if (record.Type == PCI_REGISTER && record.Scope == PROFILE_NODE)
+			nodeRegisters.SetPciMasked(record.Address >> 16, (record.Address >> 12) & 0xF, record.Address & 0xFFF, (DWORD)record.Mask, (DWORD)record.Value);
+		else
+			return false;
+	}
+
+	header.Name[sizeof(header.Name) - 1] = 0;
+
+	Name = header.Name;
+	CpuSignature = header.CpuSignature;
+	NumPStates = (int)header.NumPStates;
+	MaxMulti = header.MaxMulti;
+	PState = header.PState;
+	NodeRegisters = nodeRegisters;
+	CoreRegisters = coreRegisters;
+
+	return true;
+}
+
+
+void CompiledProfile::Print(std::ostream& os) const
+{
+	os << ".:. Profile " << Name << endl << "---" << endl;
+
+	if (!NodeRegisters.IsEmpty())
+	{
+		os << "  Node-wide registers:" << endl;
+		NodeRegisters.Print(os, "    ");
+	}
+
+	if (!CoreRegisters.IsEmpty())
+	{
+		os << "  Each logical CPU:" << endl;
+		CoreRegisters.Print(os, "    ");
+	}
+
+	if (PState >= 0)
+		os << "  switch to P" << PState << endl;
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "RegisterTransaction.h"
+
+
+/// <summary>
+/// Named sets of the command line parameters (see Worker::ParseParams()) in an INI-like text file:
+/// each profile starts with a [name] line and lists its parameters, separated by whitespace or line breaks.
+/// Empty lines and lines starting with ';' or '#' are ignored.
+/// </summary>
+class ProfileFile
+{
+public:
+
+	/// <summary>Reads all profiles. Returns false (reporting the error to stderr) if the file cannot be read or is malformed.</summary>
+	bool Load(const char* path);
+
+	/// <summary>Returns the parameters of a profile (the names are case-insensitive), NULL if it is not defined.</summary>
+	const std::vector<std::string>* Find(const char* name) const;
+
+	std::vector<std::string> GetNames() const;
+
+
+private:
+
+	std::vector<std::pair<std::string, std::vector<std::string> > > _profiles;
+};
+
+
+// Binary compiled profile:
+// a CompiledProfileHeader followed by NumRecords 24-byte CompiledProfileRecords (little endian).
+
+static const char COMPILED_PROFILE_MAGIC[4] = { 'A', 'M', 'T', 'C' };
+static const DWORD COMPILED_PROFILE_VERSION = 1;
+
+struct CompiledProfileHeader
+{
+	char Magic[4];
+	DWORD Version;
+	DWORD CpuSignature; // CPUID Fn8000_0001_EAX of the CPU compiled for
+	DWORD NumPStates;
+	double MaxMulti;    // the encoding depends on it (family 0x14)
+	int PState;         // hardware index of the P-state to be requested, -1 to keep the current ones
+	DWORD NumRecords;
+	char Name[40];      // NUL-terminated
+};
+
+enum CompiledProfileScope
+{
+	PROFILE_NODE, // written once
+	PROFILE_CORE  // written on each logical CPU
+};
+
+struct CompiledProfileRecord
+{
+	unsigned char Type;  // RegisterType
+	unsigned char Scope; // CompiledProfileScope
+	unsigned short Reserved;
+	DWORD Address;       // MSR index or device << 16 | function << 12 | register
+	QWORD Mask;          // bits to be modified
+	QWORD Value;
+};
+
+static_assert(sizeof(CompiledProfileHeader) == 72, "unexpected compiled profile header layout");
+static_assert(sizeof(CompiledProfileRecord) == 24, "unexpected compiled profile record layout");
+
+
+/// <summary>
+/// A profile validated against and encoded for a specific CPU (see Worker::Compile()): the raw register bits
+/// to be set, so applying it requires neither parsing nor encoding of multipliers and voltages.
+/// </summary>
+class CompiledProfile
+{
+public:
+
+	std::string Name;
+	DWORD CpuSignature;
+	int NumPStates;
+	double MaxMulti;
+	int PState;
+	RegisterTransaction NodeRegisters;
+	RegisterTransaction CoreRegisters; // MSRs of CURRENT_CPU, to be set on every logical CPU
+
+	CompiledProfile() : CpuSignature(0), NumPStates(0), MaxMulti(0.0), PState(-1) { }
+
+	/// <summary>Writes the profile to a file. Returns false if the file cannot be written.</summary>
+	bool Save(const char* path) const;
+
+	/// <summary>Replaces the profile by the one saved in a file. Returns false if it cannot be read or is invalid.</summary>
+	bool Load(const char* path);
+
+	/// <summary>Lists the register bits to be set and the P-state to be requested.</summary>
+	void Print(std::ostream& os) const;
+};
@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#include <stdexcept>
+#include "RegisterAccess.h"
+#include "LinuxBackend.h"
+#include "StringUtils.h"
+#include "WinRing0.h"
+
+using std::runtime_error;
+using std::string;
+
+
+static RegisterBackend* activeBackend = NULL;
+
+std::mutex RegisterBackend::SmuIndexDataMutex;
+
+
+const char* ToString(RegisterStatus status)
+{
+	switch (status)
+	{
+		case REG_OK: return "success";
+		case REG_NO_BACKEND: return "no register backend initialized";
+		case REG_CPU_UNAVAILABLE: return "CPU not available";
+		case REG_NOT_PRESENT: return "device not present";
+		case REG_ACCESS_DENIED: return "access denied";
+		case REG_ACCESS_FAILED: return "access failed";
+	}
+
+	return "unknown error";
+}
+
+
+// The index/data pair registers, D0F0xB8 and D0F0xBC, are used to access the registers at
+// D0F0xBC_x[FFFFFFFF:00000000]. To access any of these registers, the address is first written into the index
+// register, D0F0xB8, and then the data is read from or written to the data register, D0F0xBC.
+RegisterStatus RegisterBackend::ReadSmuIndirect(const DWORD* offsets, DWORD* values, int count)
+{
+	std::lock_guard<std::mutex> lock(SmuIndexDataMutex);
+
+	for (int i = 0; i < count; i++)
+	{
+		RegisterStatus status = WritePciConfig(0, 0, 0xB8, offsets[i]);
+		if (status == REG_OK)
+			status = ReadPciConfig(0, 0, 0xBC, values[i]);
+
+		if (status != REG_OK)
+			return status;
+	}
+
+	return REG_OK;
+}
+
+
+RegisterBackend* CreateDefaultBackend()
+{
+#ifdef _WIN32
+	return new WinRing0Backend();
+#else
+	return new LinuxEcamBackend();
+#endif
+}
+
+void SetBackend(RegisterBackend* backend)
+{
+	activeBackend = backend;
+}
+
+RegisterBackend& GetBackend()
+{
+	if (activeBackend == NULL)
+		throw runtime_error(ToString(REG_NO_BACKEND));
+
+	return *activeBackend;
+}
+
+void ShutdownBackend()
+{
+	delete activeBackend;
+	activeBackend = NULL;
+}
+
+int TargetCPU(int cpu)
+{
+	if (GetBackend().IsCpuAddressable())
+		return cpu;
+
+	PinCurrentThread(cpu);
+	return CURRENT_CPU;
+}
+
+
+RegisterStatus TryReadPciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD& value)
+{
+	return (activeBackend == NULL ? REG_NO_BACKEND : activeBackend->ReadPciConfig(device, function, regAddress, value));
+}
+
+RegisterStatus TryWritePciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD value)
+{
+	return (activeBackend == NULL ? REG_NO_BACKEND : activeBackend->WritePciConfig(device, function, regAddress, value));
+}
+
+RegisterStatus TryRdmsr(DWORD index, QWORD& value, int cpu)
+{
+	return (activeBackend == NULL ? REG_NO_BACKEND : activeBackend->Rdmsr(cpu, index, value));
+}
+
+RegisterStatus TryWrmsr(DWORD index, QWORD value, int cpu)
+{
+	return (activeBackend == NULL ? REG_NO_BACKEND : activeBackend->Wrmsr(cpu, index, value));
+}
+
+RegisterStatus TryCpuid(DWORD index, CpuidRegs& regs, int cpu)
+{
+	return (activeBackend == NULL ? REG_NO_BACKEND : activeBackend->Cpuid(cpu, index, regs));
+}
+
+RegisterStatus TryReadSmuRegisters(const DWORD* offsets, DWORD* values, int count)
+{
+	return (activeBackend == NULL ? REG_NO_BACKEND : activeBackend->ReadSmuIndirect(offsets, values, count));
+}
+
+
+// the error messages are only built on the (throwing) failure path
+static string Details(RegisterStatus status, int cpu)
+{
+	string msg = (cpu == CURRENT_CPU ? string() : " on CPU " + StringUtils::ToString(cpu));
+	msg += ": ";
+	msg += ToString(status);
+	return msg;
+}
+
+
+DWORD ReadPciConfig(DWORD device, DWORD function, DWORD regAddress)
+{
+	DWORD result;
+	const RegisterStatus status = TryReadPciConfig(device, function, regAddress, result);
+	if (status != REG_OK)
+	{
+		string msg = "cannot read from PCI configuration space (F";
+		msg += StringUtils::ToString(function);
+		msg += "x";
+		msg += StringUtils::ToHexString(regAddress);
+		msg += ")";
+		msg += Details(status, CURRENT_CPU);
+
+		throw runtime_error(msg);
+	}
+
+	return result;
+}
+
+void WritePciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD value)
+{
+	const RegisterStatus status = TryWritePciConfig(device, function, regAddress, value);
+	if (status != REG_OK)
+	{
+		string msg = "cannot write to PCI configuration space (F";
+		msg += StringUtils::ToString(function);
+		msg += "x";
+		msg += StringUtils::ToHexString(regAddress);
+		msg += ")";
+		msg += Details(status, CURRENT_CPU);
+
+		throw runtime_error(msg);
+	}
+}
+
+
+QWORD Rdmsr(DWORD index, int cpu)
+{
+	QWORD result;
+	const RegisterStatus status = TryRdmsr(index, result, cpu);
+	if (status != REG_OK)
+	{
+		string msg = "cannot read from MSR (0x";
+		msg += StringUtils::ToHexString(index);
+		msg += ")";
+		msg += Details(status, cpu);
+
+		throw runtime_error(msg);
+	}
+
+	return result;
+}
+
+void Wrmsr(DWORD index, const QWORD& value, int cpu)
+{
+	const RegisterStatus status = TryWrmsr(index, value, cpu);
+	if (status != REG_OK)
+	{
+		string msg = "cannot write to MSR (0x";
+		msg += StringUtils::ToHexString(index);
+		msg += ")";
+		msg += Details(status, cpu);
+
+		throw runtime_error(msg);
+	}
+}
+
+
+CpuidRegs Cpuid(DWORD index, int cpu)
+{
+	CpuidRegs result;
+	const RegisterStatus status = TryCpuid(index, result, cpu);
+	if (status != REG_OK)
+	{
+		string msg = "cannot execute CPUID instruction (0x";
+		msg += StringUtils::ToHexString(index);
+		msg += ")";
+		msg += Details(status, cpu);
+
+		throw runtime_error(msg);
+	}
+
+	return result;
+}
+
+
+void ReadSmuRegisters(const DWORD* offsets, DWORD* values, int count)
+{
+	const RegisterStatus status = TryReadSmuRegisters(offsets, values, count);
+	if (status != REG_OK)
+	{
+		string msg = "cannot read from SMU registers (D0F0xBC_x";
+		msg += StringUtils::ToHexString(offsets[0]);
+		if (count > 1)
+			msg += " ..";
+		msg += ")";
+		msg += Details(status, CURRENT_CPU);
+
+		throw runtime_error(msg);
+	}
+}
+
+DWORD ReadSmuRegister(DWORD offset)
+{
+	DWORD result;
+	ReadSmuRegisters(&offset, &result, 1);
+	return result;
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#pragma once
+
+#include <mutex>
+#include "Platform.h"
+
+
+struct CpuidRegs
+{
+	DWORD eax;
+	DWORD ebx;
+	DWORD ecx;
+	DWORD edx;
+};
+
+static const DWORD AMD_CPU_DEVICE = 0x18; // first AMD CPU
+
+static const int CURRENT_CPU = -1; // the logical CPU the calling thread is running on
+
+
+enum RegisterStatus
+{
+	REG_OK = 0,
+	REG_NO_BACKEND,       // no backend has been initialized
+	REG_CPU_UNAVAILABLE,  // the logical CPU is offline or does not exist
+	REG_NOT_PRESENT,      // the PCI device/function does not exist
+	REG_ACCESS_DENIED,
+	REG_ACCESS_FAILED     // the driver rejected the access (e.g., unsupported MSR)
+};
+
+/// <summary>Returns a static description of a status code.</summary>
+const char* ToString(RegisterStatus status);
+
+
+/// <summary>
+/// Provides access to the MSRs, the PCI configuration space and the CPUID instruction.
+/// MSR and CPUID accesses target a logical CPU index (or CURRENT_CPU).
+/// </summary>
+class RegisterBackend
+{
+public:
+
+	virtual ~RegisterBackend() { }
+
+	virtual const char* GetName() const = 0;
+
+	virtual bool Initialize() = 0;
+
+	/// <summary>
+	/// True if any logical CPU can be accessed from any thread; otherwise the calling thread
+	/// has to be moved to the target CPU for efficient accesses (see TargetCPU()).
+	/// </summary>
+	virtual bool IsCpuAddressable() const = 0;
+
+	/// <summary>Number of logical CPUs served by the backend (all CPUs of the system by default).</summary>
+	virtual int GetNumCPUs() const { return GetNumLogicalCPUs(); }
+
+	// accessors must neither throw nor allocate memory
+	virtual RegisterStatus Rdmsr(int cpu, DWORD index, QWORD& value) = 0;
+	virtual RegisterStatus Wrmsr(int cpu, DWORD index, QWORD value) = 0;
+
+	virtual RegisterStatus ReadPciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD& value) = 0;
+	virtual RegisterStatus WritePciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD value) = 0;
+
+	virtual RegisterStatus Cpuid(int cpu, DWORD index, CpuidRegs& regs) = 0;
+
+	/// <summary>
+	/// Reads a batch of registers behind the D0F0xB8/D0F0xBC index/data pair, holding the pair
+	/// exclusively for the whole batch. Backends may override it with a cheaper access path.
+	/// </summary>
+	virtual RegisterStatus ReadSmuIndirect(const DWORD* offsets, DWORD* values, int count);
+
+
+protected:
+
+	// serializes all accesses to the D0F0xB8/D0F0xBC index/data pair
+	static std::mutex SmuIndexDataMutex;
+};
+
+
+/// <summary>Creates the native backend of the platform (WinRing0 on Windows, msr/sysfs on Linux).</summary>
+RegisterBackend* CreateDefaultBackend();
+
+/// <summary>Selects the backend used by the functions below and takes ownership of it.</summary>
+void SetBackend(RegisterBackend* backend);
+RegisterBackend& GetBackend();
+
+/// <summary>Deletes the active backend.</summary>
+void ShutdownBackend();
+
+/// <summary>
+/// Prepares the calling thread for accesses to the specified logical CPU and returns the CPU index
+/// to be passed to the accessors. If the backend cannot address CPUs directly, the thread is moved
+/// to that CPU once and CURRENT_CPU is returned.
+/// </summary>
+int TargetCPU(int cpu);
+
+
+// The following accessors throw an exception on failure.
+
+DWORD ReadPciConfig(DWORD device, DWORD function, DWORD regAddress);
+void WritePciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD value);
+
+QWORD Rdmsr(DWORD index, int cpu = CURRENT_CPU);
+void Wrmsr(DWORD index, const QWORD& value, int cpu = CURRENT_CPU);
+
+CpuidRegs Cpuid(DWORD index, int cpu = CURRENT_CPU);
+
+/// <summary>Reads registers D0F0xBC_x[offset] via the D0F0xB8/D0F0xBC index/data pair in one batch.</summary>
+void ReadSmuRegisters(const DWORD* offsets, DWORD* values, int count);
+DWORD ReadSmuRegister(DWORD offset);
+
+
+// Non-throwing variants for monitoring loops: they return a status code instead and
+// neither throw nor allocate memory on the success or the failure path.
+
+RegisterStatus TryReadPciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD& value);
+RegisterStatus TryWritePciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD value);
+
+RegisterStatus TryRdmsr(DWORD index, QWORD& value, int cpu = CURRENT_CPU);
+RegisterStatus TryWrmsr(DWORD index, QWORD value, int cpu = CURRENT_CPU);
+
+RegisterStatus TryCpuid(DWORD index, CpuidRegs& regs, int cpu = CURRENT_CPU);
+
+RegisterStatus TryReadSmuRegisters(const DWORD* offsets, DWORD* values, int count);
+
+
+template <typename T> DWORD GetBits(T value, unsigned char offset, unsigned char numBits)
+{
+	const T mask = (((T)1 << numBits) - (T)1); // 2^numBits - 1; after right-shift
+	return (DWORD)((value >> offset) & mask);
+}
+
+template <typename T> void SetBits(T& value, DWORD bits, unsigned char offset, unsigned char numBits)
+{
+	const T mask = (((T)1 << numBits) - (T)1) << offset; // 2^numBits - 1, shifted by offset to the left
+	value = (value & ~mask) | (((T)bits << offset) & mask);
+}
@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#include "RegisterCache.h"
+
+using std::lock_guard;
+using std::mutex;
+
+
+// MSRs updated by hardware or by the OS behind our back
+static const DWORD VOLATILE_MSRS[] =
+{
+	0x00000010, // TSC
+	0x000000e7, // MPERF
+	0x000000e8, // APERF
+	0xc0010004, 0xc0010005, 0xc0010006, 0xc0010007, // performance event counters
+	0xc0010061, // P-state Current Limit
+	0xc0010062, // P-state Control
+	0xc0010063, // P-state Status
+	0xc0010070, // COFVID Control
+	0xc0010071, // COFVID Status
+	0
+};
+
+struct PciRegister
+{
+	DWORD Device;
+	DWORD Function;
+	DWORD RegAddress;
+};
+
+// PCI registers updated by hardware and data registers of index/data pairs
+static const PciRegister VOLATILE_PCI_REGISTERS[] =
+{
+	{ 0, 0, 0xb8 }, // D0F0xB8 index register (also written by ReadSmuIndirect() of the wrapped backend)
+	{ 0, 0, 0xbc }, // D0F0xBC data register
+	{ AMD_CPU_DEVICE, 2, 0xf4 }, // D18F2xF4 DRAM controller extra data port (offset in D18F2xF0)
+	{ AMD_CPU_DEVICE, 2, 0x1f4 }, // D18F2x1F4 (DCT1)
+	{ AMD_CPU_DEVICE, 3, 0x64 }, // D18F3x64 Hardware Thermal Control
+	{ AMD_CPU_DEVICE, 3, 0xa4 }, // D18F3xA4 Reported Temperature Control
+	{ AMD_CPU_DEVICE, 5, 0xe0 }, // D18F5xE0 Processor TDP Running Average
+	{ AMD_CPU_DEVICE, 5, 0x174 }, // D18F5x174 Northbridge P-state Status
+	{ 0, 0, 0 }
+};
+
+
+bool RegisterCache::IsMsrCacheable(DWORD index)
+{
+	for (int i = 0; VOLATILE_MSRS[i] != 0; i++)
+	{
+		if (VOLATILE_MSRS[i] == index)
+			return false;
+	}
+
+	return true;
+}
+
+bool RegisterCache::IsPciConfigCacheable(DWORD device, DWORD function, DWORD regAddress)
+{
+	// the registers of all nodes (devices 18h, 19h, ...) share the same layout
+	if (device > AMD_CPU_DEVICE && device < AMD_CPU_DEVICE + 8)
+		device = AMD_CPU_DEVICE;
+
+	for (int i = 0; VOLATILE_PCI_REGISTERS[i].RegAddress != 0; i++)
+	{
+		const PciRegister& reg = VOLATILE_PCI_REGISTERS[i];
+		if (reg.Device == device && reg.Function == function && reg.RegAddress == regAddress)
+			return false;
+	}
+
+	return true;
+}
+
+
+// accesses to CURRENT_CPU are cached for the CPU the thread is running on
+static QWORD CpuKey(int cpu, DWORD index)
+{
+	if (cpu == CURRENT_CPU)
+		cpu = GetCurrentCPU();
+
+	return ((QWORD)(unsigned int)cpu << 32) | index;
+}
+
+static QWORD PciKey(DWORD device, DWORD function, DWORD regAddress)
+{
+	return ((QWORD)device << 40) | ((QWORD)function << 32) | regAddress;
+}
+
+
+// the backend is accessed without holding the lock; a value read while a write was in flight is not cached
+template <typename Table, typename T> void RegisterCache::Insert(Table& table, QWORD key, const T& value, unsigned int generation)
+{
+	lock_guard<mutex> lock(_mutex);
+
+	if (generation == _generation)
+		table.Insert(key, value);
+}
+
+
+RegisterStatus RegisterCache::Rdmsr(int cpu, DWORD index, QWORD& value)
+{
+	if (!IsMsrCacheable(index))
+		return _backend->Rdmsr(cpu, index, value);
+
+	const QWORD key = CpuKey(cpu, index);
+
+	unsigned int generation;
+	{
+		lock_guard<mutex> lock(_mutex);
+
+		if (_msrs.Find(key, value))
+		{
+			_numHits++;
+			return REG_OK;
+		}
+
+		_numMisses++;
+		generation = _generation;
+	}
+
+	const RegisterStatus status = _backend->Rdmsr(cpu, index, value);
+	if (status != REG_OK)
+		return status;
+
+	Insert(_msrs, key, value, generation);
+	return REG_OK;
+}
+
+RegisterStatus RegisterCache::Wrmsr(int cpu, DWORD index, QWORD value)
+{
+	const RegisterStatus result = _backend->Wrmsr(cpu, index, value);
+
+	lock_guard<mutex> lock(_mutex);
+	_msrs.Erase(CpuKey(cpu, index));
+	_generation++;
+
+	return result;
+}
+
+
+RegisterStatus RegisterCache::ReadPciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD& value)
+{
+	if (!IsPciConfigCacheable(device, function, regAddress))
+		return _backend->ReadPciConfig(device, function, regAddress, value);
+
+	const QWORD key = PciKey(device, function, regAddress);
+
+	unsigned int generation;
+	{
+		lock_guard<mutex> lock(_mutex);
+
+		if (_pciRegisters.Find(key, value))
+		{
+			_numHits++;
+			return REG_OK;
+		}
+
+		_numMisses++;
+		generation = _generation;
+	}
+
+	const RegisterStatus status = _backend->ReadPciConfig(device, function, regAddress, value);
+	if (status != REG_OK)
+		return status;
+
+	Insert(_pciRegisters, key, value, generation);
+	return REG_OK;
+}
+
+RegisterStatus RegisterCache::WritePciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD value)
+{
+	const RegisterStatus result = _backend->WritePciConfig(device, function, regAddress, value);
+
+	lock_guard<mutex> lock(_mutex);
+	_pciRegisters.Erase(PciKey(device, function, regAddress));
+	_generation++;
+
+	return result;
+}
+
+
+RegisterStatus RegisterCache::Cpuid(int cpu, DWORD index, CpuidRegs& regs)
+{
+	const QWORD key = CpuKey(cpu, index);
+
+	unsigned int generation;
+	{
+		lock_guard<mutex> lock(_mutex);
+
+		if (_cpuidLeaves.Find(key, regs))
+		{
+			_numHits++;
+			return REG_OK;
+		}
+
+		_numMisses++;
+		generation = _generation;
+	}
+
+	const RegisterStatus status = _backend->Cpuid(cpu, index, regs);
+	if (status != REG_OK)
+		return status;
+
+	Insert(_cpuidLeaves, key, regs, generation);
+	return REG_OK;
+}
+
+
+void RegisterCache::Invalidate()
+{
+	lock_guard<mutex> lock(_mutex);
+
+	_msrs.Clear();
+	_pciRegisters.Clear();
+	_cpuidLeaves.Clear();
+	_generation++;
+}
+
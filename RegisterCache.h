@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include "RegisterAccess.h"
+
+
+/// <summary>
+/// Hash table of a fixed capacity (a power of 2) with linear probing, so that neither lookups nor inserts
+/// allocate memory (see the Try* accessors). Once it is full, further values are simply not stored.
+/// </summary>
+template <typename T, size_t Capacity> class FixedTable
+{
+	static_assert((Capacity & (Capacity - 1)) == 0, "the capacity must be a power of 2");
+
+public:
+
+	FixedTable() { Clear(); }
+
+	bool Find(QWORD key, T& value) const
+	{
+		const Slot* slot = Lookup(key);
+		if (slot == NULL)
+			return false;
+
+		value = slot->Value;
+		return true;
+	}
+
+	void Insert(QWORD key, const T& value)
+	{
+		// an existing entry is updated, otherwise the first free slot is taken
+		Slot* free = NULL;
+		for (size_t n = 0, i = Hash(key); n < Capacity; n++, i = (i + 1) & (Capacity - 1))
+		{
+			Slot& slot = _slots[i];
+			if (slot.Key == key)
+			{
+				slot.Value = value;
+				return;
+			}
+
+			if (slot.Key == ERASED && free == NULL)
+				free = &slot;
+
+			if (slot.Key == EMPTY)
+			{
+				if (free == NULL)
+					free = &slot;
+				break;
+			}
+		}
+
+		if (free != NULL)
+		{
+			free->Key = key;
+			free->Value = value;
+		}
+	}
+
+	void Erase(QWORD key)
+	{
+		Slot* slot = const_cast<Slot*>(Lookup(key));
+		if (slot != NULL)
+			slot->Key = ERASED;
+	}
+
+	void Clear()
+	{
+		for (size_t i = 0; i < Capacity; i++)
+			_slots[i].Key = EMPTY;
+	}
+
+
+private:
+
+	static const QWORD EMPTY = ~0ULL;
+	static const QWORD ERASED = ~0ULL - 1;
+
+	struct Slot
+	{
+		QWORD Key;
+		T Value;
+	};
+
+	static size_t Hash(QWORD key) { return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 40) & (Capacity - 1); }
+
+	const Slot* Lookup(QWORD key) const
+	{
+		for (size_t n = 0, i = Hash(key); n < Capacity; n++, i = (i + 1) & (Capacity - 1))
+		{
+			if (_slots[i].Key == key)
+				return &_slots[i];
+			if (_slots[i].Key == EMPTY)
+				break;
+		}
+
+		return NULL;
+	}
+
+	Slot _slots[Capacity];
+};
+
+
+/// <summary>
+/// Read-through shadow cache in front of another backend.
+/// MSRs are cached per (logical CPU, index), PCI registers per (device = node, function, offset) and
+/// CPUID leaves per (logical CPU, leaf). Writes go straight to the wrapped backend and invalidate the
+/// corresponding entry. Registers updated by hardware (status registers, counters, the data registers
+/// of index/data pairs) are never cached. The tables have a fixed capacity, so no access allocates memory.
+/// </summary>
+class RegisterCache : public RegisterBackend
+{
+public:
+
+	/// <summary>Wraps an initialized backend and takes ownership of it.</summary>
+	explicit RegisterCache(RegisterBackend* backend)
+		: _backend(backend)
+		, _generation(0)
+		, _numHits(0)
+		, _numMisses(0)
+	{ }
+
+	~RegisterCache() { delete _backend; }
+
+	const char* GetName() const { return _backend->GetName(); }
+
+	bool Initialize() { return true; }
+
+	bool IsCpuAddressable() const { return _backend->IsCpuAddressable(); }
+
+	int GetNumCPUs() const { return _backend->GetNumCPUs(); }
+
+	RegisterStatus Rdmsr(int cpu, DWORD index, QWORD& value);
+	RegisterStatus Wrmsr(int cpu, DWORD index, QWORD value);
+
+	RegisterStatus ReadPciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD& value);
+	RegisterStatus WritePciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD value);
+
+	RegisterStatus Cpuid(int cpu, DWORD index, CpuidRegs& regs);
+
+	RegisterStatus ReadSmuIndirect(const DWORD* offsets, DWORD* values, int count) { return _backend->ReadSmuIndirect(offsets, values, count); }
+
+	/// <summary>Drops all cached values.</summary>
+	void Invalidate();
+
+	int GetNumHits() const { return _numHits; }
+	int GetNumMisses() const { return _numMisses; }
+
+	static bool IsMsrCacheable(DWORD index);
+	static bool IsPciConfigCacheable(DWORD device, DWORD function, DWORD regAddress);
+
+
+private:
+
+	template <typename Table, typename T> void Insert(Table& table, QWORD key, const T& value, unsigned int generation);
+
+	RegisterBackend* _backend;
+
+	std::mutex _mutex;
+	FixedTable<QWORD, 4096> _msrs;             // e.g., 20 MSRs on each of 128 logical CPUs
+	FixedTable<DWORD, 2048> _pciRegisters;
+	FixedTable<CpuidRegs, 1024> _cpuidLeaves;
+	unsigned int _generation; // incremented by every write
+
+	int _numHits;
+	int _numMisses;
+};
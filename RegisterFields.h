@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#pragma once
+
+#include <cassert>
+#include <type_traits>
+#include "Platform.h"
+
+
+/// <summary>
+/// Compile-time descriptor of the bit field [Hi:Lo] of a register of type T (DWORD or QWORD).
+/// Extracting and inserting boil down to constant shifts and masks; the values themselves are only known
+/// at runtime, so Make() and Insert() assert that they fit into the field.
+/// </summary>
+template <typename T, unsigned Hi, unsigned Lo> struct Field
+{
+	static_assert(Hi >= Lo, "the high bit of a field must not be below its low bit");
+	static_assert(Hi < sizeof(T) * 8, "the field exceeds the register");
+	static_assert(Hi - Lo < 32, "fields are limited to 32 bits");
+
+	typedef T RegisterType;
+
+	static const unsigned Offset = Lo;
+	static const unsigned Width = Hi - Lo + 1;
+
+	/// <summary>Largest value the field can hold.</summary>
+	static constexpr DWORD Max() { return (DWORD)(~(T)0 >> (sizeof(T) * 8 - Width)); }
+
+	/// <summary>Register bits occupied by the field.</summary>
+	static constexpr T Mask() { return (T)Max() << Lo; }
+
+	static constexpr DWORD Get(T reg) { return (DWORD)((reg >> Lo) & Max()); }
+
+	/// <summary>Returns the value shifted into place. The value must not exceed Max().</summary>
+	static constexpr T Make(DWORD value) { return (assert(value <= Max()), ((T)value << Lo) & Mask()); }
+
+	static constexpr T Insert(T reg, DWORD value) { return (reg & ~Mask()) | Make(value); }
+};
+
+
+/// <summary>
+/// A field whose value is spread over two bit ranges of the same register, e.g., NbVid[6:0] in D18F5x16x[16:10]
+/// and NbVid[7] in D18F5x16x[21]. Low holds the least significant bits of the value.
+/// </summary>
+template <typename Low, typename High> struct SplitField
+{
+	typedef typename Low::RegisterType T;
+
+	static_assert(std::is_same<T, typename High::RegisterType>::value, "both parts must belong to the same register");
+	static_assert((Low::Mask() & High::Mask()) == 0, "the parts must not overlap");
+
+	typedef T RegisterType;
+
+	static const unsigned Width = Low::Width + High::Width;
+
+	static constexpr DWORD Max() { return Low::Max() | (High::Max() << Low::Width); }
+	static constexpr T Mask() { return Low::Mask() | High::Mask(); }
+
+	static constexpr DWORD Get(T reg) { return Low::Get(reg) | (High::Get(reg) << Low::Width); }
+	static constexpr T Make(DWORD value)
+	{
+		return (assert(value <= Max()), Low::Make(value & Low::Max()) | High::Make(value >> Low::Width));
+	}
+	static constexpr T Insert(T reg, DWORD value) { return (reg & ~Mask()) | Make(value); }
+};
+
+
+/// <summary>
+/// Several fields of the same register, e.g., CpuFid and CpuDid, encoded in a single pass.
+/// The values are passed in the order of the fields.
+/// </summary>
+template <typename... Fields> struct FieldSet;
+
+template <typename F> struct FieldSet<F>
+{
+	typedef typename F::RegisterType RegisterType;
+
+	static constexpr RegisterType Mask() { return F::Mask(); }
+	static constexpr RegisterType Make(DWORD value) { return F::Make(value); }
+	static constexpr RegisterType Insert(RegisterType reg, DWORD value) { return F::Insert(reg, value); }
+};
+
+template <typename F, typename... Rest> struct FieldSet<F, Rest...>
+{
+	typedef typename F::RegisterType RegisterType;
+
+	static_assert(std::is_same<RegisterType, typename FieldSet<Rest...>::RegisterType>::value, "all fields must belong to the same register");
+	static_assert((F::Mask() & FieldSet<Rest...>::Mask()) == 0, "the fields must not overlap");
+
+	static constexpr RegisterType Mask() { return F::Mask() | FieldSet<Rest...>::Mask(); }
+
+	template <typename... Values> static constexpr RegisterType Make(DWORD value, Values... rest)
+	{
+		return F::Make(value) | FieldSet<Rest...>::Make(rest...);
+	}
+
+	template <typename... Values> static constexpr RegisterType Insert(RegisterType reg, Values... values)
+	{
+		return (reg & ~Mask()) | Make(values...);
+	}
+};
@@ -0,0 +1,392 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#include <cstring>
+#include "RegisterLog.h"
+#include "RegisterTransaction.h"
+#include "StringUtils.h"
+
+using std::string;
+using std::vector;
+
+
+static DWORD PciAddress(DWORD device, DWORD function, DWORD regAddress)
+{
+	return (device << 16) | (function << 12) | regAddress;
+}
+
+static QWORD MakeKey(RegisterLogKind kind, int cpu, DWORD address)
+{
+	return ((QWORD)kind << 56) | ((QWORD)(unsigned short)cpu << 32) | address;
+}
+
+static string Describe(RegisterLogKind kind, int cpu, DWORD address)
+{
+	switch (kind)
+	{
+		case LOG_RDMSR:
+		case LOG_WRMSR:
+			return RegisterId::Msr(address, cpu).ToString();
+
+		case LOG_READ_PCI:
+		case LOG_WRITE_PCI:
+			return RegisterId::Pci(address >> 16, (address >> 12) & 0xF, address & 0xFFF).ToString();
+
+		default:
+			return "CPUID 0x" + StringUtils::ToHexString(address) + (cpu == CURRENT_CPU ? string() : " (CPU " + StringUtils::ToString(cpu) + ")");
+	}
+}
+
+
+RecordingBackend::RecordingBackend(RegisterBackend* backend, const char* path)
+	: _backend(backend)
+	, _path(path)
+	, _numBuffered(0)
+{
+}
+
+RecordingBackend::~RecordingBackend()
+{
+	Flush();
+	delete _backend;
+}
+
+bool RecordingBackend::Initialize()
+{
+	_file.open(_path.c_str(), std::ios::binary | std::ios::trunc);
+	if (!_file)
+		return false;
+
+	RegisterLogHeader header;
+	memcpy(header.Magic, REGISTER_LOG_MAGIC, sizeof(header.Magic));
+	header.Version = REGISTER_LOG_VERSION;
+	header.NumCPUs = _backend->GetNumCPUs();
+	header.Reserved = 0;
+
+	_file.write((const char*)&header, sizeof(header));
+	return _file.good();
+}
+
+void RecordingBackend::Append(RegisterLogKind kind, RegisterStatus status, int cpu, DWORD address, DWORD d0, DWORD d1, DWORD d2, DWORD d3)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	RegisterLogRecord& record = _buffer[_numBuffered++];
+	record.Kind = (unsigned char)kind;
+	record.Status = (unsigned char)status;
+	record.Cpu = (short)cpu;
+	record.Address = address;
+	record.Data[0] = d0;
+	record.Data[1] = d1;
+	record.Data[2] = d2;
+	record.Data[3] = d3;
+
+	if (_numBuffered == BUFFER_SIZE)
+	{
+		_file.write((const char*)_buffer, _numBuffered * sizeof(RegisterLogRecord));
+		_numBuffered = 0;
+	}
+}
+
+void RecordingBackend::Flush()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (_file.is_open())
+	{
+		_file.write((const char*)_buffer, _numBuffered * sizeof(RegisterLogRecord));
+		_file.flush();
+	}
+
+	_numBuffered = 0;
+}
+
+
+RegisterStatus RecordingBackend::Rdmsr(int cpu, DWORD index, QWORD& value)
+{
+	value = 0;
+	const RegisterStatus status = _backend->Rdmsr(cpu, index, value);
+	Append(LOG_RDMSR, status, cpu, index, (DWORD)value, (DWORD)(value >> 32));
+	return status;
+}
+
+RegisterStatus RecordingBackend::Wrmsr(int cpu, DWORD index, QWORD value)
+{
+	const RegisterStatus status = _backend->Wrmsr(cpu, index, value);
+	Append(LOG_WRMSR, status, cpu, index, (DWORD)value, (DWORD)(value >> 32));
+	return status;
+}
+
+RegisterStatus RecordingBackend::ReadPciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD& value)
+{
+	value = 0;
+	const RegisterStatus status = _backend->ReadPciConfig(device, function, regAddress, value);
+	Append(LOG_READ_PCI, status, CURRENT_CPU, PciAddress(device, function, regAddress), value);
+	return status;
+}
+
+RegisterStatus RecordingBackend::WritePciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD value)
+{
+	const RegisterStatus status = _backend->WritePciConfig(device, function, regAddress, value);
+	Append(LOG_WRITE_PCI, status, CURRENT_CPU, PciAddress(device, function, regAddress), value);
+	return status;
+}
+
+RegisterStatus RecordingBackend::Cpuid(int cpu, DWORD index, CpuidRegs& regs)
+{
+	regs.eax = regs.ebx = regs.ecx = regs.edx = 0;
+	const RegisterStatus status = _backend->Cpuid(cpu, index, regs);
+	Append(LOG_CPUID, status, cpu, index, regs.eax, regs.ebx, regs.ecx, regs.edx);
+	return status;
+}
+
+
+
+bool ReplayBackend::Initialize()
+{
+	std::ifstream file(_path.c_str(), std::ios::binary);
+	if (!file)
+		return false;
+
+	RegisterLogHeader header;
+	if (!file.read((char*)&header, sizeof(header)) ||
+	    memcmp(header.Magic, REGISTER_LOG_MAGIC, sizeof(header.Magic)) != 0 ||
+	    header.Version != REGISTER_LOG_VERSION)
+		return false;
+
+	_numCPUs = (int)header.NumCPUs;
+
+	RegisterLogRecord record;
+	while (file.read((char*)&record, sizeof(record)))
+	{
+		if (record.Kind < LOG_RDMSR || record.Kind > LOG_CPUID)
+			return false;
+
+		Sequence& sequence = _sequences[MakeKey((RegisterLogKind)record.Kind, record.Cpu, record.Address)];
+		sequence.Records.push_back(record);
+		sequence.Next = 0;
+	}
+
+	// a truncated last record is tolerated (e.g., the recording process crashed)
+	return true;
+}
+
+ReplayBackend::Sequence* ReplayBackend::Find(RegisterLogKind kind, int cpu, DWORD address)
+{
+	std::unordered_map<QWORD, Sequence>::iterator it = _sequences.find(MakeKey(kind, cpu, address));
+
+	// a recording made with a backend which is not CPU-addressable only knows CURRENT_CPU
+	if (it == _sequences.end() && cpu != CURRENT_CPU)
+		it = _sequences.find(MakeKey(kind, CURRENT_CPU, address));
+
+	return (it == _sequences.end() ? NULL : &it->second);
+}
+
+void ReplayBackend::AddMismatch(const char* what, RegisterLogKind kind, int cpu, DWORD address)
+{
+	_mismatches.push_back(string(what) + " " + Describe(kind, cpu, address));
+}
+
+const RegisterLogRecord* ReplayBackend::Read(RegisterLogKind kind, int cpu, DWORD address)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	Sequence* sequence = Find(kind, cpu, address);
+	if (sequence == NULL)
+	{
+		AddMismatch("unrecorded read of", kind, cpu, address);
+		return NULL;
+	}
+
+	const RegisterLogRecord* record = &sequence->Records[sequence->Next];
+	if (sequence->Next + 1 < sequence->Records.size())
+		sequence->Next++;
+
+	return record;
+}
+
+const RegisterLogRecord* ReplayBackend::Write(RegisterLogKind kind, int cpu, DWORD address, DWORD d0, DWORD d1)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	Sequence* sequence = Find(kind, cpu, address);
+	if (sequence == NULL || sequence->Next >= sequence->Records.size())
+	{
+		AddMismatch("unexpected write to", kind, cpu, address);
+		return NULL;
+	}
+
+	const RegisterLogRecord* record = &sequence->Records[sequence->Next++];
+	if (record->Data[0] != d0 || record->Data[1] != d1)
+	{
+		string what = "differing write (0x" + StringUtils::ToHexString(((QWORD)d1 << 32) | d0) +
+			" instead of 0x" + StringUtils::ToHexString(((QWORD)record->Data[1] << 32) | record->Data[0]) + ") to";
+		AddMismatch(what.c_str(), kind, cpu, address);
+	}
+
+	return record;
+}
+
+vector<string> ReplayBackend::GetMismatches() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	vector<string> result = _mismatches;
+
+	for (std::unordered_map<QWORD, Sequence>::const_iterator it = _sequences.begin(); it != _sequences.end(); ++it)
+	{
+		const RegisterLogRecord& first = it->second.Records[0];
+		if ((first.Kind == LOG_WRMSR || first.Kind == LOG_WRITE_PCI) && it->second.Next < it->second.Records.size())
+			result.push_back("missing write to " + Describe((RegisterLogKind)first.Kind, first.Cpu, first.Address));
+	}
+
+	return result;
+}
+
+
+RegisterStatus ReplayBackend::Rdmsr(int cpu, DWORD index, QWORD& value)
+{
+	const RegisterLogRecord* record = Read(LOG_RDMSR, cpu, index);
+	if (record == NULL)
+		return REG_ACCESS_FAILED;
+
+	value = ((QWORD)record->Data[1] << 32) | record->Data[0];
+	return (RegisterStatus)record->Status;
+}
+
+RegisterStatus ReplayBackend::Wrmsr(int cpu, DWORD index, QWORD value)
+{
+	// unexpected writes only count as mismatches so that the replay can go on
+	const RegisterLogRecord* record = Write(LOG_WRMSR, cpu, index, (DWORD)value, (DWORD)(value >> 32));
+	return (record == NULL ? REG_OK : (RegisterStatus)record->Status);
+}
+
+RegisterStatus ReplayBackend::ReadPciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD& value)
+{
+	const RegisterLogRecord* record = Read(LOG_READ_PCI, CURRENT_CPU, PciAddress(device, function, regAddress));
+	if (record == NULL)
+		return REG_NOT_PRESENT;
+
+	value = record->Data[0];
+	return (RegisterStatus)record->Status;
+}
+
+RegisterStatus ReplayBackend::WritePciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD value)
+{
+	const RegisterLogRecord* record = Write(LOG_WRITE_PCI, CURRENT_CPU, PciAddress(device, function, regAddress), value, 0);
+	return (record == NULL ? REG_OK : (RegisterStatus)record->Status);
+}
+
+RegisterStatus ReplayBackend::Cpuid(int cpu, DWORD index, CpuidRegs& regs)
+{
+	const RegisterLogRecord* record = Read(LOG_CPUID, cpu, index);
+	if (record == NULL)
+		return REG_ACCESS_FAILED;
+
+	regs.eax = record->Data[0];
+	regs.ebx = record->Data[1];
+	regs.ecx = record->Data[2];
+	regs.edx = record->Data[3];
+	return (RegisterStatus)record->Status;
+}
+
+
+
+bool SimulatedBackend::Initialize()
+{
+	std::ifstream file(_path.c_str(), std::ios::binary);
+	if (!file)
+		return false;
+
+	RegisterLogHeader header;
+	if (!file.read((char*)&header, sizeof(header)) ||
+	    memcmp(header.Magic, REGISTER_LOG_MAGIC, sizeof(header.Magic)) != 0 ||
+	    header.Version != REGISTER_LOG_VERSION)
+		return false;
+
+	_numCPUs = (int)header.NumCPUs;
+
+	const DWORD smuIndex = PciAddress(0, 0, 0xB8);
+	const DWORD smuData = PciAddress(0, 0, 0xBC);
+	DWORD smuOffset = 0;
+
+	RegisterLogRecord record;
+	while (file.read((char*)&record, sizeof(record)))
+	{
+		if (record.Kind < LOG_RDMSR || record.Kind > LOG_CPUID)
+			return false;
+
+		// the SMU accesses were logged as an index write followed by a data read
+		if (record.Kind == LOG_WRITE_PCI && record.Address == smuIndex)
+			smuOffset = record.Data[0];
+		else if (record.Kind == LOG_READ_PCI && record.Address == smuData && record.Status == REG_OK)
+			_smuRegisters[smuOffset] = record.Data[0];
+
+		if (record.Kind == LOG_RDMSR || record.Kind == LOG_READ_PCI || record.Kind == LOG_CPUID)
+			_registers[MakeKey((RegisterLogKind)record.Kind, record.Cpu, record.Address)] = record;
+	}
+
+	return true;
+}
+
+const RegisterLogRecord* SimulatedBackend::Find(RegisterLogKind kind, int cpu, DWORD address) const
+{
+	std::unordered_map<QWORD, RegisterLogRecord>::const_iterator it = _registers.find(MakeKey(kind, cpu, address));
+
+	// a recording made with a backend which is not CPU-addressable only knows CURRENT_CPU
+	if (it == _registers.end() && cpu != CURRENT_CPU)
+		it = _registers.find(MakeKey(kind, CURRENT_CPU, address));
+
+	return (it == _registers.end() ? NULL : &it->second);
+}
+
+RegisterStatus SimulatedBackend::Rdmsr(int cpu, DWORD index, QWORD& value)
+{
+	const RegisterLogRecord* record = Find(LOG_RDMSR, cpu, index);
+	if (record == NULL)
+		return REG_ACCESS_FAILED;
+
+	value = ((QWORD)record->Data[1] << 32) | record->Data[0];
+	return (RegisterStatus)record->Status;
+}
+
+RegisterStatus SimulatedBackend::ReadPciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD& value)
+{
+	const RegisterLogRecord* record = Find(LOG_READ_PCI, CURRENT_CPU, PciAddress(device, function, regAddress));
+	if (record == NULL)
+		return REG_NOT_PRESENT;
+
+	value = record->Data[0];
+	return (RegisterStatus)record->Status;
+}
+
+RegisterStatus SimulatedBackend::Cpuid(int cpu, DWORD index, CpuidRegs& regs)
+{
+	const RegisterLogRecord* record = Find(LOG_CPUID, cpu, index);
+	if (record == NULL)
+		return REG_ACCESS_FAILED;
+
+	regs.eax = record->Data[0];
+	regs.ebx = record->Data[1];
+	regs.ecx = record->Data[2];
+	regs.edx = record->Data[3];
+	return (RegisterStatus)record->Status;
+}
+
+RegisterStatus SimulatedBackend::ReadSmuIndirect(const DWORD* offsets, DWORD* values, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		std::unordered_map<DWORD, DWORD>::const_iterator it = _smuRegisters.find(offsets[i]);
+		if (it == _smuRegisters.end())
+			return REG_NOT_PRESENT;
+
+		values[i] = it->second;
+	}
+
+	return REG_OK;
+}
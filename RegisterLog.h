@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#pragma once
+
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "RegisterAccess.h"
+
+
+// Binary register access log:
+// a RegisterLogHeader followed by any number of 24-byte RegisterLogRecords (little endian).
+
+static const char REGISTER_LOG_MAGIC[4] = { 'A', 'M', 'T', 'R' };
+static const DWORD REGISTER_LOG_VERSION = 1;
+
+struct RegisterLogHeader
+{
+	char Magic[4];
+	DWORD Version;
+	DWORD NumCPUs;  // logical CPUs of the recorded system
+	DWORD Reserved;
+};
+
+enum RegisterLogKind
+{
+	LOG_RDMSR = 1,
+	LOG_WRMSR,
+	LOG_READ_PCI,
+	LOG_WRITE_PCI,
+	LOG_CPUID
+};
+
+struct RegisterLogRecord
+{
+	unsigned char Kind;   // RegisterLogKind
+	unsigned char Status; // RegisterStatus
+	short Cpu;            // as passed by the caller (CURRENT_CPU included), -1 for PCI accesses
+	DWORD Address;        // MSR index, CPUID leaf or device << 16 | function << 12 | register
+	DWORD Data[4];        // MSR: low, high; PCI: value; CPUID: eax, ebx, ecx, edx
+};
+
+static_assert(sizeof(RegisterLogHeader) == 16, "unexpected register log header layout");
+static_assert(sizeof(RegisterLogRecord) == 24, "unexpected register log record layout");
+
+
+/// <summary>
+/// Forwards all accesses to another backend and appends them, including the returned status,
+/// to a register log. The SMU index/data pair accesses are logged as plain PCI accesses.
+/// </summary>
+class RecordingBackend : public RegisterBackend
+{
+public:
+
+	/// <summary>Wraps an initialized backend and takes ownership of it.</summary>
+	RecordingBackend(RegisterBackend* backend, const char* path);
+
+	~RecordingBackend();
+
+	const char* GetName() const { return _backend->GetName(); }
+
+	/// <summary>Returns false if the log file cannot be created.</summary>
+	bool Initialize();
+
+	bool IsCpuAddressable() const { return _backend->IsCpuAddressable(); }
+
+	int GetNumCPUs() const { return _backend->GetNumCPUs(); }
+
+	RegisterStatus Rdmsr(int cpu, DWORD index, QWORD& value);
+	RegisterStatus Wrmsr(int cpu, DWORD index, QWORD value);
+
+	RegisterStatus ReadPciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD& value);
+	RegisterStatus WritePciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD value);
+
+	RegisterStatus Cpuid(int cpu, DWORD index, CpuidRegs& regs);
+
+
+private:
+
+	static const int BUFFER_SIZE = 1024; // records
+
+	void Append(RegisterLogKind kind, RegisterStatus status, int cpu, DWORD address, DWORD d0, DWORD d1 = 0, DWORD d2 = 0, DWORD d3 = 0);
+	void Flush();
+
+	RegisterBackend* _backend;
+	std::string _path;
+	std::ofstream _file;
+
+	std::mutex _mutex;
+	RegisterLogRecord _buffer[BUFFER_SIZE];
+	int _numBuffered;
+};
+
+
+/// <summary>
+/// Serves all accesses from a register log, without touching the hardware. Reads return the logged
+/// values of the same register in logged order (repeating the last one once they are used up); writes
+/// are compared against the logged writes. Any deviation is collected as a mismatch.
+/// </summary>
+class ReplayBackend : public RegisterBackend
+{
+public:
+
+	explicit ReplayBackend(const char* path)
+		: _path(path)
+		, _numCPUs(0)
+	{ }
+
+	const char* GetName() const { return "Replay"; }
+
+	/// <summary>Loads the log; returns false if it cannot be read or is invalid.</summary>
+	bool Initialize();
+
+	bool IsCpuAddressable() const { return true; }
+
+	int GetNumCPUs() const { return _numCPUs; }
+
+	RegisterStatus Rdmsr(int cpu, DWORD index, QWORD& value);
+	RegisterStatus Wrmsr(int cpu, DWORD index, QWORD value);
+
+	RegisterStatus ReadPciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD& value);
+	RegisterStatus WritePciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD value);
+
+	RegisterStatus Cpuid(int cpu, DWORD index, CpuidRegs& regs);
+
+	/// <summary>Returns descriptions of all unexpected, missing or differing accesses so far.</summary>
+	std::vector<std::string> GetMismatches() const;
+
+
+private:
+
+	struct Sequence
+	{
+		std::vector<RegisterLogRecord> Records;
+		size_t Next;
+	};
+
+	const RegisterLogRecord* Read(RegisterLogKind kind, int cpu, DWORD address);
+	const RegisterLogRecord* Write(RegisterLogKind kind, int cpu, DWORD address, DWORD d0, DWORD d1);
+	Sequence* Find(RegisterLogKind kind, int cpu, DWORD address);
+
+	void AddMismatch(const char* what, RegisterLogKind kind, int cpu, DWORD address);
+
+	std::string _path;
+	int _numCPUs;
+
+	mutable std::mutex _mutex;
+	std::unordered_map<QWORD, Sequence> _sequences; // per (kind, cpu, address)
+	std::vector<std::string> _mismatches;
+};
+
+
+/// <summary>
+/// Serves reads from a register log without ordering, verification or locking: every register returns
+/// its last logged value (the SMU registers behind D0F0xB8/D0F0xBC included) and writes are ignored.
+/// Models the cheapest possible backend, e.g., for benchmarks on machines without the hardware.
+/// </summary>
+class SimulatedBackend : public RegisterBackend
+{
+public:
+
+	explicit SimulatedBackend(const char* path)
+		: _path(path)
+		, _numCPUs(0)
+	{ }
+
+	const char* GetName() const { return "Simulated"; }
+
+	/// <summary>Loads the log; returns false if it cannot be read or is invalid.</summary>
+	bool Initialize();
+
+	bool IsCpuAddressable() const { return true; }
+
+	int GetNumCPUs() const { return _numCPUs; }
+
+	RegisterStatus Rdmsr(int cpu, DWORD index, QWORD& value);
+	RegisterStatus Wrmsr(int, DWORD, QWORD) { return REG_OK; }
+
+	RegisterStatus ReadPciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD& value);
+	RegisterStatus WritePciConfig(DWORD, DWORD, DWORD, DWORD) { return REG_OK; }
+
+	RegisterStatus Cpuid(int cpu, DWORD index, CpuidRegs& regs);
+
+	RegisterStatus ReadSmuIndirect(const DWORD* offsets, DWORD* values, int count);
+
+
+private:
+
+	const RegisterLogRecord* Find(RegisterLogKind kind, int cpu, DWORD address) const;
+
+	std::string _path;
+	int _numCPUs;
+
+	// immutable after Initialize()
+	std::unordered_map<QWORD, RegisterLogRecord> _registers; // last read per (kind, cpu, address)
+	std::unordered_map<DWORD, DWORD> _smuRegisters;          // D0F0xBC_x[offset]
+};
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#include <cstring>
+#include <fstream>
+#include "RegisterSnapshot.h"
+
+
+void RegisterSnapshot::Add(const RegisterId& reg, int cpuIndex, QWORD value)
+{
+	SnapshotEntry entry;
+	entry.Register = reg;
+	entry.CpuIndex = cpuIndex;
+	entry.Value = value;
+
+	// the CPU is determined by the index when restoring, the backend may differ
+	if (reg.Type == MSR_REGISTER)
+		entry.Register.Cpu = CURRENT_CPU;
+
+	Entries.push_back(entry);
+}
+
+
+bool RegisterSnapshot::Save(const char* path) const
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+
+	RegisterSnapshotHeader header;
+	memcpy(header.Magic, REGISTER_SNAPSHOT_MAGIC, sizeof(header.Magic));
+	header.Version = REGISTER_SNAPSHOT_VERSION;
+	header.Family = (DWORD)Family;
+	header.Model = (DWORD)Model;
+	header.NumCPUs = (DWORD)NumCPUs;
+	header.NumEntries = (DWORD)Entries.size();
+
+	file.write((const char*)&header, sizeof(header));
+
+	for (size_t i = 0; i < Entries.size(); i++)
+	{
+		const SnapshotEntry& entry = Entries[i];
+		const RegisterId& reg = entry.Register;
+
+		RegisterSnapshotRecord record;
+		record.Type = (unsigned char)reg.Type;
+		record.Reserved = 0;
+		record.CpuIndex = (short)entry.CpuIndex;
+		record.Address = (reg.Type == MSR_REGISTER ? reg.Address : (reg.Device << 16) | (reg.Function << 12) | reg.Address);
+		record.Value = entry.Value;
+
+		file.write((const char*)&record, sizeof(record));
+	}
+
+	file.flush();
+	return file.good();
+}
+
+bool RegisterSnapshot::Load(const char* path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	RegisterSnapshotHeader header;
+	if (!file.read((char*)&header, sizeof(header)) ||
+	    memcmp(header.Magic, REGISTER_SNAPSHOT_MAGIC, sizeof(header.Magic)) != 0 ||
+	    header.Version != REGISTER_SNAPSHOT_VERSION)
+		return false;
+
+	std::vector<SnapshotEntry> entries;
+
+	for (DWORD i = 0; i < header.NumEntries; i++)
+	{
+		RegisterSnapshotRecord record;
+		if (!file.read((char*)&record, sizeof(record)))
+			return false;
+
+		if (record.CpuIndex < -1 || record.CpuIndex >= (int)header.NumCPUs)
+			return false;
+
+		SnapshotEntry entry;
+		entry.CpuIndex = record.CpuIndex;
+		entry.Value = record.Value;
+
+		if (record.Type == MSR_REGISTER)
+			entry.Register = RegisterId::Msr(record.Address, CURRENT_CPU);
+		else if (record.Type == PCI_REGISTER && record.CpuIndex == -1)
+			entry.Register = RegisterId::Pci(record.Address >> 16, (record.Address >> 12) & 0xF, record.Address & 0xFFF);
+		else
+			return false;
+
+		entries.push_back(entry);
+	}
+
+	Family = (int)header.Family;
+	Model = (int)header.Model;
+	NumCPUs = (int)header.NumCPUs;
+	Entries.swap(entries);
+
+	return true;
+}
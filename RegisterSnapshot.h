@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#pragma once
+
+#include <vector>
+#include "RegisterTransaction.h"
+
+
+// Binary register snapshot:
+// a RegisterSnapshotHeader followed by NumEntries 16-byte RegisterSnapshotRecords (little endian).
+
+static const char REGISTER_SNAPSHOT_MAGIC[4] = { 'A', 'M', 'T', 'S' };
+static const DWORD REGISTER_SNAPSHOT_VERSION = 1;
+
+struct RegisterSnapshotHeader
+{
+	char Magic[4];
+	DWORD Version;
+	DWORD Family;     // of the CPU the snapshot was taken on
+	DWORD Model;
+	DWORD NumCPUs;    // logical CPUs
+	DWORD NumEntries;
+};
+
+struct RegisterSnapshotRecord
+{
+	unsigned char Type; // RegisterType
+	unsigned char Reserved;
+	short CpuIndex;     // logical CPU the MSR was read on, -1 for node-wide registers
+	DWORD Address;      // MSR index or device << 16 | function << 12 | register
+	QWORD Value;
+};
+
+static_assert(sizeof(RegisterSnapshotHeader) == 24, "unexpected register snapshot header layout");
+static_assert(sizeof(RegisterSnapshotRecord) == 16, "unexpected register snapshot record layout");
+
+
+struct SnapshotEntry
+{
+	RegisterId Register; // MSRs: Cpu is CURRENT_CPU, the register is accessed on CpuIndex
+	int CpuIndex;        // logical CPU, -1 for node-wide registers
+	QWORD Value;
+};
+
+
+/// <summary>
+/// The original values of all registers an apply is going to write (see Worker::Snapshot()), used to
+/// roll back a failed apply and, saved to a file, to restore them later on.
+/// </summary>
+class RegisterSnapshot
+{
+public:
+
+	int Family;
+	int Model;
+	int NumCPUs;
+	std::vector<SnapshotEntry> Entries;
+
+	RegisterSnapshot() : Family(0), Model(0), NumCPUs(0) { }
+
+	void Add(const RegisterId& reg, int cpuIndex, QWORD value);
+
+	bool IsEmpty() const { return Entries.empty(); }
+
+	/// <summary>Writes the snapshot to a file and flushes it. Returns false if the file cannot be written.</summary>
+	bool Save(const char* path) const;
+
+	/// <summary>Replaces the snapshot by the one saved in a file. Returns false if it cannot be read or is invalid.</summary>
+	bool Load(const char* path);
+};
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#include <iomanip>
+#include <sstream>
+#include "RegisterTransaction.h"
+
+using std::ostream;
+using std::string;
+using std::stringstream;
+
+
+RegisterId RegisterId::Msr(DWORD index, int cpu)
+{
+	RegisterId result;
+	result.Type = MSR_REGISTER;
+	result.Cpu = cpu;
+	result.Device = 0;
+	result.Function = 0;
+	result.Address = index;
+	return result;
+}
+
+RegisterId RegisterId::Pci(DWORD device, DWORD function, DWORD regAddress)
+{
+	RegisterId result;
+	result.Type = PCI_REGISTER;
+	result.Cpu = CURRENT_CPU;
+	result.Device = device;
+	result.Function = function;
+	result.Address = regAddress;
+	return result;
+}
+
+bool RegisterId::operator==(const RegisterId& other) const
+{
+	return (Type == other.Type && Cpu == other.Cpu && Device == other.Device &&
+	        Function == other.Function && Address == other.Address);
+}
+
+string RegisterId::ToString() const
+{
+	stringstream ss;
+	ss << std::hex << std::uppercase << std::setfill('0');
+
+	if (Type == MSR_REGISTER)
+	{
+		ss << "MSR" << std::setw(4) << (Address >> 16) << "_" << std::setw(4) << (Address & 0xffff);
+		if (Cpu != CURRENT_CPU)
+			ss << std::dec << " (CPU " << Cpu << ")";
+	}
+	else
+		ss << "D" << Device << "F" << Function << "x" << Address;
+
+	return ss.str();
+}
+
+
+void RegisterTransaction::SetMsrMasked(DWORD index, QWORD mask, QWORD value, int cpu)
+{
+	SetMasked(RegisterId::Msr(index, cpu), mask, value & mask);
+}
+
+void RegisterTransaction::SetPciMasked(DWORD device, DWORD function, DWORD regAddress, DWORD mask, DWORD value)
+{
+	SetMasked(RegisterId::Pci(device, function, regAddress), mask, value & mask);
+}
+
+void RegisterTransaction::SetMasked(const RegisterId& reg, QWORD mask, QWORD value)
+{
+	RegisterChange* change = NULL;
+	for (size_t i = 0; i < _changes.size(); i++)
+	{
+		if (_changes[i].Register == reg)
+		{
+			change = &_changes[i];
+			break;
+		}
+	}
+
+	if (change == NULL)
+	{
+		RegisterChange newChange;
+		newChange.Register = reg;
+		newChange.Mask = 0;
+		newChange.Value = 0;
+		newChange.HasCurrent = false;
+		newChange.Current = 0;
+
+		_changes.push_back(newChange);
+		change = &_changes.back();
+	}
+
+	// later updates of the same bits override earlier ones
+	change->Mask |= mask;
+	change->Value = (change->Value & ~mask) | value;
+}
+
+
+static QWORD Read(const RegisterId& reg)
+{
+	if (reg.Type == MSR_REGISTER)
+		return Rdmsr(reg.Address, reg.Cpu);
+
+	return ReadPciConfig(reg.Device, reg.Function, reg.Address);
+}
+
+int RegisterTransaction::RemoveNoOps()
+{
+	const size_t numChanges = _changes.size();
+
+	size_t n = 0;
+	for (size_t i = 0; i < _changes.size(); i++)
+	{
+		RegisterChange& change = _changes[i];
+		change.Current = Read(change.Register);
+		change.HasCurrent = true;
+
+		if ((change.Current & change.Mask) != change.Value)
+			_changes[n++] = change;
+	}
+
+	_changes.resize(n);
+
+	return (int)(numChanges - n);
+}
+
+
+void RegisterTransaction::Print(ostream& os, const char* indent) const
+{
+	const std::ios::fmtflags flags = os.flags();
+
+	for (size_t i = 0; i < _changes.size(); i++)
+	{
+		const RegisterChange& change = _changes[i];
+		os << indent << change.Register.ToString() << ": " << std::hex;
+		if (change.HasCurrent)
+			os << "0x" << change.Current << " -> 0x" << ((change.Current & ~change.Mask) | change.Value);
+		else
+			os << "mask 0x" << change.Mask << ", value 0x" << change.Value;
+		os << std::dec << std::endl;
+	}
+
+	os.flags(flags);
+}
+
+void RegisterTransaction::Commit()
+{
+	for (size_t i = 0; i < _changes.size(); i++)
+	{
+		const RegisterChange& change = _changes[i];
+		const RegisterId& reg = change.Register;
+
+		const QWORD current = (change.HasCurrent ? change.Current : Read(reg));
+		const QWORD value = (current & ~change.Mask) | change.Value;
+
+		if (reg.Type == MSR_REGISTER)
+			Wrmsr(reg.Address, value, reg.Cpu);
+		else
+			WritePciConfig(reg.Device, reg.Function, reg.Address, (DWORD)value);
+	}
+
+	_changes.clear();
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include "RegisterAccess.h"
+
+
+enum RegisterType
+{
+	MSR_REGISTER,
+	PCI_REGISTER
+};
+
+struct RegisterId
+{
+	RegisterType Type;
+	int Cpu;         // MSRs only
+	DWORD Device;    // PCI registers only
+	DWORD Function;  // PCI registers only
+	DWORD Address;   // MSR index or PCI register offset
+
+	static RegisterId Msr(DWORD index, int cpu);
+	static RegisterId Pci(DWORD device, DWORD function, DWORD regAddress);
+
+	bool operator==(const RegisterId& other) const;
+
+	/// <summary>Returns the BKDG name, e.g., "MSRC001_0064 (CPU 3)" or "D18F4x15C".</summary>
+	std::string ToString() const;
+};
+
+struct RegisterChange
+{
+	RegisterId Register;
+	QWORD Mask;      // bits to be modified
+	QWORD Value;     // new values of these bits
+	bool HasCurrent; // the current value has been read by RemoveNoOps()
+	QWORD Current;
+};
+
+
+/// <summary>
+/// Gathers bit field updates for any number of registers and applies them with a single
+/// read-modify-write cycle per register. Registers are committed in the order they were first touched.
+/// </summary>
+class RegisterTransaction
+{
+public:
+
+	/// <summary>Sets the bits selected by the mask (any number of fields at once).</summary>
+	void SetMsrMasked(DWORD index, QWORD mask, QWORD value, int cpu = CURRENT_CPU);
+	void SetPciMasked(DWORD device, DWORD function, DWORD regAddress, DWORD mask, DWORD value);
+
+	/// <summary>Sets a field described by a Field, SplitField or single-field FieldSet (see RegisterFields.h).</summary>
+	template <typename F> void SetMsrField(DWORD index, DWORD value, int cpu = CURRENT_CPU)
+	{
+		SetMsrMasked(index, F::Mask(), F::Make(value), cpu);
+	}
+
+	template <typename F> void SetPciField(DWORD device, DWORD function, DWORD regAddress, DWORD value)
+	{
+		SetPciMasked(device, function, regAddress, F::Mask(), F::Make(value));
+	}
+
+	/// <summary>Returns the pending changes, one per register.</summary>
+	const std::vector<RegisterChange>& GetChanges() const { return _changes; }
+
+	bool IsEmpty() const { return _changes.empty(); }
+
+	/// <summary>
+	/// Reads each register and drops the changes its current value already satisfies. The read values
+	/// are kept for Print() and Commit(). Returns the number of dropped registers.
+	/// </summary>
+	int RemoveNoOps();
+
+	/// <summary>Lists the pending changes, one register per line.</summary>
+	void Print(std::ostream& os, const char* indent = "  ") const;
+
+	/// <summary>
+	/// Reads (unless already read by RemoveNoOps()), modifies and writes each register once and clears
+	/// the pending changes.
+	/// </summary>
+	void Commit();
+
+	void Clear() { _changes.clear(); }
+
+
+private:
+
+	void SetMasked(const RegisterId& reg, QWORD mask, QWORD value);
+
+	std::vector<RegisterChange> _changes;
+};
@@ -0,0 +1,406 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#pragma once
+
+#include "RegisterFields.h"
+
+
+// Field descriptors of the registers used by the program, named after the BKDGs.
+// The static_asserts document the field widths given by the BKDGs; a descriptor
+// disagreeing with the documented width does not compile.
+
+
+// CPUID Fn0000_0006_ECX Thermal and Power Management
+namespace CPUID_0000_0006_ECX
+{
+	typedef Field<DWORD, 0, 0> EffFreq; // effective frequency interface (MPERF/APERF)
+}
+
+// CPUID Fn8000_0001_EAX Family, Model, Stepping Identifiers
+namespace CPUID_8000_0001_EAX
+{
+	typedef Field<DWORD, 7, 4> BaseModel;
+	typedef Field<DWORD, 11, 8> BaseFamily;
+	typedef Field<DWORD, 19, 16> ExtModel;
+	typedef Field<DWORD, 27, 20> ExtFamily;
+}
+
+// CPUID Fn8000_0007_EDX Advanced Power Management Information
+namespace CPUID_8000_0007_EDX
+{
+	typedef Field<DWORD, 9, 9> CPB;
+}
+
+// CPUID Fn8000_0008_ECX Size Identifiers
+namespace CPUID_8000_0008_ECX
+{
+	typedef Field<DWORD, 7, 0> NC; // number of physical cores - 1
+}
+
+
+// MSR0000_00E7 Max Performance Frequency Clock Count (MPERF), increments at the P0 frequency while in C0
+namespace MSR0000_00E7
+{
+	static const DWORD Index = 0xE7;
+}
+
+// MSR0000_00E8 Actual Performance Frequency Clock Count (APERF), increments at the actual frequency while in C0
+namespace MSR0000_00E8
+{
+	static const DWORD Index = 0xE8;
+}
+
+// MSRC001_0015 Hardware Configuration (HWCR)
+namespace MSRC001_0015
+{
+	static const DWORD Index = 0xC0010015;
+
+	typedef Field<QWORD, 25, 25> CpbDis;
+}
+
+// MSRC001_0062 P-state Control
+namespace MSRC001_0062
+{
+	static const DWORD Index = 0xC0010062;
+
+	typedef Field<QWORD, 2, 0> PstateCmd;
+}
+
+// MSRC001_00[6B:64] P-state [7:0], families 10h and 15h
+namespace MSRC001_0064
+{
+	static const DWORD Index = 0xC0010064;
+
+	typedef Field<QWORD, 5, 0> CpuFid;
+	typedef Field<QWORD, 8, 6> CpuDid;
+	typedef Field<QWORD, 15, 9> CpuVid;
+	typedef Field<QWORD, 16, 9> CpuVidSvi2; // CpuVid[7:0] on SVI2 platforms (family 15h models 10h-1Fh and 30h-3Fh)
+	typedef Field<QWORD, 22, 22> NbPstate;  // NbDid on family 10h
+	typedef Field<QWORD, 31, 25> NbVid;     // family 10h only
+	typedef Field<QWORD, 63, 63> PstateEn;
+
+	typedef FieldSet<CpuFid, CpuDid> CpuCof;
+
+	static_assert(CpuFid::Width == 6, "CpuFid[5:0]");
+	static_assert(CpuDid::Width == 3, "CpuDid[2:0]");
+	static_assert(CpuVid::Width == 7, "CpuVid[6:0]");
+	static_assert(CpuVidSvi2::Width == 8, "CpuVid[7:0]");
+	static_assert(NbVid::Width == 7, "NbVid[6:0]");
+}
+
+// MSRC001_00[6B:64] P-state [7:0], family 12h
+namespace MSRC001_0064_F12
+{
+	typedef Field<QWORD, 3, 0> CpuDid;
+	typedef Field<QWORD, 8, 4> CpuFid;
+
+	typedef FieldSet<CpuFid, CpuDid> CpuCof;
+
+	static_assert(CpuDid::Width == 4, "CpuDid[3:0]");
+	static_assert(CpuFid::Width == 5, "CpuFid[4:0]");
+}
+
+// MSRC001_00[6B:64] P-state [7:0], family 14h
+namespace MSRC001_0064_F14
+{
+	typedef Field<QWORD, 3, 0> CpuDidLSD;
+	typedef Field<QWORD, 8, 4> CpuDidMSD;
+
+	typedef FieldSet<CpuDidMSD, CpuDidLSD> CpuCof;
+
+	static_assert(CpuDidLSD::Width == 4, "CpuDidLSD[3:0]");
+	static_assert(CpuDidMSD::Width == 5, "CpuDidMSD[4:0]");
+}
+
+// MSRC001_0071 COFVID Status
+// (CurCpuFid/CurCpuDid share the layout of the P-state definitions, see above)
+namespace MSRC001_0071
+{
+	static const DWORD Index = 0xC0010071;
+
+	typedef Field<QWORD, 15, 9> CurCpuVid;
+	typedef SplitField<CurCpuVid, Field<QWORD, 20, 20> > CurCpuVidSvi2; // CurCpuVid[7] on SVI2 platforms
+	typedef Field<QWORD, 18, 16> CurPstate;
+	typedef Field<QWORD, 23, 23> NbPstateDis;
+	typedef Field<QWORD, 41, 35> MaxVid;
+	typedef Field<QWORD, 48, 42> MinVid;
+	typedef Field<QWORD, 54, 49> MaxCpuCof;
+
+	static_assert(CurCpuVid::Width == 7, "CurCpuVid[6:0]");
+	static_assert(CurCpuVidSvi2::Width == 8, "CurCpuVid[7:0]");
+	static_assert(CurPstate::Width == 3, "CurPstate[2:0]");
+	static_assert(MaxVid::Width == 7, "MaxVid[6:0]");
+	static_assert(MinVid::Width == 7, "MinVid[6:0]");
+	static_assert(MaxCpuCof::Width == 6, "MaxCpuCof[5:0]");
+}
+
+
+// D0F0x7C IOC Configuration Control
+namespace D0F0x7C
+{
+	typedef Field<DWORD, 0, 0> ForceIntGfxDisable;
+}
+
+// D0F0xBC_x3F9E8 NB_DPM_CONFIG_1
+namespace D0F0xBC_x3F9E8
+{
+	static const DWORD Offset = 0x0003F9E8;
+
+	typedef Field<DWORD, 7, 0> Dpm0PgNbPsLo;
+	typedef Field<DWORD, 15, 8> Dpm0PgNbPsHi;
+	typedef Field<DWORD, 23, 16> DpmXNbPsLo;
+	typedef Field<DWORD, 31, 24> DpmXNbPsHi;
+}
+
+// D0F0xBC_x3FD[8C:00:step14] LCLK DPM Control 0
+namespace D0F0xBC_x3FD00
+{
+	static const DWORD Offset = 0x0003FD00;
+	static const DWORD Step = 0x14;
+
+	typedef Field<DWORD, 7, 0> LowVoltageReqThreshold;
+	typedef Field<DWORD, 15, 8> VID;
+	typedef Field<DWORD, 23, 16> LclkDivider;
+	typedef Field<DWORD, 31, 24> StateValid;
+}
+
+// D0F0xBC_x3FDC8 SMU_LCLK_DPM_CNTL
+namespace D0F0xBC_x3FDC8
+{
+	static const DWORD Offset = 0x0003FDC8;
+
+	typedef Field<DWORD, 15, 8> LclkDpmBootState;
+	typedef Field<DWORD, 23, 16> VoltageChgEn;
+	typedef Field<DWORD, 31, 24> LclkDpmEn;
+}
+
+
+// D18F2x[1,0]84 DRAM MRS (family 12h)
+namespace D18F2x84
+{
+	typedef Field<DWORD, 6, 4> Twr;
+	typedef Field<DWORD, 22, 20> Tcwl;
+}
+
+// D18F2x[1,0]88 DRAM Timing Low (family 12h)
+namespace D18F2x88
+{
+	typedef Field<DWORD, 3, 0> Tcl;
+}
+
+// D18F2x94_dct[3:0] DRAM Configuration High
+namespace D18F2x94
+{
+	typedef Field<DWORD, 4, 0> MemClkFreq;
+	typedef Field<DWORD, 7, 7> MemClkFreqVal;
+	typedef Field<DWORD, 20, 20> SlowAccessMode;
+
+	static_assert(MemClkFreq::Width == 5, "MemClkFreq[4:0]");
+}
+
+// D18F2x[1,0]F4_x40 DRAM Timing 0 (family 12h)
+namespace D18F2xF4_x40
+{
+	typedef Field<DWORD, 3, 0> Trcd;
+	typedef Field<DWORD, 11, 8> Trp;
+	typedef Field<DWORD, 20, 16> Tras;
+	typedef Field<DWORD, 29, 24> Trc;
+}
+
+// D18F2x[1,0]F4_x41 DRAM Timing 1 (family 12h)
+namespace D18F2xF4_x41
+{
+	typedef Field<DWORD, 2, 0> Trtp;
+	typedef Field<DWORD, 10, 8> Trrd;
+	typedef Field<DWORD, 18, 16> Twtr;
+}
+
+// D18F2x2E0_dct[3:0] Memory P-state Control and Status
+namespace D18F2x2E0
+{
+	typedef Field<DWORD, 28, 24> M1MemClkFreq;
+	typedef Field<DWORD, 30, 30> FastMstateDis;
+
+	static_assert(M1MemClkFreq::Width == 5, "M1MemClkFreq[4:0]");
+}
+
+
+// D18F3x64 Hardware Thermal Control (HTC)
+namespace D18F3x64
+{
+	static const DWORD Address = 0x64;
+
+	typedef Field<DWORD, 0, 0> HtcEn;
+	typedef Field<DWORD, 4, 4> HtcAct;          // currently in the HTC-active state
+	typedef Field<DWORD, 5, 5> HtcActSts;       // has entered the HTC-active state (sticky until cleared by writing 1)
+	typedef Field<DWORD, 22, 16> HtcTmpLmt;     // Tctl limit: 52 + HtcTmpLmt / 2 degrees
+	typedef Field<DWORD, 27, 24> HtcHystLmt;    // in 1/2 degrees
+	typedef Field<DWORD, 30, 28> HtcPstateLimit; // software P-state numbering
+}
+
+// D18F3xA0 Power Control Miscellaneous
+namespace D18F3xA0
+{
+	typedef Field<DWORD, 6, 0> PsiVidLow;
+	typedef Field<DWORD, 7, 7> PsiVidEn;
+	typedef SplitField<PsiVidLow, Field<DWORD, 8, 8> > PsiVid; // PsiVid[7] on SVI2 platforms
+
+	static_assert(PsiVid::Width == 8, "PsiVid[7:0]");
+}
+
+// D18F3xA4 Reported Temperature Control
+namespace D18F3xA4
+{
+	static const DWORD Address = 0xA4;
+
+	typedef Field<DWORD, 17, 16> CurTmpTjSel; // 11b: CurTmp is offset by -49 (family 15h)
+	typedef Field<DWORD, 31, 21> CurTmp;      // in 1/8 degrees
+
+	static_assert(CurTmp::Width == 11, "CurTmp[10:0]");
+}
+
+// D18F3xD4 Clock Power/Timing Control 0 (family 15h)
+namespace D18F3xD4
+{
+	typedef Field<DWORD, 5, 0> MaxSwPstateCpuCof;
+}
+
+// D18F3xDC Clock Power/Timing Control 2
+namespace D18F3xDC
+{
+	typedef Field<DWORD, 10, 8> HwPstateMaxVal;
+
+	static_assert(HwPstateMaxVal::Width == 3, "HwPstateMaxVal[2:0]");
+}
+
+// D18F3xE8 Northbridge Capabilities
+namespace D18F3xE8
+{
+	static const DWORD Address = 0xE8;
+
+	typedef Field<DWORD, 24, 24> MemPstateCap;
+	typedef Field<DWORD, 29, 29> MultiNodeCpu; // family 15h: two internal nodes per package
+	typedef Field<DWORD, 31, 30> IntNodeNum;
+}
+
+// D18F3x1F0 Product Information (family 10h)
+namespace D18F3x1F0
+{
+	typedef Field<DWORD, 25, 20> MaxSwPstateCpuCof;
+}
+
+
+// D18F4x15C Core Performance Boost Control
+namespace D18F4x15C
+{
+	static const DWORD Address = 0x15C;
+
+	typedef Field<DWORD, 1, 0> BoostSrc;
+	typedef Field<DWORD, 2, 2> NumBoostStatesF10; // family 10h: a single boost P-state at most
+	typedef Field<DWORD, 4, 2> NumBoostStates;
+	typedef Field<DWORD, 7, 7> ApmMasterEn;       // family 15h
+	typedef Field<DWORD, 28, 28> IgnoreBoostThresh; // family 12h
+	typedef Field<DWORD, 29, 29> BoostEnAllCores;   // family 12h
+	typedef Field<DWORD, 31, 31> BoostLock;
+
+	static_assert(NumBoostStates::Width == 3, "NumBoostStates[2:0]");
+}
+
+// D18F4x1B8 Processor TDP (family 15h)
+namespace D18F4x1B8
+{
+	static const DWORD Address = 0x1B8;
+
+	typedef Field<DWORD, 15, 0> ProcessorTdp; // in TDP units (see Tdp2Watt)
+	typedef Field<DWORD, 31, 16> BaseTdp;
+}
+
+
+// D18F5xE0 Processor TDP Running Average (family 15h)
+namespace D18F5xE0
+{
+	static const DWORD Address = 0xE0;
+
+	typedef Field<DWORD, 3, 0> RunAvgRange;       // the average spans 2^(RunAvgRange + 1) samples
+	typedef Field<DWORD, 25, 4> TdpRunAvgAccCap;   // signed
+	typedef Field<DWORD, 31, 4> TdpRunAvgAccCapCZ; // signed, models 60h and later
+}
+
+// D18F5xE8 TDP Limit 3 (family 15h)
+namespace D18F5xE8
+{
+	static const DWORD Address = 0xE8;
+
+	typedef SplitField<Field<DWORD, 15, 10>, Field<DWORD, 9, 0> > Tdp2Watt; // watts per TDP unit, fixed point 0.16
+	typedef Field<DWORD, 28, 16> ApmTdpLimit;
+	typedef Field<DWORD, 31, 16> ApmTdpLimitCZ; // models 60h and later
+
+	static_assert(Tdp2Watt::Width == 16, "Tdp2Watt[15:0]");
+}
+
+// D18F5x16[C:0] Northbridge P-state [3:0]
+namespace D18F5x160
+{
+	static const DWORD Address = 0x160;
+
+	typedef Field<DWORD, 0, 0> NbPstateEn;
+	typedef Field<DWORD, 6, 1> NbFid;
+	typedef Field<DWORD, 7, 7> NbDid;
+	typedef Field<DWORD, 16, 10> NbVidLow;
+	typedef Field<DWORD, 18, 18> MemPstate;
+	typedef SplitField<NbVidLow, Field<DWORD, 21, 21> > NbVid; // NbVid[7] on SVI2 platforms
+
+	typedef FieldSet<NbFid, NbDid> NbCof;
+
+	static_assert(NbFid::Width == 6, "NbFid[5:0]");
+	static_assert(NbVidLow::Width == 7, "NbVid[6:0]");
+	static_assert(NbVid::Width == 8, "NbVid[7:0]");
+}
+
+// D18F5x170 Northbridge P-state Control
+namespace D18F5x170
+{
+	typedef Field<DWORD, 1, 0> NbPstateMaxVal;
+	typedef Field<DWORD, 4, 3> NbPstateLo;
+	typedef Field<DWORD, 7, 6> NbPstateHi;
+	typedef Field<DWORD, 23, 23> NbPstateGnbSlowDis;
+	typedef Field<DWORD, 31, 31> MemPstateDis;
+
+	static_assert(NbPstateMaxVal::Width == 2, "NbPstateMaxVal[1:0]");
+	static_assert(NbPstateLo::Width == 2, "NbPstateLo[1:0]");
+	static_assert(NbPstateHi::Width == 2, "NbPstateHi[1:0]");
+}
+
+// D18F5x174 Northbridge P-state Status
+namespace D18F5x174
+{
+	static const DWORD Address = 0x174;
+
+	typedef Field<DWORD, 2, 1> StartupNbPstate;
+	typedef Field<DWORD, 20, 19> CurNbPstate;
+
+	static_assert(StartupNbPstate::Width == 2, "StartupNbPstate[1:0]");
+	static_assert(CurNbPstate::Width == 2, "CurNbPstate[1:0]");
+}
+
+// D18F5x178 Northbridge Fusion Configuration
+namespace D18F5x178
+{
+	typedef Field<DWORD, 19, 19> SwGfxDis;
+}
+
+// D18F5x17C Miscellaneous Voltages
+namespace D18F5x17C
+{
+	static const DWORD Address = 0x17C;
+
+	typedef Field<DWORD, 30, 23> NbPsi0Vid;
+	typedef Field<DWORD, 31, 31> NbPsi0VidEn;
+
+	static_assert(NbPsi0Vid::Width == 8, "NbPsi0Vid[7:0]");
+}
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include "ReplayCheck.h"
+#include "Info.h"
+#include "RegisterCache.h"
+#include "RegisterLog.h"
+#include "Registers.h"
+#include "Worker.h"
+
+using std::string;
+using std::vector;
+
+
+/// <summary>
+/// A family 15h model 13h system with 4 P-states and the given number of cores. P-state requests take effect
+/// after a few reads of MSRC001_0071, like the hardware ramping the voltage, so the apply has to wait for them.
+/// </summary>
+class SyntheticBackend : public RegisterBackend
+{
+public:
+
+	explicit SyntheticBackend(int numCPUs)
+		: _numCPUs(numCPUs)
+		, _requested(numCPUs, 0)
+		, _current(numCPUs, 0)
+		, _pendingReads(numCPUs, 0)
+	{
+		for (int i = 0; i < NUM_PSTATES; i++)
+			_pStates[i] = (1ULL << 63) | ((QWORD)(0x20 + i * 4) << 9) | (0x10 - i * 2); // PstateEn, CpuVid, CpuFid
+	}
+
+	const char* GetName() const { return "Synthetic"; }
+
+	bool Initialize() { return true; }
+
+	bool IsCpuAddressable() const { return true; }
+
+	int GetNumCPUs() const { return _numCPUs; }
+
+	RegisterStatus Rdmsr(int cpu, DWORD index, QWORD& value)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		cpu = (cpu == CURRENT_CPU ? 0 : cpu);
+		value = 0;
+
+		if (index >= MSRC001_0064::Index && index < MSRC001_0064::Index + NUM_PSTATES)
+			value = _pStates[index - MSRC001_0064::Index];
+		else if (index == MSRC001_0062::Index)
+			value = _requested[cpu];
+		else if (index == MSRC001_0071::Index)
+		{
+			if (_current[cpu] != _requested[cpu] && ++_pendingReads[cpu] >= TRANSITION_READS)
+			{
+				_current[cpu] = _requested[cpu];
+				_pendingReads[cpu] = 0;
+			}
+
+			value = ((QWORD)_current[cpu] << 16) | (_pStates[_current[cpu]] & 0xFFFF); // CurPstate, CurCpuVid/Did/Fid
+		}
+
+		return REG_OK;
+	}
+
+	RegisterStatus Wrmsr(int cpu, DWORD index, QWORD value)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		cpu = (cpu == CURRENT_CPU ? 0 : cpu);
+
+		if (index >= MSRC001_0064::Index && index < MSRC001_0064::Index + NUM_PSTATES)
+			_pStates[index - MSRC001_0064::Index] = value;
+		else if (index == MSRC001_0062::Index)
+			_requested[cpu] = (int)(value & (NUM_PSTATES - 1));
+
+		return REG_OK;
+	}
+
+	RegisterStatus ReadPciConfig(DWORD, DWORD function, DWORD regAddress, DWORD& value)
+	{
+		value = 0;
+
+		if (function == 3 && regAddress == 0xDC)
+			value = (NUM_PSTATES - 1) << 8; // D18F3xDC HwPstateMaxVal
+		else if (function == 5 && regAddress == 0x170)
+			value = 1;                      // D18F5x170 NbPstateMaxVal: 2 NB P-states
+
+		return REG_OK;
+	}
+
+	RegisterStatus WritePciConfig(DWORD, DWORD, DWORD, DWORD) { return REG_OK; }
+
+	RegisterStatus Cpuid(int, DWORD index, CpuidRegs& regs)
+	{
+		regs.eax = regs.ebx = regs.ecx = regs.edx = 0;
+
+		if (index == 0x80000000)
+			regs.ecx = 0x444d4163;          // "DMAc" of "AuthenticAMD"
+		else if (index == 0x80000001)
+			regs.eax = 0x00610F31;          // family 15h model 13h
+		else if (index == 0x80000008)
+			regs.ecx = (DWORD)(_numCPUs - 1); // NC
+
+		return REG_OK;
+	}
+
+
+private:
+
+	static const int NUM_PSTATES = 4;
+	static const int TRANSITION_READS = 3;
+
+	const int _numCPUs;
+
+	std::mutex _mutex;
+	QWORD _pStates[NUM_PSTATES];
+	vector<int> _requested;
+	vector<int> _current;
+	vector<int> _pendingReads;
+};
+
+
+/// <summary>Initializes Info and applies the check's parameters on the global backend.</summary>
+static void ApplyChanges()
+{
+	Info info;
+	if (!info.Initialize())
+		throw std::runtime_error("the synthetic CPU is not recognized");
+
+	const char* params[] = { "ReplayCheck", "P0=16@1.3", "P1=14@1.25", "P2=@1.2", "NB_P1=@1.0" };
+	Worker worker(info);
+	if (!worker.ParseParams(sizeof(params) / sizeof(params[0]), params))
+		throw std::runtime_error("invalid parameters");
+
+	worker.ApplyChanges();
+}
+
+
+ReplayCheckResult ReplayCheck::Run(int numCPUs, const char* logPath)
+{
+	ReplayCheckResult result;
+	result.NumHostCPUs = GetNumLogicalCPUs();
+	result.NumCPUs = (numCPUs > 0 ? numCPUs : result.NumHostCPUs + 3);
+
+	// record
+	{
+		RegisterBackend* backend = new RecordingBackend(new SyntheticBackend(result.NumCPUs), logPath);
+		if (!backend->Initialize())
+		{
+			delete backend;
+			result.Mismatches.push_back("cannot create " + string(logPath));
+			return result;
+		}
+
+		SetBackend(new RegisterCache(backend));
+
+		try
+		{
+			ApplyChanges();
+		}
+		catch (const std::exception& e)
+		{
+			result.Mismatches.push_back(string("recording failed: ") + e.what());
+		}
+
+		// flushes the log
+		ShutdownBackend();
+
+		if (!result.Mismatches.empty())
+			return result;
+	}
+
+	// replay
+	ReplayBackend* replay = new ReplayBackend(logPath);
+	if (!replay->Initialize())
+	{
+		delete replay;
+		result.Mismatches.push_back("cannot read " + string(logPath));
+		return result;
+	}
+
+	SetBackend(new RegisterCache(replay));
+
+	if (replay->GetNumCPUs() != result.NumCPUs)
+		result.Mismatches.push_back("the log has lost the number of logical CPUs");
+
+	try
+	{
+		ApplyChanges();
+	}
+	catch (const std::exception& e)
+	{
+		result.Mismatches.push_back(string("replay failed: ") + e.what());
+	}
+
+	const vector<string> mismatches = replay->GetMismatches();
+	result.Mismatches.insert(result.Mismatches.end(), mismatches.begin(), mismatches.end());
+
+	ShutdownBackend();
+
+	return result;
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+struct ReplayCheckResult
+{
+	int NumCPUs;                         // logical CPUs of the synthetic system
+	int NumHostCPUs;
+	std::vector<std::string> Mismatches; // reported by the replay, plus failures of the check itself
+};
+
+
+/// <summary>
+/// Self-check of the record/replay backends (see RegisterLog.h) without AMD hardware: P-state changes are applied
+/// to a synthetic family 15h system with more logical CPUs than the host while its register accesses are recorded,
+/// then the log is replayed through the same Info/Worker pipeline. Replaces the global backend while running.
+/// </summary>
+class ReplayCheck
+{
+public:
+
+	/// <summary>Runs the check with the given number of logical CPUs (the host's + 3 if not positive), logging to the given file.</summary>
+	static ReplayCheckResult Run(int numCPUs, const char* logPath);
+};
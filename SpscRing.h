@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+
+/// <summary>
+/// Bounded lock-free ring buffer for exactly one producer and one consumer thread.
+/// Neither side ever blocks: pushing into a full ring and popping from an empty one fail.
+/// </summary>
+template <typename T, size_t Capacity> class SpscRing
+{
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "the capacity must be a power of 2");
+
+public:
+
+	SpscRing()
+		: _head(0)
+		, _tail(0)
+	{ }
+
+	/// <summary>Producer side; returns false if the ring is full.</summary>
+	bool TryPush(const T& item)
+	{
+		const size_t head = _head.load(std::memory_order_relaxed);
+		if (head - _tail.load(std::memory_order_acquire) == Capacity)
+			return false;
+
+		_items[head & (Capacity - 1)] = item;
+		_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	/// <summary>Consumer side; returns false if the ring is empty.</summary>
+	bool TryPop(T& item)
+	{
+		const size_t tail = _tail.load(std::memory_order_relaxed);
+		if (tail == _head.load(std::memory_order_acquire))
+			return false;
+
+		item = _items[tail & (Capacity - 1)];
+		_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+
+private:
+
+	static const size_t CACHE_LINE_SIZE = 64;
+
+	// The indices only ever grow (and wrap around at SIZE_MAX). They are padded to separate cache lines, so that
+	// producer and consumer do not invalidate each other's line (padding instead of alignas, as heap-allocated
+	// over-aligned types are not supported before C++17).
+	std::atomic<size_t> _head; // next slot to be written, owned by the producer
+	char _headPadding[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> _tail; // next slot to be read, owned by the consumer
+	char _tailPadding[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+	T _items[Capacity];
+};
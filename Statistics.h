@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <ostream>
+#include <vector>
+
+
+struct Percentiles
+{
+	size_t Count;
+	double Min;
+	double Mean;
+	double P50;
+	double P90;
+	double P99;
+	double Max;
+};
+
+
+/// <summary>
+/// Some helper functions for latency distributions.
+/// </summary>
+class Statistics
+{
+public:
+
+	/// <summary>Computes the distribution of the values (nearest-rank percentiles); the values are sorted.</summary>
+	static Percentiles Compute(std::vector<double>& values)
+	{
+		Percentiles result = { values.size(), 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+		if (values.empty())
+			return result;
+
+		std::sort(values.begin(), values.end());
+
+		double sum = 0.0;
+		for (size_t i = 0; i < values.size(); i++)
+			sum += values[i];
+
+		result.Min = values.front();
+		result.Mean = sum / values.size();
+		result.P50 = Rank(values, 0.50);
+		result.P90 = Rank(values, 0.90);
+		result.P99 = Rank(values, 0.99);
+		result.Max = values.back();
+
+		return result;
+	}
+
+	/// <summary>Prints "p50 / p90 / p99 / max <unit> (mean <mean>, <count> samples)".</summary>
+	static void Print(std::ostream& os, const Percentiles& p, const char* unit)
+	{
+		const std::ios::fmtflags flags = os.flags();
+		const std::streamsize precision = os.precision();
+		os.setf(std::ios::fixed);
+		os.precision(p.Max < 10.0 ? 3 : 1);
+
+		os << p.P50 << " / " << p.P90 << " / " << p.P99 << " / " << p.Max << " " << unit
+		   << " (p50/p90/p99/max, mean " << p.Mean << ", " << p.Count << " samples)";
+
+		os.precision(precision);
+		os.flags(flags);
+	}
+
+
+private:
+
+	// the smallest value with at least the fraction of all values not exceeding it
+	static double Rank(const std::vector<double>& sorted, double fraction)
+	{
+		size_t rank = (size_t)(fraction * sorted.size() + 0.999999);
+		rank = std::max<size_t>(1, std::min(rank, sorted.size()));
+		return sorted[rank - 1];
+	}
+};
@@ -7,9 +7,17 @@
 
 #pragma once
 
+#include <cstring>
 #include <sstream>
 #include <vector>
 
+#ifndef _WIN32
+#include <strings.h>
+#define strtok_s strtok_r
+#define _stricmp strcasecmp
+#define _strnicmp strncasecmp
+#endif
+
 
 /// <summary>
 /// Some helper functions when working with strings.
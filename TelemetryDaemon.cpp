@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <thread>
+#include <vector>
+#include "TelemetryDaemon.h"
+#include "FrequencyMonitor.h"
+#include "Info.h"
+#include "Registers.h"
+#include "TelemetryShm.h"
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+using std::vector;
+using std::chrono::steady_clock;
+
+
+static QWORD Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+
+bool TelemetryDaemon::Run(double intervalSeconds, double seconds, const std::atomic<bool>& stop) const
+{
+	const Info& info = *_info;
+
+	const int numCPUs = GetBackend().GetNumCPUs();
+	const bool isCpuAddressable = GetBackend().IsCpuAddressable();
+	const bool hasEffFreq = FrequencyMonitor::IsSupported();
+	const double p0MHz = FrequencyMonitor(info).GetP0MHz();
+
+	intervalSeconds = std::max(0.0001, intervalSeconds);
+	const steady_clock::duration interval = std::chrono::duration_cast<steady_clock::duration>(std::chrono::duration<double>(intervalSeconds));
+
+	// the segment of a daemon which has not exited cleanly is taken over, a running daemon keeps its own
+	SharedMemory memory;
+	if (!memory.Create(TELEMETRY_NAME, GetTelemetrySize(numCPUs)))
+	{
+		TelemetryReader previous;
+		if (previous.Open() && IsProcessRunning(previous.GetHeader().ProcessId))
+			return false;
+
+		previous.Close();
+		SharedMemory::Remove(TELEMETRY_NAME);
+
+		if (!memory.Create(TELEMETRY_NAME, GetTelemetrySize(numCPUs)))
+			return false;
+	}
+
+	TelemetryHeader* header = (TelemetryHeader*)memory.GetAddress();
+	TelemetryNodeRecord* node = (TelemetryNodeRecord*)(header + 1);
+	TelemetryCoreRecord* cores = (TelemetryCoreRecord*)(node + 1);
+
+	header->Version = TELEMETRY_VERSION;
+	header->HeaderSize = sizeof(TelemetryHeader);
+	header->RecordSize = sizeof(TelemetryCoreRecord);
+	header->NumCPUs = numCPUs;
+	header->Family = info.Family;
+	header->Model = info.Model;
+	header->IntervalMicroseconds = (DWORD)(intervalSeconds * 1e6);
+	header->ProcessId = (DWORD)getpid();
+	for (int i = 0; i < numCPUs; i++)
+		cores[i].Cpu = i;
+
+	// readers check the magic first, so it is written last
+	std::atomic_thread_fence(std::memory_order_release);
+	header->Magic = TELEMETRY_MAGIC;
+
+	std::atomic<bool> stopSamplers(false);
+	vector<std::thread> samplers;
+
+	for (int i = 0; i < numCPUs; i++)
+	{
+		samplers.push_back(std::thread([&, i]()
+		{
+			// unpinned, CURRENT_CPU would publish the registers of whichever CPU the thread runs on
+			const bool canSample = (PinCurrentThread(i) || isCpuAddressable);
+			const int cpu = (isCpuAddressable ? i : CURRENT_CPU);
+
+			QWORD lastMperf = 0, lastAperf = 0;
+			bool haveLast = false;
+
+			steady_clock::time_point next = steady_clock::now();
+
+			while (!stopSamplers.load(std::memory_order_relaxed))
+			{
+				TelemetryCoreData data;
+				data.Timestamp = Now();
+				data.EffectiveMHz = 0.0;
+
+				CofVidStatus status;
+				if (canSample && info.TryReadCofVidStatus(status, cpu) == REG_OK)
+				{
+					data.PState = status.PState;
+					data.VID = status.VID;
+					data.Voltage = info.DecodeVID(status.VID);
+					data.CofMHz = status.Multi * 100.0; // internal multi for 100 MHz reference
+				}
+				else
+				{
+					data.PState = data.VID = -1;
+					data.Voltage = data.CofMHz = 0.0;
+				}
+
+				QWORD mperf, aperf;
+				if (canSample && hasEffFreq && TryRdmsr(MSR0000_00E7::Index, mperf, cpu) == REG_OK && TryRdmsr(MSR0000_00E8::Index, aperf, cpu) == REG_OK)
+				{
+					if (haveLast && mperf != lastMperf)
+						data.EffectiveMHz = p0MHz * (double)(aperf - lastAperf) / (double)(mperf - lastMperf);
+
+					lastMperf = mperf;
+					lastAperf = aperf;
+					haveLast = true;
+				}
+
+				PublishRecord(cores[i], data);
+
+				next += interval;
+				if (next < steady_clock::now())
+					next = steady_clock::now() + interval;
+
+				std::this_thread::sleep_until(next);
+			}
+		}));
+	}
+
+	const steady_clock::time_point end = steady_clock::now() + std::chrono::duration_cast<steady_clock::duration>(std::chrono::duration<double>(seconds));
+	steady_clock::time_point next = steady_clock::now();
+
+	while (!stop.load() && (seconds <= 0 || steady_clock::now() < end))
+	{
+		TelemetryNodeData data;
+		data.Timestamp = Now();
+		data.NbPState = -1;
+		data.Reserved = 0;
+
+		if (info.TryReadTemperature(data.TemperatureC) != REG_OK)
+			data.TemperatureC = std::numeric_limits<double>::quiet_NaN();
+
+		DWORD eax;
+		if (info.Family == 0x15 && TryReadPciConfig(AMD_CPU_DEVICE, 5, D18F5x174::Address, eax) == REG_OK)
+			data.NbPState = D18F5x174::CurNbPstate::Get(eax);
+
+		PublishRecord(*node, data);
+
+		next += interval;
+		if (next < steady_clock::now())
+			next = steady_clock::now() + interval;
+
+		std::this_thread::sleep_until(next);
+	}
+
+	stopSamplers.store(true);
+	for (int i = 0; i < numCPUs; i++)
+		samplers[i].join();
+
+	return true;
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#pragma once
+
+#include <atomic>
+
+class Info;
+
+
+/// <summary>
+/// Resident mode: keeps the register backend open and publishes the current P-state, VID, frequency
+/// (COFVID and APERF/MPERF based), NB P-state and temperature in the telemetry segment (see TelemetryShm.h).
+/// Every logical CPU is sampled by a thread pinned to it, which is the single writer of its record; the
+/// node-wide values are published by the calling thread.
+/// </summary>
+class TelemetryDaemon
+{
+public:
+
+	explicit TelemetryDaemon(const Info& info)
+		: _info(&info)
+	{ }
+
+	/// <summary>
+	/// Publishes every interval until stop is set or, if positive, the duration has elapsed.
+	/// Returns false if the segment cannot be created.
+	/// </summary>
+	bool Run(double intervalSeconds, double seconds, const std::atomic<bool>& stop) const;
+
+
+private:
+
+	const Info* _info;
+};
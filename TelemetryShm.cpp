@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "TelemetryShm.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef _WIN32
+
+bool SharedMemory::Create(const char* name, size_t size)
+{
+	Close();
+
+	const std::string fullName = std::string("Local\\") + name;
+	HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, (DWORD)size, fullName.c_str());
+	if (mapping == NULL)
+		return false;
+
+	if (GetLastError() == ERROR_ALREADY_EXISTS)
+	{
+		CloseHandle(mapping);
+		return false;
+	}
+
+	_address = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size);
+	if (_address == NULL)
+	{
+		CloseHandle(mapping);
+		return false;
+	}
+
+	_handle = mapping;
+	_size = size;
+	return true;
+}
+
+bool SharedMemory::Open(const char* name)
+{
+	Close();
+
+	const std::string fullName = std::string("Local\\") + name;
+	HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, fullName.c_str());
+	if (mapping == NULL)
+		return false;
+
+	_address = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (_address == NULL)
+	{
+		CloseHandle(mapping);
+		return false;
+	}
+
+	MEMORY_BASIC_INFORMATION info;
+	VirtualQuery(_address, &info, sizeof(info));
+
+	_handle = mapping;
+	_size = info.RegionSize;
+	return true;
+}
+
+void SharedMemory::Remove(const char*)
+{
+}
+
+void SharedMemory::Close()
+{
+	if (_address != NULL)
+		UnmapViewOfFile(_address);
+	if (_handle != NULL)
+		CloseHandle((HANDLE)_handle);
+
+	_address = NULL;
+	_handle = NULL;
+	_size = 0;
+}
+
+#else
+
+bool SharedMemory::Create(const char* name, size_t size)
+{
+	Close();
+
+	snprintf(_name, sizeof(_name), "/%s", name);
+
+	const int fd = shm_open(_name, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return false;
+
+	void* address = MAP_FAILED;
+	if (ftruncate(fd, (off_t)size) == 0) // zero-filled
+		address = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (address == MAP_FAILED)
+	{
+		shm_unlink(_name);
+		return false;
+	}
+
+	_address = address;
+	_size = size;
+	_owner = true;
+	return true;
+}
+
+bool SharedMemory::Open(const char* name)
+{
+	Close();
+
+	snprintf(_name, sizeof(_name), "/%s", name);
+
+	const int fd = shm_open(_name, O_RDONLY | O_CLOEXEC, 0);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	void* address = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+		address = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (address == MAP_FAILED)
+		return false;
+
+	_address = address;
+	_size = (size_t)st.st_size;
+	return true;
+}
+
+void SharedMemory::Remove(const char* name)
+{
+	char fullName[64];
+	snprintf(fullName, sizeof(fullName), "/%s", name);
+	shm_unlink(fullName);
+}
+
+void SharedMemory::Close()
+{
+	if (_address != NULL)
+		munmap(_address, _size);
+	if (_owner)
+		shm_unlink(_name);
+
+	_address = NULL;
+	_size = 0;
+	_owner = false;
+}
+
+#endif
+
+
+
+bool TelemetryReader::Open()
+{
+	_header = NULL;
+
+	if (!_memory.Open(TELEMETRY_NAME) || _memory.GetSize() < sizeof(TelemetryHeader))
+		return false;
+
+	const TelemetryHeader* header = (const TelemetryHeader*)_memory.GetAddress();
+	if (header->Magic != TELEMETRY_MAGIC || header->Version != TELEMETRY_VERSION ||
+	    header->HeaderSize != sizeof(TelemetryHeader) || header->RecordSize != sizeof(TelemetryCoreRecord) ||
+	    _memory.GetSize() < GetTelemetrySize(header->NumCPUs))
+		return false;
+
+	_header = header;
+	return true;
+}
+
+bool TelemetryReader::ReadNode(TelemetryNodeData& data) const
+{
+	const TelemetryNodeRecord* node = (const TelemetryNodeRecord*)(_header + 1);
+	return ReadRecord(*node, data);
+}
+
+bool TelemetryReader::ReadCore(int cpu, TelemetryCoreData& data) const
+{
+	if (cpu < 0 || cpu >= (int)_header->NumCPUs)
+		return false;
+
+	const TelemetryCoreRecord* cores = (const TelemetryCoreRecord*)((const TelemetryNodeRecord*)(_header + 1) + 1);
+	return ReadRecord(cores[cpu], data);
+}
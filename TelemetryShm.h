@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include "Platform.h"
+
+
+// Layout of the telemetry segment published by the daemon mode:
+//   TelemetryHeader | TelemetryNodeRecord | TelemetryCoreRecord[NumCPUs]
+// All structures are 64 bytes (one cache line) and little endian. Each record is guarded by a
+// seqlock: the writer increments Sequence before (odd: update in progress) and after (even) updating
+// the data; a reader copies the data and retries if Sequence was odd or changed meanwhile.
+
+static const char* const TELEMETRY_NAME = "AmdMsrTweaker"; // "/AmdMsrTweaker" on Linux, "Local\\AmdMsrTweaker" on Windows
+static const DWORD TELEMETRY_MAGIC = 0x54544D41; // "AMTT"
+static const DWORD TELEMETRY_VERSION = 1;        // incremented with every incompatible layout change
+static const int TELEMETRY_READ_ATTEMPTS = 1000; // per record, before giving up on a consistent copy
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "the seqlocks require lock-free atomics (shared across processes)");
+
+struct TelemetryHeader
+{
+	DWORD Magic;
+	DWORD Version;
+	DWORD HeaderSize; // sizeof(TelemetryHeader)
+	DWORD RecordSize; // sizeof(TelemetryNodeRecord) = sizeof(TelemetryCoreRecord)
+	DWORD NumCPUs;
+	DWORD Family;
+	DWORD Model;
+	DWORD IntervalMicroseconds; // sampling interval
+	DWORD ProcessId;            // of the daemon
+	DWORD Reserved[7];
+};
+
+struct TelemetryNodeData
+{
+	QWORD Timestamp;     // steady clock (CLOCK_MONOTONIC/QueryPerformanceCounter) in nanoseconds
+	double TemperatureC; // Tctl, NaN if unavailable
+	int NbPState;        // CurNbPstate, -1 if unavailable
+	int Reserved;
+};
+
+struct TelemetryCoreData
+{
+	QWORD Timestamp;     // steady clock in nanoseconds
+	int PState;          // CurPstate (hardware index), -1 if unavailable
+	int VID;             // CurCpuVid
+	double Voltage;      // decoded CurCpuVid
+	double CofMHz;       // frequency of the current P-state
+	double EffectiveMHz; // delivered while active during the last interval (APERF/MPERF), 0 if idle or unavailable
+};
+
+struct TelemetryNodeRecord
+{
+	std::atomic<DWORD> Sequence;
+	DWORD Reserved;
+	TelemetryNodeData Data;
+	char Padding[64 - 8 - sizeof(TelemetryNodeData)];
+};
+
+struct TelemetryCoreRecord
+{
+	std::atomic<DWORD> Sequence;
+	DWORD Cpu;
+	TelemetryCoreData Data;
+	char Padding[64 - 8 - sizeof(TelemetryCoreData)];
+};
+
+static_assert(sizeof(TelemetryHeader) == 64, "unexpected telemetry header layout");
+static_assert(sizeof(TelemetryNodeRecord) == 64, "unexpected telemetry record layout");
+static_assert(sizeof(TelemetryCoreRecord) == 64, "unexpected telemetry record layout");
+
+
+/// <summary>Total size of the segment for a number of logical CPUs.</summary>
+inline size_t GetTelemetrySize(int numCPUs)
+{
+	return sizeof(TelemetryHeader) + sizeof(TelemetryNodeRecord) + numCPUs * sizeof(TelemetryCoreRecord);
+}
+
+
+/// <summary>Seqlock writer side; there must be a single writer per record.</summary>
+template <typename Record, typename Data> void PublishRecord(Record& record, const Data& data)
+{
+	const DWORD sequence = record.Sequence.load(std::memory_order_relaxed);
+
+	record.Sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	record.Data = data;
+
+	record.Sequence.store(sequence + 2, std::memory_order_release);
+}
+
+/// <summary>
+/// Seqlock reader side; returns false if the record has never been written or no consistent copy could be made
+/// within TELEMETRY_READ_ATTEMPTS (e.g., the daemon has been killed in the middle of an update).
+/// </summary>
+template <typename Record, typename Data> bool ReadRecord(const Record& record, Data& data)
+{
+	for (int attempt = 0; attempt < TELEMETRY_READ_ATTEMPTS; attempt++)
+	{
+		const DWORD before = record.Sequence.load(std::memory_order_acquire);
+		if ((before & 1) == 0) // otherwise an update is in progress
+		{
+			data = record.Data;
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (record.Sequence.load(std::memory_order_relaxed) == before)
+				return (before != 0);
+		}
+
+		std::this_thread::yield();
+	}
+
+	return false;
+}
+
+
+/// <summary>Named shared memory segment (POSIX shm on Linux, file mapping backed by the paging file on Windows).</summary>
+class SharedMemory
+{
+public:
+
+	SharedMemory()
+		: _address(NULL)
+		, _size(0)
+		, _handle(NULL)
+		, _owner(false)
+	{ }
+
+	~SharedMemory() { Close(); }
+
+	/// <summary>Creates a zero-initialized segment for writing; fails if the name is already in use.</summary>
+	bool Create(const char* name, size_t size);
+
+	/// <summary>
+	/// Removes the name of a segment (Linux; on Windows, a segment vanishes with its last handle).
+	/// Processes still mapping it keep the old segment.
+	/// </summary>
+	static void Remove(const char* name);
+
+	/// <summary>Maps an existing segment read-only; the size is taken from the segment.</summary>
+	bool Open(const char* name);
+
+	void Close();
+
+	void* GetAddress() const { return _address; }
+	size_t GetSize() const { return _size; }
+
+
+private:
+
+	SharedMemory(const SharedMemory&);
+	SharedMemory& operator=(const SharedMemory&);
+
+	void* _address;
+	size_t _size;
+	void* _handle; // Windows mapping handle
+	bool _owner;   // removes the name on Linux
+	char _name[64];
+};
+
+
+/// <summary>Reads the telemetry published by a running daemon.</summary>
+class TelemetryReader
+{
+public:
+
+	TelemetryReader()
+		: _header(NULL)
+	{ }
+
+	/// <summary>Maps the segment and checks its magic, version and layout.</summary>
+	bool Open();
+
+	void Close() { _header = NULL; _memory.Close(); }
+
+	const TelemetryHeader& GetHeader() const { return *_header; }
+
+	bool ReadNode(TelemetryNodeData& data) const;
+	bool ReadCore(int cpu, TelemetryCoreData& data) const;
+
+
+private:
+
+	SharedMemory _memory;
+	const TelemetryHeader* _header;
+};
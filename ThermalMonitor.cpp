@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "ThermalMonitor.h"
+#include "Info.h"
+#include "ParallelApply.h"
+
+using std::endl;
+using std::vector;
+using std::chrono::steady_clock;
+
+
+struct CorePStates
+{
+	int Current;   // hardware P-state numbering
+	int Requested;
+	bool Valid;
+};
+
+
+// reads the current and the requested P-state of all cores, each one on its own core
+static void Sweep(const Info& info, int numCPUs, vector<CorePStates>& pStates)
+{
+	ParallelApply::RunIndexed(numCPUs, [&](int index, int cpu)
+	{
+		CorePStates& p = pStates[index];
+		p.Valid = (info.TryGetCurrentPState(p.Current, cpu) == REG_OK &&
+		           info.TryGetRequestedPState(p.Requested, cpu) == REG_OK);
+	});
+}
+
+
+ThermalReport ThermalMonitor::Run(double intervalSeconds, double seconds, const std::atomic<bool>& stop, std::ostream* log) const
+{
+	const Info& info = *_info;
+
+	const int numCPUs = GetBackend().GetNumCPUs();
+
+	const steady_clock::duration interval = std::chrono::duration_cast<steady_clock::duration>(
+		std::chrono::duration<double>(std::max(0.001, intervalSeconds)));
+
+	ThermalReport report;
+	report.NumSamples = report.NumFailed = report.NumHtcActive = 0;
+	report.MinTemperature = report.AvgTemperature = report.MaxTemperature = 0.0;
+	report.HtcEnabled = report.HtcWasActive = false;
+	report.Seconds = 0.0;
+
+	// the clamp in progress per core (Cpu < 0 if none)
+	ThermalClampEvent none = { -1, 0, 0.0, 0.0, 0, 0, 0.0 };
+	vector<ThermalClampEvent> open(numCPUs, none);
+
+	vector<CorePStates> pStates(numCPUs);
+	double sumTemperature = 0.0;
+	QWORD numTemperatures = 0;
+
+	auto finish = [&](int cpu)
+	{
+		report.Events.push_back(open[cpu]);
+		if (log != NULL)
+			PrintEvent(*log, open[cpu]);
+		open[cpu].Cpu = -1;
+	};
+
+	const steady_clock::time_point start = steady_clock::now();
+	const std::chrono::system_clock::time_point wallStart = std::chrono::system_clock::now();
+	const steady_clock::time_point end = start + std::chrono::duration_cast<steady_clock::duration>(std::chrono::duration<double>(seconds));
+
+	steady_clock::time_point next = start;
+
+	while ((seconds <= 0 || next < end) && !stop.load())
+	{
+		const double now = std::chrono::duration<double>(steady_clock::now() - start).count();
+
+		double temperature;
+		HtcStatus htc;
+		const bool valid = (info.TryReadTemperature(temperature) == REG_OK && info.TryReadHtcStatus(htc) == REG_OK);
+
+		report.NumSamples++;
+
+		if (!valid)
+			report.NumFailed++;
+		else
+		{
+			if (report.NumSamples == 1)
+			{
+				report.HtcEnabled = htc.Enabled;
+				report.HtcWasActive = htc.WasActive;
+			}
+
+			report.MinTemperature = (numTemperatures == 0 ? temperature : std::min(report.MinTemperature, temperature));
+			report.MaxTemperature = (numTemperatures == 0 ? temperature : std::max(report.MaxTemperature, temperature));
+			sumTemperature += temperature;
+			numTemperatures++;
+
+			if (htc.Active)
+				report.NumHtcActive++;
+
+			Sweep(info, numCPUs, pStates);
+
+			for (int i = 0; i < numCPUs; i++)
+			{
+				const CorePStates& p = pStates[i];
+
+				// slower than requested while HTC is active and limits the requested P-state
+				const bool clamped = (htc.Active && p.Valid && p.Current > p.Requested && p.Requested < htc.PStateLimit);
+
+				ThermalClampEvent& e = open[i];
+
+				if (e.Cpu >= 0 && (!clamped || p.Requested != e.RequestedPState))
+					finish(i);
+
+				if (!clamped)
+					continue;
+
+				if (e.Cpu < 0)
+				{
+					e.Cpu = i;
+					e.Start = now;
+					e.StartTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+						(wallStart + std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::duration<double>(now))).time_since_epoch()).count();
+					e.RequestedPState = p.Requested;
+					e.PState = p.Current;
+					e.MaxTemperature = temperature;
+				}
+
+				e.Duration = now - e.Start;
+				e.PState = std::max(e.PState, p.Current);
+				e.MaxTemperature = std::max(e.MaxTemperature, temperature);
+			}
+		}
+
+		// keep the rate, but skip the samples missed while being descheduled
+		next += interval;
+		const steady_clock::time_point current = steady_clock::now();
+		if (next < current)
+			next = current + interval;
+
+		std::this_thread::sleep_until(next);
+	}
+
+	for (int i = 0; i < numCPUs; i++)
+	{
+		if (open[i].Cpu >= 0)
+			finish(i);
+	}
+
+	report.AvgTemperature = (numTemperatures == 0 ? 0.0 : sumTemperature / numTemperatures);
+	report.Seconds = std::chrono::duration<double>(steady_clock::now() - start).count();
+
+	return report;
+}
+
+
+void ThermalMonitor::PrintEvent(std::ostream& os, const ThermalClampEvent& e)
+{
+	const std::ios::fmtflags flags = os.flags();
+	const std::streamsize precision = os.precision();
+	os.setf(std::ios::fixed);
+	os.precision(3);
+
+	// the UNIX time allows correlating the clamps with the logs of other tools
+	os << "  HTC clamp at " << (e.StartTime / 1000000) / 1e3 << " (+" << e.Start << " s) for " << e.Duration << " s: CPU " << e.Cpu
+	   << " in P" << e.PState << " instead of P" << e.RequestedPState;
+	os.precision(1);
+	os << ", up to " << e.MaxTemperature << " C" << endl;
+
+	os.precision(precision);
+	os.flags(flags);
+}
+
+void ThermalMonitor::Print(std::ostream& os, const ThermalReport& report) const
+{
+	const Info& info = *_info;
+
+	const std::ios::fmtflags flags = os.flags();
+	const std::streamsize precision = os.precision();
+	os.setf(std::ios::fixed);
+	os.precision(1);
+
+	os << ".:. Thermal" << endl << "---" << endl;
+
+	os << "  " << report.NumSamples << " samples in " << report.Seconds << " s";
+	if (report.NumFailed > 0)
+		os << ", " << report.NumFailed << " failed";
+	os << endl;
+
+	os << "  Temperature: " << report.MinTemperature << " / " << report.AvgTemperature << " / " << report.MaxTemperature << " C (min/avg/max)" << endl;
+
+	HtcStatus htc;
+	if (info.TryReadHtcStatus(htc) == REG_OK && htc.Enabled)
+		os << "  HTC: limit " << htc.Limit << " C (hysteresis " << htc.Hysteresis << " C), P-state limit P" << htc.PStateLimit << endl;
+	else
+		os << "  HTC: disabled" << endl;
+
+	if (report.HtcWasActive)
+		os << "  HTC has been active before the monitoring started" << endl;
+
+	os << "  HTC active in " << (report.NumSamples > 0 ? 100.0 * report.NumHtcActive / report.NumSamples : 0.0) << "% of the samples, "
+	   << report.Events.size() << " clamp events" << endl;
+
+	os.precision(precision);
+	os.flags(flags);
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <ostream>
+#include <vector>
+#include "Platform.h"
+
+class Info;
+
+
+/// <summary>A period in which HTC kept a core slower than its requested P-state.</summary>
+struct ThermalClampEvent
+{
+	int Cpu;
+	QWORD StartTime;        // wall clock, in nanoseconds since the UNIX epoch
+	double Start;           // seconds since the start of the monitoring
+	double Duration;        // seconds (up to the last sample of the clamp)
+	int RequestedPState;    // hardware P-state numbering
+	int PState;             // slowest one observed during the clamp
+	double MaxTemperature;
+};
+
+struct ThermalReport
+{
+	QWORD NumSamples;
+	QWORD NumFailed;
+	double MinTemperature;
+	double AvgTemperature;
+	double MaxTemperature;
+	QWORD NumHtcActive;     // samples in the HTC-active state
+	bool HtcEnabled;
+	bool HtcWasActive;      // HtcActSts at the start: HTC has been active before
+	double Seconds;
+	std::vector<ThermalClampEvent> Events;
+};
+
+
+/// <summary>
+/// Samples the temperature (D18F3xA4) and the HTC status (D18F3x64) along with the current and
+/// the requested P-state of each core, and reports the periods in which HTC clamped a core below
+/// the P-state requested via MSRC001_0062 (by the OS or the Worker).
+/// </summary>
+class ThermalMonitor
+{
+public:
+
+	explicit ThermalMonitor(const Info& info)
+		: _info(&info)
+	{ }
+
+	/// <summary>
+	/// Samples every interval until the period has elapsed (if positive) or the stop flag is set.
+	/// Finished clamp events are also written to the log stream, if any, as they occur.
+	/// </summary>
+	ThermalReport Run(double intervalSeconds, double seconds, const std::atomic<bool>& stop, std::ostream* log = NULL) const;
+
+	/// <summary>Prints the summary; the events are printed by PrintEvent().</summary>
+	void Print(std::ostream& os, const ThermalReport& report) const;
+
+	static void PrintEvent(std::ostream& os, const ThermalClampEvent& e);
+
+
+private:
+
+	const Info* _info;
+};
@@ -0,0 +1,407 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <thread>
+#include "TraceAnalyzer.h"
+#include "Info.h"
+#include "PStateTrace.h"
+
+#ifndef _WIN32
+#include <dirent.h>
+#endif
+
+using std::endl;
+using std::string;
+using std::vector;
+
+// sanity limit for the CPU count of a trace header, a corrupt one must not exhaust the memory
+static const DWORD MAX_TRACE_CPUS = 4096;
+
+
+vector<string> TraceAnalyzer::ListTraces(const char* path)
+{
+	vector<string> result;
+	const string dir(path);
+
+#ifdef _WIN32
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA((dir + "\\*").c_str(), &data);
+	if (find != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+				result.push_back(dir + "\\" + data.cFileName);
+		} while (FindNextFileA(find, &data));
+
+		FindClose(find);
+	}
+	else
+		result.push_back(dir);
+#else
+	DIR* d = opendir(path);
+	if (d != NULL)
+	{
+		while (const dirent* entry = readdir(d))
+		{
+			if (entry->d_name[0] != '.')
+				result.push_back(dir + "/" + entry->d_name);
+		}
+
+		closedir(d);
+	}
+	else
+		result.push_back(dir);
+#endif
+
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+
+namespace
+{
+	// the state of a core between two of its transitions
+	struct CoreState
+	{
+		int PState;       // -1 until the first event
+		double Multi;
+		QWORD Since;
+		bool InLoadOnset;
+		QWORD OnsetTime;
+	};
+}
+
+TraceStatistics TraceAnalyzer::Analyze(const string& path)
+{
+	TraceStatistics result;
+	result.Path = path;
+	result.Valid = false;
+	result.NumPStates = result.NumBoostStates = result.NumNBPStates = 0;
+	result.NbSeconds = 0.0;
+	memset(result.PStateMHz, 0, sizeof(result.PStateMHz));
+	memset(result.NbPStateSeconds, 0, sizeof(result.NbPStateSeconds));
+
+	PStateTraceReader reader;
+	if (!reader.Open(path.c_str()))
+	{
+		result.Error = "no P-state trace";
+		return result;
+	}
+
+	const PStateTraceHeader& header = reader.GetHeader();
+	result.Host.assign(header.Host, strnlen(header.Host, sizeof(header.Host)));
+
+	// decode the raw registers with the codec Info::ReadPState() uses on the recorded platform
+	const std::unique_ptr<PStateCodec> codec(PStateCodec::Create(header.Family, header.Model, header.MaxMulti));
+	if (!codec || header.NumPStates == 0 || header.NumPStates > 8 || header.NumNBPStates > 4)
+	{
+		result.Error = "unsupported CPU";
+		return result;
+	}
+
+	if (header.NumCPUs == 0 || header.NumCPUs > MAX_TRACE_CPUS)
+	{
+		result.Error = "corrupt header";
+		return result;
+	}
+
+	result.Valid = true;
+	result.NumPStates = header.NumPStates;
+	result.NumBoostStates = header.NumBoostStates;
+	result.NumNBPStates = header.NumNBPStates;
+
+	PStateInfo pStates[8];
+	codec->DecodePStates(header.PStates, pStates, result.NumPStates);
+	for (int i = 0; i < result.NumPStates; i++)
+		result.PStateMHz[i] = pStates[i].Multi * 100.0;
+
+	const int numCPUs = (int)header.NumCPUs;
+	const int slowestPState = result.NumPStates - 1;
+	const int targetPState = result.NumBoostStates; // P0 in software terms
+
+	CoreTraceStatistics empty;
+	memset(&empty, 0, sizeof(empty));
+	result.Cores.assign(numCPUs, empty);
+	for (int i = 0; i < numCPUs; i++)
+		result.Cores[i].Cpu = i;
+
+	CoreState initial = { -1, 0.0, 0, false, 0 };
+	vector<CoreState> cores(numCPUs, initial);
+
+	int nbPState = -1;
+	QWORD nbSince = 0;
+	QWORD end = 0;
+
+	// accounts the time of the previous state of a core up to the timestamp
+	auto closeCore = [&](int cpu, QWORD timestamp)
+	{
+		const CoreState& s = cores[cpu];
+		if (s.PState < 0 || timestamp <= s.Since)
+			return;
+
+		CoreTraceStatistics& stats = result.Cores[cpu];
+		const double dt = (timestamp - s.Since) / 1e9;
+		stats.Seconds += dt;
+		stats.PStateSeconds[s.PState & 7] += dt;
+		stats.MultiSeconds += s.Multi * dt;
+		if (s.PState < result.NumBoostStates)
+			stats.BoostSeconds += dt;
+	};
+
+	auto closeNb = [&](QWORD timestamp)
+	{
+		if (nbPState < 0 || timestamp <= nbSince)
+			return;
+
+		const double dt = (timestamp - nbSince) / 1e9;
+		result.NbSeconds += dt;
+		result.NbPStateSeconds[nbPState & 3] += dt;
+	};
+
+	// stream the trace block by block
+	vector<PStateTraceEvent> events;
+	for (size_t b = 0; b < reader.GetNumBlocks(); b++)
+	{
+		if (!reader.ReadBlock(b, events))
+		{
+			result.Error = "corrupt block";
+			break;
+		}
+
+		for (size_t i = 0; i < events.size(); i++)
+		{
+			const PStateTraceEvent& e = events[i];
+			end = std::max(end, e.Timestamp);
+
+			if (e.Kind == TRACE_NBPSTATE)
+			{
+				closeNb(e.Timestamp);
+				nbPState = (int)e.Value;
+				nbSince = e.Timestamp;
+				continue;
+			}
+
+			if (e.Kind != TRACE_COFVID || e.Cpu < 0 || e.Cpu >= numCPUs)
+				continue;
+
+			CofVidStatus status;
+			codec->DecodeCofVid(e.Value, status);
+
+			closeCore(e.Cpu, e.Timestamp);
+
+			CoreState& s = cores[e.Cpu];
+			CoreTraceStatistics& stats = result.Cores[e.Cpu];
+
+			if (s.PState >= 0 && status.PState != s.PState)
+			{
+				stats.NumTransitions++;
+
+				// a load onset starts when leaving the slowest P-state and ends in P0 (or a boost state);
+				// it is abandoned if the core falls back to the slowest P-state first
+				if (s.PState == slowestPState)
+				{
+					s.InLoadOnset = true;
+					s.OnsetTime = e.Timestamp;
+				}
+
+				if (s.InLoadOnset && status.PState <= targetPState)
+				{
+					const double latency = (e.Timestamp - s.OnsetTime) / 1e9;
+					stats.NumLoadOnsets++;
+					stats.TimeToP0Seconds += latency;
+					stats.MaxTimeToP0Seconds = std::max(stats.MaxTimeToP0Seconds, latency);
+					s.InLoadOnset = false;
+				}
+				else if (status.PState == slowestPState)
+					s.InLoadOnset = false;
+			}
+
+			s.PState = status.PState;
+			s.Multi = status.Multi;
+			s.Since = e.Timestamp;
+		}
+	}
+
+	// the last states last until the last recorded transition
+	for (int i = 0; i < numCPUs; i++)
+		closeCore(i, end);
+	closeNb(end);
+
+	return result;
+}
+
+
+vector<TraceStatistics> TraceAnalyzer::Run(const vector<string>& paths, int numThreads)
+{
+	if (numThreads <= 0)
+		numThreads = GetNumLogicalCPUs();
+	numThreads = std::max(1, std::min(numThreads, (int)paths.size()));
+
+	vector<TraceStatistics> result(paths.size());
+	std::atomic<size_t> next(0);
+
+	// files differ widely in size, so the threads fetch them one by one
+	vector<std::thread> workers;
+	for (int t = 0; t < numThreads; t++)
+	{
+		workers.push_back(std::thread([&]()
+		{
+			for (size_t i = next.fetch_add(1); i < paths.size(); i = next.fetch_add(1))
+			{
+				// an exception escaping a worker would terminate the whole analysis
+				try
+				{
+					result[i] = Analyze(paths[i]);
+				}
+				catch (const std::exception& e)
+				{
+					result[i] = TraceStatistics();
+					result[i].Path = paths[i];
+					result[i].Valid = false;
+					result[i].Error = string("cannot be analyzed: ") + e.what();
+				}
+			}
+		}));
+	}
+
+	for (size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+
+	return result;
+}
+
+
+void TraceAnalyzer::Print(std::ostream& os, const vector<TraceStatistics>& traces)
+{
+	const std::ios::fmtflags flags = os.flags();
+	const std::streamsize precision = os.precision();
+	os.setf(std::ios::fixed);
+	os.precision(1);
+
+	// totals of all traces, by P-state index
+	double totalSeconds = 0.0, totalBoost = 0.0, totalPStates[8] = { 0 };
+	double totalNbSeconds = 0.0, totalNb[4] = { 0 };
+	double totalTimeToP0 = 0.0, maxTimeToP0 = 0.0;
+	QWORD totalTransitions = 0, totalOnsets = 0;
+	int numValid = 0;
+
+	for (size_t t = 0; t < traces.size(); t++)
+	{
+		const TraceStatistics& trace = traces[t];
+		if (!trace.Valid)
+		{
+			os << "  " << trace.Path << ": skipped (" << trace.Error << ")" << endl;
+			continue;
+		}
+
+		numValid++;
+
+		os << ".:. " << trace.Host << " (" << trace.Path << ")";
+		if (!trace.Error.empty())
+			os << " - " << trace.Error << ", partially analyzed";
+		os << endl << "---" << endl;
+
+		os << "   ";
+		for (int p = 0; p < trace.NumPStates; p++)
+			os << " P" << p << " " << trace.PStateMHz[p] << " MHz" << (p < trace.NumBoostStates ? " (boost)" : "");
+		os << endl;
+
+		for (size_t i = 0; i < trace.Cores.size(); i++)
+		{
+			const CoreTraceStatistics& c = trace.Cores[i];
+			if (c.Seconds <= 0)
+			{
+				os << "  CPU " << c.Cpu << ": no transitions" << endl;
+				continue;
+			}
+
+			os << "  CPU " << c.Cpu << ": " << c.Seconds << " s, " << (c.NumTransitions / c.Seconds) << " transitions/s, "
+			   << (c.MultiSeconds * 100.0 / c.Seconds) << " MHz on average" << endl;
+
+			os << "   ";
+			for (int p = 0; p < trace.NumPStates; p++)
+				os << " P" << p << " " << (100.0 * c.PStateSeconds[p] / c.Seconds) << "%";
+			if (trace.NumBoostStates > 0)
+				os << ", boost " << (100.0 * c.BoostSeconds / c.Seconds) << "%";
+			os << endl;
+
+			if (c.NumLoadOnsets > 0)
+			{
+				os.precision(3);
+				os << "    time to P0: " << (1000.0 * c.TimeToP0Seconds / c.NumLoadOnsets) << " ms on average, "
+				   << (1000.0 * c.MaxTimeToP0Seconds) << " ms max (" << c.NumLoadOnsets << " load onsets)" << endl;
+				os.precision(1);
+			}
+
+			totalSeconds += c.Seconds;
+			totalBoost += c.BoostSeconds;
+			for (int p = 0; p < 8; p++)
+				totalPStates[p] += c.PStateSeconds[p];
+			totalTransitions += c.NumTransitions;
+			totalOnsets += c.NumLoadOnsets;
+			totalTimeToP0 += c.TimeToP0Seconds;
+			maxTimeToP0 = std::max(maxTimeToP0, c.MaxTimeToP0Seconds);
+		}
+
+		if (trace.NbSeconds > 0)
+		{
+			os << "   ";
+			for (int p = 0; p < trace.NumNBPStates; p++)
+				os << " NB_P" << p << " " << (100.0 * trace.NbPStateSeconds[p] / trace.NbSeconds) << "%";
+			os << endl;
+
+			totalNbSeconds += trace.NbSeconds;
+			for (int p = 0; p < 4; p++)
+				totalNb[p] += trace.NbPStateSeconds[p];
+		}
+
+		os << endl;
+	}
+
+	if (numValid > 1 && totalSeconds > 0)
+	{
+		os << ".:. All " << numValid << " traces (" << totalSeconds << " core-seconds)" << endl << "---" << endl;
+
+		os << "   ";
+		for (int p = 0; p < 8; p++)
+		{
+			if (totalPStates[p] > 0)
+				os << " P" << p << " " << (100.0 * totalPStates[p] / totalSeconds) << "%";
+		}
+		os << ", boost " << (100.0 * totalBoost / totalSeconds) << "%" << endl;
+
+		os << "    " << (totalTransitions / totalSeconds) << " transitions/s per core" << endl;
+
+		if (totalOnsets > 0)
+		{
+			os.precision(3);
+			os << "    time to P0: " << (1000.0 * totalTimeToP0 / totalOnsets) << " ms on average, "
+			   << (1000.0 * maxTimeToP0) << " ms max (" << totalOnsets << " load onsets)" << endl;
+			os.precision(1);
+		}
+
+		if (totalNbSeconds > 0)
+		{
+			os << "   ";
+			for (int p = 0; p < 4; p++)
+			{
+				if (totalNb[p] > 0)
+					os << " NB_P" << p << " " << (100.0 * totalNb[p] / totalNbSeconds) << "%";
+			}
+			os << endl;
+		}
+	}
+
+	os.precision(precision);
+	os.flags(flags);
+}
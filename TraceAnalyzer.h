@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Platform.h"
+
+
+struct CoreTraceStatistics
+{
+	int Cpu;
+	double Seconds;            // covered by known P-states
+	double PStateSeconds[8];
+	double BoostSeconds;       // in P0 .. P[NumBoostStates-1]
+	double MultiSeconds;       // integral of the current multiplier (internal one), for the average frequency
+	QWORD NumTransitions;      // P-state changes
+	QWORD NumLoadOnsets;       // departures from the slowest P-state which reached P0 (or a boost state)
+	double TimeToP0Seconds;    // summed up over the load onsets
+	double MaxTimeToP0Seconds;
+};
+
+struct TraceStatistics
+{
+	std::string Path;
+	std::string Host;
+	bool Valid;                // false if the file is no trace or unsupported; the statistics may be partial if Error is set
+	std::string Error;
+
+	int NumPStates;
+	int NumBoostStates;
+	int NumNBPStates;
+	double PStateMHz[8];       // decoded from the recorded P-state definitions
+
+	std::vector<CoreTraceStatistics> Cores;
+
+	double NbSeconds;
+	double NbPStateSeconds[4];
+};
+
+
+/// <summary>
+/// Computes residency and latency statistics of recorded P-state traces (see PStateTrace.h).
+/// Files are analyzed in parallel, each one streamed block by block.
+/// </summary>
+class TraceAnalyzer
+{
+public:
+
+	/// <summary>Returns the files of a directory (sorted by name) or the path itself if it is no directory.</summary>
+	static std::vector<std::string> ListTraces(const char* path);
+
+	static TraceStatistics Analyze(const std::string& path);
+
+	/// <summary>Analyzes the traces using the given number of threads (all logical CPUs if not positive).</summary>
+	static std::vector<TraceStatistics> Run(const std::vector<std::string>& paths, int numThreads);
+
+	static void Print(std::ostream& os, const std::vector<TraceStatistics>& traces);
+};
@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#include <chrono>
+#include <exception>
+#include <thread>
+#include "TransitionBenchmark.h"
+#include "Info.h"
+
+using std::endl;
+using std::vector;
+using std::chrono::steady_clock;
+
+typedef std::chrono::duration<double, std::micro> Microseconds;
+
+
+vector<CoreTransitions> TransitionBenchmark::Run(int iterations, double timeoutSeconds) const
+{
+	const Info& info = *_info;
+
+	const int numCPUs = GetBackend().GetNumCPUs();
+
+	// the boost P-states cannot be requested by software
+	const int firstPState = (info.IsBoostSupported ? info.NumBoostStates : 0);
+
+	vector<PStateInfo> pStates;
+	for (int i = 0; i < info.NumPStates; i++)
+		pStates.push_back(info.ReadPState(i));
+
+	// the samples of all cores per pair, for the summary
+	vector<vector<double> > allSamples(info.NumPStates * info.NumPStates);
+	vector<int> allTimeouts(info.NumPStates * info.NumPStates, 0);
+
+	vector<CoreTransitions> result;
+
+	for (int i = 0; i < numCPUs; i++)
+	{
+		CoreTransitions core;
+		core.Cpu = i;
+
+		std::exception_ptr error;
+
+		// one core at a time, the others must not compete for the shared voltage plane
+		std::thread worker([&]()
+		{
+			const int cpu = TargetCPU(i);
+
+			int requested;
+			const bool restore = (info.TryGetRequestedPState(requested, cpu) == REG_OK);
+
+			RaiseThreadPriority();
+
+			try
+			{
+
+				for (int from = firstPState; from < info.NumPStates; from++)
+				{
+					for (int to = firstPState; to < info.NumPStates; to++)
+					{
+						if (from == to)
+							continue;
+
+						TransitionLatency pair;
+						pair.From = from;
+						pair.To = to;
+						pair.NumTimeouts = 0;
+
+						vector<double> samples;
+						samples.reserve(iterations);
+
+						for (int n = 0; n < iterations; n++)
+						{
+							info.SetCurrentPState(from, cpu);
+							if (!info.WaitForPState(pStates[from], timeoutSeconds, cpu))
+							{
+								pair.NumTimeouts++;
+								continue;
+							}
+
+							const steady_clock::time_point start = steady_clock::now();
+							info.SetCurrentPState(to, cpu);
+							const bool reached = info.WaitForPState(pStates[to], timeoutSeconds, cpu);
+							const steady_clock::time_point end = steady_clock::now();
+
+							if (reached)
+								samples.push_back(Microseconds(end - start).count());
+							else
+								pair.NumTimeouts++;
+						}
+
+						const int k = from * info.NumPStates + to;
+						allSamples[k].insert(allSamples[k].end(), samples.begin(), samples.end());
+						allTimeouts[k] += pair.NumTimeouts;
+
+						pair.Latency = Statistics::Compute(samples);
+						core.Pairs.push_back(pair);
+					}
+				}
+
+			}
+			catch (...)
+			{
+				error = std::current_exception();
+			}
+
+			// the originally requested P-state is restored even if the benchmark failed
+			try
+			{
+				if (restore)
+					info.SetCurrentPState(requested, cpu);
+			}
+			catch (...)
+			{
+				if (!error)
+					error = std::current_exception();
+			}
+
+			RestoreThreadPriority();
+		});
+
+		worker.join();
+
+		if (error)
+			std::rethrow_exception(error);
+
+		result.push_back(core);
+	}
+
+	// all cores, reported as CPU -1
+	CoreTransitions all;
+	all.Cpu = -1;
+	for (int from = firstPState; from < info.NumPStates; from++)
+	{
+		for (int to = firstPState; to < info.NumPStates; to++)
+		{
+			if (from == to)
+				continue;
+
+			const int k = from * info.NumPStates + to;
+
+			TransitionLatency pair;
+			pair.From = from;
+			pair.To = to;
+			pair.NumTimeouts = allTimeouts[k];
+			pair.Latency = Statistics::Compute(allSamples[k]);
+			all.Pairs.push_back(pair);
+		}
+	}
+	result.push_back(all);
+
+	return result;
+}
+
+
+void TransitionBenchmark::Print(std::ostream& os, const vector<CoreTransitions>& cores) const
+{
+	const Info& info = *_info;
+
+	os << ".:. P-state transition latency" << endl << "---" << endl;
+
+	for (size_t i = 0; i < cores.size(); i++)
+	{
+		const CoreTransitions& core = cores[i];
+
+		if (core.Cpu < 0)
+			os << "  All CPUs:" << endl;
+		else
+			os << "  CPU " << core.Cpu << ":" << endl;
+
+		for (size_t j = 0; j < core.Pairs.size(); j++)
+		{
+			const TransitionLatency& pair = core.Pairs[j];
+			const PStateInfo from = info.ReadPState(pair.From);
+			const PStateInfo to = info.ReadPState(pair.To);
+
+			// raising the VID takes longer than lowering it
+			os << "    P" << pair.From << " -> P" << pair.To << (to.VID < from.VID ? " (VID up)" : (to.VID > from.VID ? " (VID down)" : "")) << ": ";
+			if (pair.Latency.Count > 0)
+				Statistics::Print(os, pair.Latency, "us");
+			else
+				os << "never reached";
+			if (pair.NumTimeouts > 0)
+				os << ", " << pair.NumTimeouts << " timeouts";
+			os << endl;
+		}
+	}
+}
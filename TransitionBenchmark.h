@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) Martin Kinkelin
+ *
+ * See the "License.txt" file in the root directory for infos
+ * about permitted and prohibited uses of this code.
+ */
+
+#pragma once
+
+#include <ostream>
+#include <vector>
+#include "Statistics.h"
+
+class Info;
+
+
+struct TransitionLatency
+{
+	int From;               // hardware P-state numbering
+	int To;
+	int NumTimeouts;        // the target was not reached in time (e.g., limited by HTC or the shared voltage plane)
+	Percentiles Latency;    // microseconds, successful transitions only
+};
+
+struct CoreTransitions
+{
+	int Cpu;
+	std::vector<TransitionLatency> Pairs;
+};
+
+
+/// <summary>
+/// Measures how long the hardware takes to move between the P-states: for every ordered pair of
+/// software-requestable P-states, each core is put into the first one, the second one is requested
+/// via MSRC001_0062 and MSRC001_0071 is polled until CurPstate, the multiplier and the VID reflect it.
+/// The cores are measured one after another; the requested P-states are restored afterwards.
+/// </summary>
+class TransitionBenchmark
+{
+public:
+
+	explicit TransitionBenchmark(const Info& info)
+		: _info(&info)
+	{ }
+
+	std::vector<CoreTransitions> Run(int iterations, double timeoutSeconds) const;
+
+	void Print(std::ostream& os, const std::vector<CoreTransitions>& cores) const;
+
+
+private:
+
+	const Info* _info;
+};
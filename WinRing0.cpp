@@ -5,97 +5,88 @@
  * about permitted and prohibited uses of this code.
  */
 
+#ifdef _WIN32
+
 #pragma comment(lib, "WinRing0/WinRing0.lib")
 #pragma comment(lib, "WinRing0/WinRing0x64.lib")
 
 #include "WinRing0.h"
-#include "StringUtils.h"
-
-using std::exception;
-using std::string;
+#include "WinRing0/OlsApi.h"
 
 
-DWORD ReadPciConfig(DWORD device, DWORD function, DWORD regAddress)
+static DWORD_PTR AffinityMask(int cpu)
 {
-	const DWORD pciAddress = ((device & 0x1f) << 3) | (function & 0x7);
+	return (DWORD_PTR)1 << cpu;
+}
 
-	DWORD result;
-	if (!ReadPciConfigDwordEx(pciAddress, regAddress, &result))
-	{
-		string msg = "cannot read from PCI configuration space (F";
-		msg += StringUtils::ToString(function);
-		msg += "x";
-		msg += StringUtils::ToHexString(regAddress);
-		msg += ")";
+// WinRing0 does not tell us why an access failed
+static RegisterStatus ToStatus(BOOL result)
+{
+	return (result != FALSE ? REG_OK : REG_ACCESS_FAILED);
+}
 
-		throw exception(msg.c_str());
-	}
 
-	return result;
+WinRing0Backend::~WinRing0Backend()
+{
+	if (_initialized)
+		DeinitializeOls();
 }
 
-void WritePciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD value)
+bool WinRing0Backend::Initialize()
 {
-	const DWORD pciAddress = ((device & 0x1f) << 3) | (function & 0x7);
-
-	if (!WritePciConfigDwordEx(pciAddress, regAddress, value))
+	if (!InitializeOls() || GetDllStatus() != 0)
 	{
-		string msg = "cannot write to PCI configuration space (F";
-		msg += StringUtils::ToString(function);
-		msg += "x";
-		msg += StringUtils::ToHexString(regAddress);
-		msg += ")";
-
-		throw exception(msg.c_str());
+		DeinitializeOls();
+		return false;
 	}
+
+	_initialized = true;
+	return true;
 }
 
 
-QWORD Rdmsr(DWORD index)
+RegisterStatus WinRing0Backend::Rdmsr(int cpu, DWORD index, QWORD& value)
 {
-	QWORD result;
-	PDWORD eax = (PDWORD)&result;
+	PDWORD eax = (PDWORD)&value;
 	PDWORD edx = eax + 1;
 
-	if (!Rdmsr(index, eax, edx))
-	{
-		string msg = "cannot read from MSR (0x";
-		msg += StringUtils::ToHexString(index);
-		msg += ")";
-
-		throw exception(msg.c_str());
-	}
+	if (cpu == CURRENT_CPU)
+		return ToStatus(::Rdmsr(index, eax, edx));
 
-	return result;
+	return ToStatus(RdmsrTx(index, eax, edx, AffinityMask(cpu)));
 }
 
-void Wrmsr(DWORD index, const QWORD& value)
+RegisterStatus WinRing0Backend::Wrmsr(int cpu, DWORD index, QWORD value)
 {
 	PDWORD eax = (PDWORD)&value;
 	PDWORD edx = eax + 1;
 
-	if (!Wrmsr(index, *eax, *edx))
-	{
-		string msg = "cannot write to MSR (0x";
-		msg += StringUtils::ToHexString(index);
-		msg += ")";
+	if (cpu == CURRENT_CPU)
+		return ToStatus(::Wrmsr(index, *eax, *edx));
 
-		throw exception(msg.c_str());
-	}
+	return ToStatus(WrmsrTx(index, *eax, *edx, AffinityMask(cpu)));
 }
 
 
-CpuidRegs Cpuid(DWORD index)
+RegisterStatus WinRing0Backend::ReadPciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD& value)
 {
-	CpuidRegs result;
-	if (!Cpuid(index, &result.eax, &result.ebx, &result.ecx, &result.edx))
-	{
-		string msg = "cannot execute CPUID instruction (0x";
-		msg += StringUtils::ToHexString(index);
-		msg += ")";
+	const DWORD pciAddress = ((device & 0x1f) << 3) | (function & 0x7);
+	return ToStatus(ReadPciConfigDwordEx(pciAddress, regAddress, &value));
+}
+
+RegisterStatus WinRing0Backend::WritePciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD value)
+{
+	const DWORD pciAddress = ((device & 0x1f) << 3) | (function & 0x7);
+	return ToStatus(WritePciConfigDwordEx(pciAddress, regAddress, value));
+}
 
-		throw exception(msg.c_str());
-	}
 
-	return result;
+RegisterStatus WinRing0Backend::Cpuid(int cpu, DWORD index, CpuidRegs& regs)
+{
+	if (cpu == CURRENT_CPU)
+		return ToStatus(::Cpuid(index, &regs.eax, &regs.ebx, &regs.ecx, &regs.edx));
+
+	return ToStatus(CpuidTx(index, &regs.eax, &regs.ebx, &regs.ecx, &regs.edx, AffinityMask(cpu)));
 }
+
+#endif
@@ -7,43 +7,39 @@
 
 #pragma once
 
-#define WIN32_MEAN_AND_LEAN
-#include <windows.h>
-#undef min
-#undef max
+#include "RegisterAccess.h"
 
-#include "WinRing0/OlsApi.h"
 
+/// <summary>
+/// Windows backend based on the WinRing0 driver.
+/// Accesses to other CPUs than the current one temporarily move the calling thread.
+/// </summary>
+class WinRing0Backend : public RegisterBackend
+{
+public:
 
-typedef unsigned long long QWORD;
+	WinRing0Backend()
+		: _initialized(false)
+	{ }
 
-struct CpuidRegs
-{
-	DWORD eax;
-	DWORD ebx;
-	DWORD ecx;
-	DWORD edx;
-};
+	~WinRing0Backend();
 
-static const DWORD AMD_CPU_DEVICE = 0x18; // first AMD CPU
+	const char* GetName() const { return "WinRing0"; }
 
-DWORD ReadPciConfig(DWORD device, DWORD function, DWORD regAddress);
-void WritePciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD value);
+	bool Initialize();
 
-QWORD Rdmsr(DWORD index);
-void Wrmsr(DWORD index, const QWORD& value);
+	bool IsCpuAddressable() const { return false; }
 
-CpuidRegs Cpuid(DWORD index);
+	RegisterStatus Rdmsr(int cpu, DWORD index, QWORD& value);
+	RegisterStatus Wrmsr(int cpu, DWORD index, QWORD value);
 
+	RegisterStatus ReadPciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD& value);
+	RegisterStatus WritePciConfig(DWORD device, DWORD function, DWORD regAddress, DWORD value);
 
-template <typename T> DWORD GetBits(T value, unsigned char offset, unsigned char numBits)
-{
-	const T mask = (((T)1 << numBits) - (T)1); // 2^numBits - 1; after right-shift
-	return (DWORD)((value >> offset) & mask);
-}
+	RegisterStatus Cpuid(int cpu, DWORD index, CpuidRegs& regs);
 
-template <typename T> void SetBits(T& value, DWORD bits, unsigned char offset, unsigned char numBits)
-{
-	const T mask = (((T)1 << numBits) - (T)1) << offset; // 2^numBits - 1, shifted by offset to the left
-	value = (value & ~mask) | (((T)bits << offset) & mask);
-}
+
+private:
+
+	bool _initialized;
+};
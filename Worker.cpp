@@ -6,13 +6,15 @@
  */
 
 #include <algorithm>
-#include <chrono>
+#include <atomic>
 #include <iostream>
 #include <locale>
-#include <thread>
+#include <stdexcept>
 #include "Worker.h"
+#include "ParallelApply.h"
+#include "Registers.h"
+#include "RegisterTransaction.h"
 #include "StringUtils.h"
-#include "WinRing0.h"
 
 using std::cerr;
 using std::endl;
@@ -22,6 +24,9 @@ using std::string;
 using std::tolower;
 using std::vector;
 
+// max time per P-state transition when re-applying the active P-state (typically < 0.1 ms, more if the VID rises)
+static const double TRANSITION_TIMEOUT = 0.01; // seconds
+
 static void SplitPair(string& left, string& right, const string& str, char delimiter)
 {
 	const size_t i = str.find(delimiter);
@@ -35,6 +40,16 @@ static void SplitPair(string& left, string& right, const string& str, char delim
 
 }
 
+// the encoders clamp silently, Compile() refuses values beyond the limits of the CPU
+static void CheckRange(vector<string>& errors, const string& what, double value, double minValue, double maxValue, const char* unit)
+{
+	if (value < minValue || value > maxValue)
+	{
+		errors.push_back(what + " " + StringUtils::ToString(value) + unit + " is outside of " +
+		                 StringUtils::ToString(minValue) + " - " + StringUtils::ToString(maxValue) + unit);
+	}
+}
+
 bool Worker::ParseParams(int argc, const char* argv[])
 {
 	const Info& info = *_info;
@@ -44,7 +59,7 @@ bool Worker::ParseParams(int argc, const char* argv[])
 	psi.NBPState = -1;
 
 	NBPStateInfo nbpsi;
-	nbpsi.Multi = 1.0;
+	nbpsi.Multi = -1.0;
 	nbpsi.VID = -1;
 
 	for (int i = 0; i < info.NumPStates; i++)
@@ -92,6 +107,11 @@ bool Worker::ParseParams(int argc, const char* argv[])
 					if (!vid.empty())
 						_pStates[index].VID = info.EncodeVID(atof(vid.c_str()));
 
+					if (!multi.empty() && info.MaxMulti > 0)
+						CheckRange(_rangeErrors, key + " multiplier", atof(multi.c_str()), info.MinMulti / info.multiScaleFactor, info.MaxMulti / info.multiScaleFactor, "");
+					if (!vid.empty())
+						CheckRange(_rangeErrors, key + " voltage", atof(vid.c_str()), info.MinVID, info.MaxVID, " V");
+
 					continue;
 				}
 			}
@@ -109,6 +129,12 @@ bool Worker::ParseParams(int argc, const char* argv[])
 					if (!vid.empty())
 						_nbPStates[index].VID = info.EncodeVID(atof(vid.c_str()));
 
+					const std::vector<MultiTable::Entry>& nbMultis = PStateCodec::GetNbMultiTable().GetEntries();
+					if (!multi.empty())
+						CheckRange(_rangeErrors, key + " multiplier", atof(multi.c_str()), nbMultis.front().Multi, nbMultis.back().Multi, "");
+					if (!vid.empty())
+						CheckRange(_rangeErrors, key + " voltage", atof(vid.c_str()), info.MinVID, info.MaxVID, " V");
+
 					continue;
 				}
 			}
@@ -166,10 +192,25 @@ bool Worker::ParseParams(int argc, const char* argv[])
 				}
 			}
 
+			if (_stricmp(key.c_str(), "ShowPlan") == 0)
+			{
+				_showPlan = (atoi(value.c_str()) != 0);
+				continue;
+			}
+
+			if (_stricmp(key.c_str(), "Snapshot") == 0)
+			{
+				_snapshotPath = value;
+				continue;
+			}
+
 			if (_stricmp(key.c_str(), "NbPsi0Vid") == 0)
 			{
 				if (!value.empty())
+				{
 					_NbPsi0Vid_VID = info.EncodeVID(atof(value.c_str()));
+					CheckRange(_rangeErrors, key + " voltage", atof(value.c_str()), info.MinVID, info.MaxVID, " V");
+				}
 
 				continue;
 			}
@@ -192,25 +233,63 @@ static bool ContainsChanges(const NBPStateInfo& info)
 	return (info.Multi >= 0 || info.VID >= 0);
 }
 
-static void SwitchTo(int logicalCPUIndex)
+bool Worker::HasChanges() const
 {
-	const HANDLE hThread = GetCurrentThread();
-	SetThreadAffinityMask(hThread, (DWORD_PTR)1 << logicalCPUIndex);
+	for (size_t i = 0; i < _pStates.size(); i++)
+	{
+		if (ContainsChanges(_pStates[i]))
+			return true;
+	}
+
+	for (size_t i = 0; i < _nbPStates.size(); i++)
+	{
+		if (ContainsChanges(_nbPStates[i]))
+			return true;
+	}
+
+	return (_pState >= 0 || _turbo >= 0 || _apm >= 0 || _NbPsi0Vid_VID >= 0 || _boostEnAllCores >= 0 || _ignoreBoostThresh >= 0);
 }
 
-void Worker::ApplyChanges()
+
+void ApplyPlan::Print(std::ostream& os) const
+{
+	os << ".:. Apply plan" << endl << "---" << endl;
+
+	bool empty = NodeRegisters.IsEmpty();
+	if (!NodeRegisters.IsEmpty())
+	{
+		os << "  Node-wide registers:" << endl;
+		NodeRegisters.Print(os, "    ");
+	}
+
+	for (size_t i = 0; i < CoreRegisters.size(); i++)
+	{
+		if (CoreRegisters[i].IsEmpty() && NewPState[i] < 0 && BouncePState[i] < 0)
+			continue;
+
+		empty = false;
+		os << "  CPU " << i << ":" << endl;
+		CoreRegisters[i].Print(os, "    ");
+
+		if (NewPState[i] >= 0)
+			os << "    switch to P" << NewPState[i] << endl;
+		if (BouncePState[i] >= 0)
+			os << "    re-enter P" << BouncePState[i] << " (new definition)" << endl;
+	}
+
+	if (empty)
+		os << "  nothing to do" << endl;
+	if (NumSkipped > 0)
+		os << "  " << NumSkipped << " register(s) already up to date" << endl;
+}
+
+
+void Worker::AddNodeChanges(RegisterTransaction& transaction, vector<PStateInfo>& pStates) const
 {
 	const Info& info = *_info;
-#ifdef _DEBUG
-	unsigned short sleepDelay = 0;
-	string sleepText = ", waiting for " + std::to_string(sleepDelay) + "seconds.";
-#endif
 
-	// Apply NB P-states
-#ifdef _DEBUG
-	cerr << "Applying NB P-states" << sleepText << endl;
-	std::this_thread::sleep_for(std::chrono::seconds(sleepDelay));
-#endif
+	// node-wide registers are shared by all cores; gather all changes and write each register once
+
 	//Changing NB P-states causes system hang on Carrizo (Model == 0x60), disable for now
 	if (info.Family == 0x15 && info.Model != 0x60)
 	{
@@ -218,14 +297,14 @@ void Worker::ApplyChanges()
 		{
 			const NBPStateInfo& nbpsi = _nbPStates[i];
 			if (ContainsChanges(nbpsi))
-				info.WriteNBPState(nbpsi);
+				info.WriteNBPState(nbpsi, transaction);
 		}
 	}
 	else if (info.Family == 0x10 && (_nbPStates[0].VID >= 0 || _nbPStates[1].VID >= 0))
 	{
-		for (int i = 0; i < _pStates.size(); i++)
+		for (int i = 0; i < pStates.size(); i++)
 		{
-			PStateInfo& psi = _pStates[i];
+			PStateInfo& psi = pStates[i];
 
 			const int nbPState = (psi.NBPState >= 0 ? psi.NBPState : info.ReadPState(i).NBPState);
 			const NBPStateInfo& nbpsi = _nbPStates[nbPState];
@@ -235,118 +314,377 @@ void Worker::ApplyChanges()
 		}
 	}
 #ifdef _DEBUG
-	if (_nbPStates.size() > 0 && (info.Family == 0x15 && info.Model != 0x60))
-	{
-		cerr << "NB P-states successfully applied" << endl;
-	}
-	else if (info.Family == 0x15 && info.Model == 0x60)
-	{
-		cerr << "Modifying P-states on Carrizo is disabled for now (causes system hang)" << endl;
-	}
-	else
-	{
-		cerr << "No P-states applied (non were specified)" << endl;
-	}
+	if (info.Family == 0x15 && info.Model == 0x60)
+		cerr << "Modifying NB P-states on Carrizo is disabled for now (causes system hang)" << endl;
 #endif
 
-	// Applying turbo
-#ifdef _DEBUG
-	cerr << "Configuring turbo and APM (if supported)" << sleepText << endl;
-	std::this_thread::sleep_for(std::chrono::seconds(sleepDelay));
-#endif
 	if (_turbo >= 0 && info.IsBoostSupported)
 	{
-		info.SetBoostSource(_turbo == 1);
+		info.SetBoostSource(_turbo == 1, transaction);
 	}
 	if (_boostEnAllCores >= 0 && info.BoostEnAllCores != -1)
 	{
-		info.SetBoostEnAllCores(_boostEnAllCores);
+		info.SetBoostEnAllCores(_boostEnAllCores, transaction);
 	}
 	if (_ignoreBoostThresh >= 0 && info.IgnoreBoostThresh != -1)
 	{
-		info.SetIgnoreBoostThresh(_ignoreBoostThresh);
+		info.SetIgnoreBoostThresh(_ignoreBoostThresh, transaction);
 	}
 	if (_apm >= 0 && info.Family == 0x15)
 	{
-		info.SetAPM(_apm == 1);
+		info.SetAPM(_apm == 1, transaction);
 	}
-
 	if (_NbPsi0Vid_VID >= 0 && info.Family == 0x15)
 	{
-#ifdef _DEBUG
-		cerr << "Writing NbPsi0Vid" << sleepText << endl;
-		std::this_thread::sleep_for(std::chrono::seconds(sleepDelay));
-#endif
-		info.WriteNbPsi0Vid(_NbPsi0Vid_VID);
+		info.WriteNbPsi0Vid(_NbPsi0Vid_VID, transaction);
 	}
+}
 
-	SYSTEM_INFO sysInfo;
-	GetSystemInfo(&sysInfo);
-	const int numLogicalCPUs = sysInfo.dwNumberOfProcessors;
-
-	// switch to the highest thread priority (we do not want to get interrupted often)
-	const HANDLE hProcess = GetCurrentProcess();
-	const HANDLE hThread = GetCurrentThread();
-	SetPriorityClass(hProcess, REALTIME_PRIORITY_CLASS);
-	SetThreadPriority(hThread, THREAD_PRIORITY_HIGHEST);
+void Worker::AddCoreChanges(const vector<PStateInfo>& pStates, RegisterTransaction& transaction, int cpu) const
+{
+	const Info& info = *_info;
 
-	// Write P-states, perform one iteration in each logical core
-#ifdef _DEBUG
-	if (_pStates.size() > 0)
+	for (int i = 0; i < pStates.size(); i++)
 	{
-		cerr << "Writing P-states" << sleepText << endl;
-		std::this_thread::sleep_for(std::chrono::seconds(sleepDelay));
+		const PStateInfo& psi = pStates[i];
+		if (ContainsChanges(psi))
+			info.WritePState(psi, transaction, cpu);
 	}
-#endif
-	for (int j = 0; j < numLogicalCPUs; j++)
+
+	if (_turbo >= 0 && info.IsBoostSupported)
+		info.SetCPBDis(_turbo == 1, transaction, cpu);
+}
+
+
+ApplyPlan Worker::Plan() const
+{
+	ApplyPlan plan;
+	plan.NumSkipped = 0;
+
+	vector<PStateInfo> pStates = _pStates;
+	AddNodeChanges(plan.NodeRegisters, pStates);
+
+	PlanCores(plan, [&](int, int cpu, RegisterTransaction& coreTransaction)
 	{
-		SwitchTo(j);
+		AddCoreChanges(pStates, coreTransaction, cpu);
+		return _pState;
+	});
 
-		for (int i = 0; i < _pStates.size(); i++)
-		{
-			const PStateInfo& psi = _pStates[i];
-			if (ContainsChanges(psi))
-				info.WritePState(psi);
-		}
+	return plan;
+}
+
+
+static DWORD GetCpuSignature()
+{
+	return Cpuid(0x80000001).eax;
+}
+
+bool Worker::Compile(CompiledProfile& profile) const
+{
+	const Info& info = *_info;
+
+	// settings Plan() would skip on this CPU are errors as well
+	vector<string> errors = _rangeErrors;
 
-		if (_turbo >= 0 && info.IsBoostSupported)
-			info.SetCPBDis(_turbo == 1);
+	const bool nbPStatesSupported = (info.Family == 0x15 && info.Model != 0x60);
+	for (size_t i = 0; i < _nbPStates.size(); i++)
+	{
+		const NBPStateInfo& nbpsi = _nbPStates[i];
+		if ((nbpsi.Multi >= 0 && !nbPStatesSupported) || (nbpsi.VID >= 0 && !nbPStatesSupported && info.Family != 0x10))
+			errors.push_back("NB_P" + StringUtils::ToString(i) + " cannot be modified on this CPU");
 	}
 
-	// Set P-states, perform one iteration in each logical core
-#ifdef _DEBUG
-	if (ContainsChanges(_pStates[info.GetCurrentPState()]))
+	if (_turbo >= 0 && !info.IsBoostSupported)
+		errors.push_back("Turbo is not supported by this CPU");
+	if (_boostEnAllCores >= 0 && info.BoostEnAllCores == -1)
+		errors.push_back("BoostEnAllCores is not supported by this CPU");
+	if (_ignoreBoostThresh >= 0 && info.IgnoreBoostThresh == -1)
+		errors.push_back("IgnoreBoostThresh is not supported by this CPU");
+	if (_apm >= 0 && info.Family != 0x15)
+		errors.push_back("APM is only supported by family 0x15");
+	if (_NbPsi0Vid_VID >= 0 && info.Family != 0x15)
+		errors.push_back("NbPsi0Vid is only supported by family 0x15");
+
+	if (!errors.empty())
 	{
-		cerr << "Settings P-states" << sleepText << endl;
-		std::this_thread::sleep_for(std::chrono::seconds(sleepDelay));
+		for (size_t i = 0; i < errors.size(); i++)
+			cerr << "ERROR: " << errors[i] << endl;
+
+		return false;
 	}
-#endif
-	for (int j = 0; j < numLogicalCPUs; j++)
+
+	profile.CpuSignature = GetCpuSignature();
+	profile.NumPStates = info.NumPStates;
+	profile.MaxMulti = info.MaxMulti;
+	profile.PState = _pState;
+	profile.NodeRegisters.Clear();
+	profile.CoreRegisters.Clear();
+
+	// the P-state definitions are encoded the same way for every core
+	vector<PStateInfo> pStates = _pStates;
+	AddNodeChanges(profile.NodeRegisters, pStates);
+	AddCoreChanges(pStates, profile.CoreRegisters, CURRENT_CPU);
+
+	return true;
+}
+
+ApplyPlan Worker::PlanProfile(const CompiledProfile& profile) const
+{
+	const Info& info = *_info;
+
+	if (profile.CpuSignature != GetCpuSignature() || profile.NumPStates != info.NumPStates || profile.MaxMulti != info.MaxMulti)
+		throw std::runtime_error("profile " + profile.Name + " has been compiled for a different CPU");
+
+	ApplyPlan plan;
+	plan.NumSkipped = 0;
+	plan.NodeRegisters = profile.NodeRegisters;
+
+	const vector<RegisterChange>& changes = profile.CoreRegisters.GetChanges();
+
+	PlanCores(plan, [&](int, int cpu, RegisterTransaction& coreTransaction)
 	{
-		SwitchTo(j);
+		for (size_t i = 0; i < changes.size(); i++)
+			coreTransaction.SetMsrMasked(changes[i].Register.Address, changes[i].Mask, changes[i].Value, cpu);
+
+		return profile.PState;
+	});
+
+	return plan;
+}
 
-		const int currentPState = info.GetCurrentPState();
-		const int newPState = (_pState >= 0 ? _pState : currentPState);
+ApplyPlan Worker::PlanRestore(const RegisterSnapshot& snapshot) const
+{
+	const Info& info = *_info;
+
+	ApplyPlan plan;
+	plan.NumSkipped = 0;
+
+	const vector<SnapshotEntry>& entries = snapshot.Entries;
+
+	// the whole registers are written back
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		const SnapshotEntry& entry = entries[i];
+		const RegisterId& reg = entry.Register;
 
-		if (newPState != currentPState)
-			info.SetCurrentPState(newPState);
+		if (entry.CpuIndex >= 0)
+			continue;
+
+		if (reg.Type == MSR_REGISTER)
+			plan.NodeRegisters.SetMsrMasked(reg.Address, ~0ULL, entry.Value);
 		else
+			plan.NodeRegisters.SetPciMasked(reg.Device, reg.Function, reg.Address, 0xffffffff, (DWORD)entry.Value);
+	}
+
+	PlanCores(plan, [&](int index, int cpu, RegisterTransaction& coreTransaction)
+	{
+		int pState = -1;
+
+		for (size_t i = 0; i < entries.size(); i++)
 		{
-			if (ContainsChanges(_pStates[currentPState]))
+			const SnapshotEntry& entry = entries[i];
+			if (entry.CpuIndex != index)
+				continue;
+
+			// the P-state request is restored by a transition, like any other one
+			if (entry.Register.Address == MSRC001_0062::Index)
+				pState = (int)MSRC001_0062::PstateCmd::Get(entry.Value) + info.NumBoostStates;
+			else
+				coreTransaction.SetMsrMasked(entry.Register.Address, ~0ULL, entry.Value, cpu);
+		}
+
+		return pState;
+	});
+
+	return plan;
+}
+
+void Worker::PlanCores(ApplyPlan& plan, const CoreChanges& coreChanges) const
+{
+	const Info& info = *_info;
+
+	plan.NumSkipped += plan.NodeRegisters.RemoveNoOps();
+
+	// the per-core registers are read on their cores, all at once
+	const int numLogicalCPUs = GetBackend().GetNumCPUs();
+	plan.CoreRegisters.resize(numLogicalCPUs);
+	plan.NewPState.assign(numLogicalCPUs, -1);
+	plan.BouncePState.assign(numLogicalCPUs, -1);
+	plan.PStateControl.assign(numLogicalCPUs, 0);
+	std::atomic<int> numSkipped(0);
+
+	ParallelApply::RunIndexed(numLogicalCPUs, [&](int index, int cpu)
+	{
+		RegisterTransaction& coreTransaction = plan.CoreRegisters[index];
+
+		const int pState = coreChanges(index, cpu, coreTransaction);
+
+		numSkipped += coreTransaction.RemoveNoOps();
+
+		const int currentPState = info.GetCurrentPState(cpu);
+
+		// software cannot request the boost P-states, SetCurrentPState() requests the fastest non-boosted one instead
+		if (pState >= 0)
+		{
+			int requested;
+			if (info.TryGetRequestedPState(requested, cpu) != REG_OK || requested != max(pState, info.NumBoostStates))
+				plan.NewPState[index] = pState;
+		}
+
+		// the new definition of the active P-state only takes effect after a transition into it
+		const std::vector<RegisterChange>& changes = coreTransaction.GetChanges();
+		for (size_t i = 0; i < changes.size(); i++)
+		{
+			if (changes[i].Register.Type == MSR_REGISTER && changes[i].Register.Address == MSRC001_0064::Index + currentPState &&
+			    (plan.NewPState[index] < 0 || plan.NewPState[index] == currentPState))
 			{
-				const int tempPState = (currentPState == info.NumPStates - 1 ? 0 : info.NumPStates - 1);
-				info.SetCurrentPState(tempPState);
-				Sleep(1);
-				info.SetCurrentPState(currentPState);
+				plan.BouncePState[index] = currentPState;
+				plan.NewPState[index] = -1;
 			}
 		}
+
+		// the transitions overwrite the P-state request
+		if (plan.NewPState[index] >= 0 || plan.BouncePState[index] >= 0)
+			plan.PStateControl[index] = Rdmsr(MSRC001_0062::Index, cpu);
+	});
+
+	plan.NumSkipped += numSkipped;
+}
+
+
+RegisterSnapshot Worker::Snapshot(const ApplyPlan& plan) const
+{
+	RegisterSnapshot snapshot;
+	snapshot.Family = _info->Family;
+	snapshot.Model = _info->Model;
+	snapshot.NumCPUs = (int)plan.CoreRegisters.size();
+
+	const vector<RegisterChange>& nodeChanges = plan.NodeRegisters.GetChanges();
+	for (size_t i = 0; i < nodeChanges.size(); i++)
+		snapshot.Add(nodeChanges[i].Register, -1, nodeChanges[i].Current);
+
+	for (int index = 0; index < snapshot.NumCPUs; index++)
+	{
+		const vector<RegisterChange>& changes = plan.CoreRegisters[index].GetChanges();
+		for (size_t i = 0; i < changes.size(); i++)
+			snapshot.Add(changes[i].Register, index, changes[i].Current);
+
+		if (plan.NewPState[index] >= 0 || plan.BouncePState[index] >= 0)
+			snapshot.Add(RegisterId::Msr(MSRC001_0062::Index, CURRENT_CPU), index, plan.PStateControl[index]);
 	}
 
-	SetThreadPriority(hThread, THREAD_PRIORITY_NORMAL);
-	SetPriorityClass(hProcess, NORMAL_PRIORITY_CLASS);
+	return snapshot;
+}
+
 
+void Worker::Execute(ApplyPlan& plan) const
+{
+	const Info& info = *_info;
+
+#ifdef _DEBUG
+	cerr << "Writing node-wide registers" << endl;
+	plan.NodeRegisters.Print(cerr);
+#endif
+	plan.NodeRegisters.Commit();
+
+	const int numLogicalCPUs = (int)plan.CoreRegisters.size();
+
+	bool needsTransitions = false;
+	for (int i = 0; i < numLogicalCPUs; i++)
+		needsTransitions |= (plan.NewPState[i] >= 0 || plan.BouncePState[i] >= 0);
+
+	// switch to the highest thread priority (we do not want to get interrupted often)
+	RaiseThreadPriority();
+
+	// all cores write their P-state MSRs simultaneously, so the machine does not run in a mixed state for long
+	ParallelApplyReport report = ParallelApply::RunIndexed(numLogicalCPUs, [&](int index, int)
+	{
+		plan.CoreRegisters[index].Commit();
+	});
 #ifdef _DEBUG
-	cerr << "Successfully executed all steps, exiting in 5 seconds" << endl;
-	std::this_thread::sleep_for(std::chrono::seconds(5));
+	cerr << "P-states written on " << report.NumCPUs << " logical CPUs in " << report.TotalMicroseconds
+	     << " us (skew " << report.SkewMicroseconds << " us)" << endl;
 #endif
+
+	// the boost P-states cannot be requested by software
+	const int firstPState = (info.IsBoostSupported ? info.NumBoostStates : 0);
+	std::atomic<int> numUnconfirmed(0);
+
+	if (needsTransitions)
+	{
+		report = ParallelApply::RunIndexed(numLogicalCPUs, [&](int index, int cpu)
+		{
+			if (plan.NewPState[index] >= 0)
+				info.SetCurrentPState(plan.NewPState[index], cpu);
+
+			const int activePState = plan.BouncePState[index];
+			const int tempPState = (activePState == info.NumPStates - 1 ? firstPState : info.NumPStates - 1);
+
+			// bounce via another P-state and confirm both transitions via the per-core COFVID status (the cores share
+			// the voltage plane and bounce simultaneously, so the VID only needs to provide the target voltage)
+			if (activePState >= 0 && tempPState != activePState)
+			{
+				info.SetCurrentPState(tempPState, cpu);
+				const bool left = info.WaitForPState(info.ReadPState(tempPState, cpu), TRANSITION_TIMEOUT, cpu);
+
+				info.SetCurrentPState(activePState, cpu);
+				if (!left || !info.WaitForPState(info.ReadPState(activePState, cpu), TRANSITION_TIMEOUT, cpu))
+					numUnconfirmed++;
+			}
+		});
+#ifdef _DEBUG
+		cerr << "P-states set on " << report.NumCPUs << " logical CPUs in " << report.TotalMicroseconds
+		     << " us (skew " << report.SkewMicroseconds << " us)" << endl;
+#endif
+	}
+
+	RestoreThreadPriority();
+
+	// e.g., limited by HTC, or the voltage regulator not ramping up in time
+	if (numUnconfirmed > 0)
+	{
+		cerr << "WARNING: the new definition of the active P-state has not taken effect on " << numUnconfirmed
+		     << " logical CPU(s) within " << (TRANSITION_TIMEOUT * 1000) << " ms" << endl;
+	}
+}
+
+
+void Worker::ApplyChanges()
+{
+	ApplyPlan plan = Plan();
+	Apply(plan);
+}
+
+void Worker::Apply(ApplyPlan& plan) const
+{
+	if (_showPlan)
+		plan.Print(std::cout);
+
+	// all or nothing: nothing is written unless the original values are safe
+	const RegisterSnapshot snapshot = Snapshot(plan);
+	if (!_snapshotPath.empty() && !snapshot.Save(_snapshotPath.c_str()))
+		throw std::runtime_error("cannot write snapshot " + _snapshotPath);
+
+	try
+	{
+		Execute(plan);
+	}
+	catch (...)
+	{
+		cerr << "Apply failed, rolling back " << snapshot.Entries.size() << " register(s)" << endl;
+
+		try
+		{
+			ApplyPlan rollback = PlanRestore(snapshot);
+			Execute(rollback);
+		}
+		catch (const std::exception& e)
+		{
+			cerr << "ERROR: rollback failed: " << e.what() << endl;
+			if (!_snapshotPath.empty())
+				cerr << "The original values can be restored by: AmdMsrTweaker restore file=" << _snapshotPath << endl;
+		}
+
+		throw;
+	}
 }
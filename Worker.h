@@ -7,8 +7,31 @@
 
 #pragma once
 
+#include <functional>
+#include <ostream>
+#include <string>
 #include <vector>
 #include "Info.h"
+#include "Profile.h"
+#include "RegisterSnapshot.h"
+#include "RegisterTransaction.h"
+
+
+/// <summary>
+/// The register writes and P-state transitions needed to get from the current state of the hardware
+/// to the requested configuration.
+/// </summary>
+struct ApplyPlan
+{
+	RegisterTransaction NodeRegisters;              // written once
+	std::vector<RegisterTransaction> CoreRegisters; // per logical CPU, written by a thread on that CPU
+	std::vector<int> NewPState;                     // per logical CPU: P-state to be requested, -1 to keep it
+	std::vector<int> BouncePState;                  // per logical CPU: active P-state to be re-entered for its new definition, -1 if none
+	std::vector<QWORD> PStateControl;               // per logical CPU: MSRC001_0062 before the transitions (if any)
+	int NumSkipped;                                 // registers already holding the requested values
+
+	void Print(std::ostream& os) const;
+};
 
 
 class Worker
@@ -23,15 +46,64 @@ public:
 		, _NbPsi0Vid_VID(-1)
 		, _boostEnAllCores(-1)
 		, _ignoreBoostThresh(-1)
+		, _showPlan(false)
 	{ }
 
 	bool ParseParams(int argc, const char* argv[]);
 
+	/// <summary>Returns whether the parsed parameters request any changes (i.e., more than options like ShowPlan=1).</summary>
+	bool HasChanges() const;
+
+	/// <summary>
+	/// Reads the affected registers once and determines the writes and P-state transitions which are
+	/// actually required; registers already holding the requested values are left alone.
+	/// </summary>
+	ApplyPlan Plan() const;
+
+	/// <summary>
+	/// Plans writing back a snapshot taken on this machine: registers changed since then are restored
+	/// and the P-states requested back then are requested again.
+	/// </summary>
+	ApplyPlan PlanRestore(const RegisterSnapshot& snapshot) const;
+
+	/// <summary>
+	/// Checks the parsed parameters against the limits of the CPU and encodes them into the register bits to be set.
+	/// Returns false (reporting the errors to stderr) if any value is out of range.
+	/// </summary>
+	bool Compile(CompiledProfile& profile) const;
+
+	/// <summary>Like Plan(), for a profile compiled on this machine. Throws if it has been compiled for another CPU.</summary>
+	ApplyPlan PlanProfile(const CompiledProfile& profile) const;
+
+	/// <summary>Returns the values of all registers the plan is going to write, as read by Plan().</summary>
+	RegisterSnapshot Snapshot(const ApplyPlan& plan) const;
+
+	void Execute(ApplyPlan& plan) const;
+
+	/// <summary>
+	/// Executes a plan, printing it first if requested (ShowPlan=1).
+	/// The original register values are saved first (Snapshot=<file>) and restored if the apply fails,
+	/// after which the error is rethrown.
+	/// </summary>
+	void Apply(ApplyPlan& plan) const;
+
+	/// <summary>Plans and applies the parsed changes.</summary>
 	void ApplyChanges();
 
 
 private:
 
+	/// <summary>Adds the changes of a core to its transaction and returns the P-state to be requested (-1 to keep it).</summary>
+	typedef std::function<int(int index, int cpu, RegisterTransaction& transaction)> CoreChanges;
+
+	/// <summary>Drops the no-ops of the node-wide registers and plans the registers and transitions of each core.</summary>
+	void PlanCores(ApplyPlan& plan, const CoreChanges& coreChanges) const;
+
+	/// <summary>Adds the node-wide changes; family 0x10 folds the NB VIDs into the P-states instead.</summary>
+	void AddNodeChanges(RegisterTransaction& transaction, std::vector<PStateInfo>& pStates) const;
+
+	void AddCoreChanges(const std::vector<PStateInfo>& pStates, RegisterTransaction& transaction, int cpu) const;
+
 	const Info* _info;
 	std::vector<PStateInfo> _pStates;
 	std::vector<NBPStateInfo> _nbPStates;
@@ -41,4 +113,7 @@ private:
 	int _NbPsi0Vid_VID; // 
 	int _boostEnAllCores;
 	int _ignoreBoostThresh;
+	bool _showPlan;
+	std::string _snapshotPath;
+	std::vector<std::string> _rangeErrors; // P-state multipliers/voltages beyond the limits of the CPU
 };